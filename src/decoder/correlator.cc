@@ -34,6 +34,10 @@ const char* correlationTypeToString(correlationType t) {
   return "";
 }
 
+uint64_t encodedSyncWord(correlationType type) {
+  return encodedSyncWords[type];
+}
+
 int correlate(uint8_t* data, size_t len, int* maxOut, correlationType* maxType) {
   uint64_t tmp = 0;
 
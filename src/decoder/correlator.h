@@ -19,6 +19,10 @@ extern const unsigned encodedSyncWordBits;
 
 const char* correlationTypeToString(correlationType type);
 
+// Returns the encoded sync word that correlate matches for a type.
+// The most significant bit comes first in the bit stream.
+uint64_t encodedSyncWord(correlationType type);
+
 // Correlates bit stream with sync words.
 // This function is only used when there is no signal lock, so we can
 // afford to correlate with both LRIT and HRIT sync words. Doing this
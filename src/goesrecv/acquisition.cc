@@ -0,0 +1,129 @@
+#include "acquisition.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// FFT size and number of FFTs averaged per estimate
+constexpr size_t fftSize = 4096;
+constexpr size_t averages = 8;
+
+// Ratio of the peak power to the median power for a valid estimate
+constexpr float threshold = 10.0f;
+
+} // namespace
+
+Acquisition::Acquisition(uint32_t sampleRate, float maxDeviation)
+    : timeoutSamples_(lockTimeout * sampleRate),
+      size_(fftSize),
+      fft_(fftSize),
+      window_(fftSize),
+      tmp_(fftSize),
+      power_(fftSize, 0.0f),
+      pos_(0),
+      count_(0),
+      state_(State::SEARCH),
+      samples_(0),
+      packets_(0),
+      seen_(0) {
+  // The tone is at twice the offset
+  maxBin_ = std::min<double>(
+    (2 * maxDeviation * size_) / (2 * M_PI),
+    size_ / 2 - 2);
+
+  for (size_t i = 0; i < size_; i++) {
+    window_[i] = 0.5f - 0.5f * cosf((2 * M_PI * i) / size_);
+  }
+}
+
+bool Acquisition::work(
+    size_t nsamples,
+    const std::complex<float>* fi,
+    float* frequency) {
+  const auto packets = packets_.load(std::memory_order_relaxed);
+  const bool packet = (packets != seen_);
+  seen_ = packets;
+
+  // The loop has locked, whether or not it was seeded
+  if (packet) {
+    state_ = State::LOCKED;
+    samples_ = 0;
+    return false;
+  }
+
+  switch (state_) {
+  case State::LOCKED:
+  case State::PULL_IN:
+    samples_ += nsamples;
+    if (samples_ >= timeoutSamples_) {
+      state_ = State::SEARCH;
+      pos_ = 0;
+      count_ = 0;
+      std::fill(power_.begin(), power_.end(), 0.0f);
+    }
+    return false;
+  case State::SEARCH:
+    break;
+  }
+
+  // Average the spectra of consecutive FFTs worth of squared samples
+  for (size_t i = 0; i < nsamples && count_ < averages; i++) {
+    tmp_[pos_] = fi[i] * fi[i] * window_[pos_];
+    if (++pos_ < size_) {
+      continue;
+    }
+    fft_.run(tmp_.data());
+    for (size_t j = 0; j < size_; j++) {
+      power_[j] += std::norm(tmp_[j]);
+    }
+    pos_ = 0;
+    count_++;
+  }
+
+  if (count_ < averages) {
+    return false;
+  }
+
+  const bool found = estimate(frequency);
+  count_ = 0;
+  std::fill(power_.begin(), power_.end(), 0.0f);
+  if (!found) {
+    return false;
+  }
+
+  state_ = State::PULL_IN;
+  samples_ = 0;
+  return true;
+}
+
+bool Acquisition::estimate(float* frequency) {
+  // Bin k is at index k modulo the size
+  auto power = [this] (int k) {
+    return power_[(k + size_) % size_];
+  };
+
+  int peak = 0;
+  for (int k = -maxBin_; k <= maxBin_; k++) {
+    if (power(k) > power(peak)) {
+      peak = k;
+    }
+  }
+
+  std::vector<float> sorted(power_);
+  std::nth_element(sorted.begin(), sorted.begin() + size_ / 2, sorted.end());
+  if (power(peak) < threshold * sorted[size_ / 2]) {
+    return false;
+  }
+
+  // Parabolic interpolation of the magnitude around the peak
+  const float a = sqrtf(power(peak - 1));
+  const float b = sqrtf(power(peak));
+  const float c = sqrtf(power(peak + 1));
+  const float d = a - 2 * b + c;
+  const float delta = (d < 0.0f) ? 0.5f * (a - c) / d : 0.0f;
+
+  // Halve the frequency of the squared signal
+  *frequency = (M_PI * (peak + delta)) / size_;
+  return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <complex>
+#include <vector>
+
+#include "fft.h"
+
+// Acquisition finds the carrier of a BPSK signal before the Costas
+// loop has locked on to it, such that the loop doesn't have to sweep
+// toward a carrier that is far off (e.g. with the oscillator of an
+// RTL-SDR 10-20 kHz off).
+//
+// Squaring a BPSK signal removes the modulation, and leaves a tone at
+// twice the carrier offset. Its frequency is found from the peak of
+// the averaged power spectrum of the squared samples, interpolated
+// between bins. Only offsets up to the maximum deviation of the loop
+// are considered, and a peak must stand out from the noise.
+//
+// The decoder reports every packet it decodes. Without packets for
+// a while (lockTimeout), the signal is considered lost, and a new
+// estimate is made. After seeding the loop with an estimate, it gets
+// the same time to lock before the next estimate is made. The loop
+// uses a wider bandwidth until it has locked (see Costas).
+//
+class Acquisition {
+public:
+  // Time without packets after which the signal is considered lost
+  static constexpr double lockTimeout = 2.0;
+
+  // Sample rate in Hz, maximum deviation in radians per sample.
+  explicit Acquisition(uint32_t sampleRate, float maxDeviation);
+
+  // Reports a decoded packet. Safe to call from any thread.
+  void notify() {
+    packets_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Returns true if the loop has not locked (it should use its
+  // acquisition bandwidth).
+  bool isAcquiring() const {
+    return state_ != State::LOCKED;
+  }
+
+  // Processes a block of samples before the loop derotates them.
+  // Returns true if the loop must continue at a new frequency (in
+  // radians per sample).
+  bool work(size_t nsamples, const std::complex<float>* fi, float* frequency);
+
+protected:
+  enum class State {
+    SEARCH,
+    PULL_IN,
+    LOCKED,
+  };
+
+  // Returns true if the spectrum has a peak, and its frequency.
+  bool estimate(float* frequency);
+
+  const uint64_t timeoutSamples_;
+  const size_t size_;
+  int maxBin_;
+
+  FFT fft_;
+  std::vector<float> window_;
+  std::vector<std::complex<float> > tmp_;
+  std::vector<float> power_;
+
+  // Position in the current FFT, and number of FFTs averaged
+  size_t pos_;
+  size_t count_;
+
+  State state_;
+
+  // Samples since the last estimate or packet
+  uint64_t samples_;
+
+  // Packets reported by the decoder, and seen by work
+  std::atomic<uint64_t> packets_;
+  uint64_t seen_;
+};
@@ -2,23 +2,60 @@
 
 #include <cmath>
 
+#include <util/error.h>
+
 #ifdef __ARM_NEON
 #include <arm_neon.h>
 #endif
 
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
 AGC::AGC() {
   min_ = 1e-6f;
   max_ = 1e+6f;
   alpha_ = 1e-4f;
   gain_ = 1e0f;
+  reportedGain_ = gain_;
+  simd_ = simdBest();
 }
 
-#ifdef __ARM_NEON
+void AGC::setSIMD(SIMD simd) {
+  ASSERT(simdSupported(simd));
+  simd_ = simd;
+}
 
 void AGC::work(
     size_t nsamples,
     std::complex<float>* ci,
     std::complex<float>* co) {
+  switch (simd_) {
+#ifdef __ARM_NEON
+  case SIMD::NEON:
+    workNEON(nsamples, ci, co);
+    break;
+#endif
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+    workSSE41(nsamples, ci, co);
+    break;
+  case SIMD::AVX2:
+    workAVX2(nsamples, ci, co);
+    break;
+#endif
+  default:
+    workScalar(nsamples, ci, co);
+    break;
+  }
+}
+
+#ifdef __ARM_NEON
+
+void AGC::workNEON(
+    size_t nsamples,
+    std::complex<float>* ci,
+    std::complex<float>* co) {
   float* fi = (float*) ci;
   float* fo = (float*) co;
 
@@ -53,9 +90,9 @@ void AGC::work(
   gain_ = gain[0];
 }
 
-#else
+#endif
 
-void AGC::work(
+void AGC::workScalar(
     size_t nsamples,
     std::complex<float>* ci,
     std::complex<float>* co) {
@@ -75,15 +112,121 @@ void AGC::work(
   }
 }
 
+#ifdef SIMD_X86
+
+// The gain update only depends on the magnitude of the first sample
+// of every group of 4. These magnitudes are computed for multiple
+// groups at once, after which the (serial) gain updates are cheap.
+
+TARGET_SSE41
+void AGC::workSSE41(
+    size_t nsamples,
+    std::complex<float>* ci,
+    std::complex<float>* co) {
+  float* fi = (float*) ci;
+  float* fo = (float*) co;
+  float m[4];
+  float g[4];
+
+  // Process 16 samples (4 gain updates) at a time.
+  size_t i = 0;
+  for (; i + 16 <= nsamples; i += 16) {
+    __m128 v[8];
+    for (size_t j = 0; j < 8; j++) {
+      v[j] = _mm_loadu_ps(&fi[2*i + 4*j]);
+    }
+
+    // Magnitude of input samples 0, 4, 8, and 12.
+    __m128 a = _mm_movelh_ps(v[0], v[2]);
+    __m128 b = _mm_movelh_ps(v[4], v[6]);
+    a = _mm_mul_ps(a, a);
+    b = _mm_mul_ps(b, b);
+    _mm_storeu_ps(m, _mm_sqrt_ps(_mm_hadd_ps(a, b)));
+
+    // Magnitude of output sample is gain times magnitude of input.
+    for (size_t j = 0; j < 4; j++) {
+      g[j] = update(m[j]);
+    }
+
+    // Apply gain.
+    for (size_t j = 0; j < 8; j++) {
+      __m128 gain = _mm_set1_ps(g[j / 2]);
+      _mm_storeu_ps(&fo[2*i + 4*j], _mm_mul_ps(v[j], gain));
+    }
+  }
+
+  // Remainder
+  workScalar(nsamples - i, &ci[i], &co[i]);
+}
+
+TARGET_AVX2
+void AGC::workAVX2(
+    size_t nsamples,
+    std::complex<float>* ci,
+    std::complex<float>* co) {
+  float* fi = (float*) ci;
+  float* fo = (float*) co;
+  float m[8];
+  float g[8];
+
+  // Process 32 samples (8 gain updates) at a time.
+  // Every 256 bit register holds a single group of 4 samples.
+  size_t i = 0;
+  for (; i + 32 <= nsamples; i += 32) {
+    __m256 v[8];
+    for (size_t j = 0; j < 8; j++) {
+      v[j] = _mm256_loadu_ps(&fi[2*i + 8*j]);
+    }
+
+    // Magnitude of the first sample in every group.
+    __m128 a = _mm_movelh_ps(
+      _mm256_castps256_ps128(v[0]), _mm256_castps256_ps128(v[1]));
+    __m128 b = _mm_movelh_ps(
+      _mm256_castps256_ps128(v[2]), _mm256_castps256_ps128(v[3]));
+    __m128 c = _mm_movelh_ps(
+      _mm256_castps256_ps128(v[4]), _mm256_castps256_ps128(v[5]));
+    __m128 d = _mm_movelh_ps(
+      _mm256_castps256_ps128(v[6]), _mm256_castps256_ps128(v[7]));
+    a = _mm_mul_ps(a, a);
+    b = _mm_mul_ps(b, b);
+    c = _mm_mul_ps(c, c);
+    d = _mm_mul_ps(d, d);
+    _mm_storeu_ps(&m[0], _mm_sqrt_ps(_mm_hadd_ps(a, b)));
+    _mm_storeu_ps(&m[4], _mm_sqrt_ps(_mm_hadd_ps(c, d)));
+
+    // Magnitude of output sample is gain times magnitude of input.
+    for (size_t j = 0; j < 8; j++) {
+      g[j] = update(m[j]);
+    }
+
+    // Apply gain.
+    for (size_t j = 0; j < 8; j++) {
+      __m256 gain = _mm256_set1_ps(g[j]);
+      _mm256_storeu_ps(&fo[2*i + 8*j], _mm256_mul_ps(v[j], gain));
+    }
+  }
+
+  // Remainder
+  workScalar(nsamples - i, &ci[i], &co[i]);
+}
+
 #endif
 
-void AGC::work(
+void AGC::process(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo) {
+  work(nsamples, fi, fo);
+  reportedGain_.store(gain_, std::memory_order_relaxed);
+}
+
+size_t AGC::work(
     const std::shared_ptr<Queue<Samples> >& qin,
     const std::shared_ptr<Queue<Samples> >& qout) {
   auto input = qin->popForRead();
   if (!input) {
     qout->close();
-    return;
+    return 0;
   }
 
   auto output = qout->popForWrite();
@@ -94,6 +237,7 @@ void AGC::work(
   auto ci = input->data();
   auto co = output->data();
   work(nsamples, ci, co);
+  reportedGain_.store(gain_, std::memory_order_relaxed);
 
   // Return input buffer
   qin->pushRead(std::move(input));
@@ -105,4 +249,5 @@ void AGC::work(
 
   // Return output buffer
   qout->pushWrite(std::move(output));
+  return nsamples;
 }
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 
 #include "sample_publisher.h"
+#include "simd.h"
 #include "types.h"
 
 class AGC {
@@ -17,28 +20,88 @@ public:
     max_ = max;
   }
 
+  // Select kernel implementation (defaults to best supported).
+  void setSIMD(SIMD simd);
+
+  SIMD getSIMD() const {
+    return simd_;
+  }
+
   void setSamplePublisher(std::unique_ptr<SamplePublisher> samplePublisher) {
     samplePublisher_ = std::move(samplePublisher);
   }
 
+  // Safe to call from any thread; updated once per block.
   float getGain() const {
-    return gain_;
+    return reportedGain_.load(std::memory_order_relaxed);
   }
 
-  void work(
+  // Processes a single block of samples.
+  // Returns the number of samples consumed (0 if the input has closed).
+  size_t work(
       const std::shared_ptr<Queue<Samples> >& qin,
       const std::shared_ptr<Queue<Samples> >& qout);
 
+  // Processes samples that are not passed through a queue (see Fused).
+  // The sample publisher is not called.
+  void process(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo);
+
+  // Returns the gain for a group of 4 samples, and updates it from the
+  // magnitude of the first input sample of the group. For kernels
+  // that apply the gain themselves (see Costas::process).
+  SIMD_INLINE float update(float magnitude) {
+    const float gain = gain_;
+    gain_ += alpha_ * (0.5f - gain_ * magnitude);
+    gain_ = std::max(gain_, min_);
+    gain_ = std::min(gain_, max_);
+    return gain;
+  }
+
+  // Makes the gain after calls to update available to getGain.
+  void report() {
+    reportedGain_.store(gain_, std::memory_order_relaxed);
+  }
+
 protected:
   void work(
       size_t nsamples,
       std::complex<float>* fi,
       std::complex<float>* fo);
 
+  void workScalar(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo);
+
+#ifdef __ARM_NEON
+  void workNEON(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo);
+#endif
+
+#ifdef SIMD_X86
+  TARGET_SSE41 void workSSE41(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo);
+
+  TARGET_AVX2 void workAVX2(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo);
+#endif
+
+  SIMD simd_;
+
   float min_;
   float max_;
   float gain_;
   float alpha_;
+  std::atomic<float> reportedGain_;
 
   std::unique_ptr<SamplePublisher> samplePublisher_;
 };
@@ -7,6 +7,8 @@
 
 #include <util/error.h>
 
+#include "scheduling.h"
+
 std::unique_ptr<Airspy> Airspy::open(uint32_t index) {
   struct airspy_device* dev = nullptr;
   auto rv = airspy_open(&dev);
@@ -21,7 +23,7 @@ std::unique_ptr<Airspy> Airspy::open(uint32_t index) {
   return std::make_unique<Airspy>(dev);
 }
 
-Airspy::Airspy(struct airspy_device* dev) : dev_(dev) {
+Airspy::Airspy(struct airspy_device* dev) : dev_(dev), scheduled_(false) {
   // Load list of supported sample rates
   sampleRates_ = loadSampleRates();
 
@@ -79,6 +81,19 @@ void Airspy::setBiasTee(bool on) {
   ASSERT(rv >= 0);
 }
 
+void Airspy::setRealSamples(bool on) {
+  ASSERT(dev_ != nullptr);
+  auto rv = airspy_set_sample_type(
+    dev_,
+    on ? AIRSPY_SAMPLE_INT16_REAL : AIRSPY_SAMPLE_FLOAT32_IQ);
+  ASSERT(rv == 0);
+  if (on) {
+    downconverter_ = std::make_unique<RealDownconverter>();
+  } else {
+    downconverter_.reset();
+  }
+}
+
 static int airspy_callback(airspy_transfer* transfer) {
   auto airspy = reinterpret_cast<Airspy*>(transfer->ctx);
   airspy->handle(transfer);
@@ -88,6 +103,7 @@ static int airspy_callback(airspy_transfer* transfer) {
 void Airspy::start(const std::shared_ptr<Queue<Samples> >& queue) {
   ASSERT(dev_ != nullptr);
   queue_ = queue;
+  scheduled_ = false;
   thread_ = std::thread([&] {
       auto rv = airspy_start_rx(dev_, &airspy_callback, this);
       ASSERT(rv == 0);
@@ -115,10 +131,31 @@ void Airspy::stop() {
 }
 
 void Airspy::handle(const airspy_transfer* transfer) {
+  if (!scheduled_) {
+    Scheduling::apply("source");
+    scheduled_ = true;
+  }
+
+  // Raw transfers hold 2 real samples per complex sample
   auto nsamples = transfer->sample_count;
-  auto out = queue_->popForWrite();
+  if (downconverter_) {
+    nsamples /= 2;
+  }
+
+  auto out = popForWrite(*queue_, nsamples);
+  if (!out) {
+    return;
+  }
   out->resize(nsamples);
-  memcpy(out->data(), transfer->samples, nsamples * sizeof(std::complex<float>));
+  if (downconverter_) {
+    downconverter_->work(
+      simd_,
+      transfer->sample_count,
+      (const int16_t*) transfer->samples,
+      out->data());
+  } else {
+    memcpy(out->data(), transfer->samples, nsamples * sizeof(std::complex<float>));
+  }
 
   // Publish output if applicable
   if (samplePublisher_) {
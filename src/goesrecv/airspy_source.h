@@ -8,6 +8,7 @@
 
 #include <libairspy/airspy.h>
 
+#include "downconvert.h"
 #include "source.h"
 
 class Airspy : public Source {
@@ -31,6 +32,11 @@ public:
 
   void setBiasTee(bool on);
 
+  // Request raw real samples from the device instead of complex
+  // samples converted by libairspy, and convert them on the USB
+  // thread (see RealDownconverter). Call before start.
+  void setRealSamples(bool on);
+
   void setSamplePublisher(std::unique_ptr<SamplePublisher> samplePublisher) {
     samplePublisher_ = std::move(samplePublisher);
   }
@@ -48,9 +54,16 @@ protected:
   std::vector<uint32_t> sampleRates_;
   std::uint32_t sampleRate_;
 
+  // Set if the device produces raw real samples
+  std::unique_ptr<RealDownconverter> downconverter_;
+
   // Background RX thread
   std::thread thread_;
 
+  // Set once the thread that libairspy calls back on has been
+  // scheduled (the thread above only starts streaming)
+  bool scheduled_;
+
   // Set on start; cleared on stop
   std::shared_ptr<Queue<Samples> > queue_;
 
@@ -0,0 +1,387 @@
+#include "autotune.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include <toml/toml.h>
+#include <util/time.h>
+
+#include "agc.h"
+#include "clock_recovery.h"
+#include "convert.h"
+#include "costas.h"
+#include "frontend.h"
+#include "quantize.h"
+#include "rrc.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Time spent benchmarking a single implementation of a kernel
+constexpr auto kernelDuration = std::chrono::milliseconds(200);
+
+// Time spent benchmarking the chain of kernels for a single block size
+constexpr auto chainDuration = std::chrono::milliseconds(500);
+
+// Block size used to compare implementations of a kernel
+constexpr uint32_t kernelBlockSize = 64 * 1024;
+
+// Block sizes to try for the complete chain. These are all valid
+// transfer sizes for the RTL-SDR (a multiple of 512 bytes).
+const uint32_t blockSizes[] = {
+  16 * 1024,
+  32 * 1024,
+  64 * 1024,
+  128 * 1024,
+  256 * 1024,
+};
+
+uint64_t elapsed(Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    Clock::now() - start).count();
+}
+
+// Returns the instruction sets to try for a kernel. Only the sample
+// conversion has an SSE2 variant; other kernels would run their
+// scalar implementation.
+std::vector<SIMD> supported(const std::string& name) {
+  std::vector<SIMD> out;
+  for (auto simd : { SIMD::NONE, SIMD::NEON, SIMD::SSE2, SIMD::SSE41, SIMD::AVX2 }) {
+    if (simd == SIMD::SSE2 && name != "source") {
+      continue;
+    }
+    if (simdSupported(simd)) {
+      out.push_back(simd);
+    }
+  }
+  return out;
+}
+
+// Noisy BPSK signal with a small carrier offset, such that the loops
+// in the kernels have something to track.
+Samples signal(size_t nsamples, uint32_t sampleRate, uint32_t symbolRate) {
+  std::mt19937 gen(1);
+  std::normal_distribution<float> noise(0.0f, 0.1f);
+  std::uniform_int_distribution<int> bit(0, 1);
+  const double sps = (double) sampleRate / (double) symbolRate;
+  Samples out(nsamples);
+  float symbol = 1.0f;
+  for (size_t i = 0, j = 0; i < nsamples; i++) {
+    if (i >= j * sps) {
+      symbol = bit(gen) ? 1.0f : -1.0f;
+      j++;
+    }
+    auto carrier = std::polar(0.5f, 0.001f * i);
+    out[i] = carrier * symbol + std::complex<float>(noise(gen), noise(gen));
+  }
+  return out;
+}
+
+// Same signal as it would be produced by an RTL-SDR.
+std::vector<uint8_t> signalU8(const Samples& samples) {
+  std::vector<uint8_t> out(samples.size() * 2);
+  for (size_t i = 0; i < samples.size(); i++) {
+    const float v[2] = { samples[i].real(), samples[i].imag() };
+    for (size_t j = 0; j < 2; j++) {
+      out[i * 2 + j] = std::max(0.0f, std::min(255.0f, v[j] * 128.0f + 127.4f));
+    }
+  }
+  return out;
+}
+
+// Returns samples per second spent in the work function of a stage.
+template <typename T, typename Out>
+double measureStage(T& stage, const Samples& input) {
+  auto qin = std::make_shared<LockingQueue<Samples> >(1);
+  auto qout = std::make_shared<LockingQueue<Out> >(1);
+  uint64_t nanos = 0;
+  uint64_t nsamples = 0;
+  auto start = Clock::now();
+  while (Clock::now() - start < kernelDuration) {
+    auto in = qin->popForWrite();
+    in->assign(input.begin(), input.end());
+    qin->pushWrite(std::move(in));
+
+    auto t0 = Clock::now();
+    stage.work(qin, qout);
+    nanos += elapsed(t0);
+    nsamples += input.size();
+
+    auto out = qout->popForRead();
+    qout->pushRead(std::move(out));
+  }
+  return (1e9 * nsamples) / nanos;
+}
+
+// Returns samples per second for both 8 bit sample conversions.
+double measureConvert(SIMD simd, const std::vector<uint8_t>& input) {
+  const auto nsamples = input.size() / 2;
+  Samples out(nsamples);
+  uint64_t nanos = 0;
+  uint64_t total = 0;
+  auto start = Clock::now();
+  while (Clock::now() - start < kernelDuration) {
+    auto t0 = Clock::now();
+    convertU8(simd, nsamples, input.data(), out.data());
+    convertS8(simd, nsamples, (const int8_t*) input.data(), out.data());
+    nanos += elapsed(t0);
+    total += 2 * nsamples;
+  }
+  return (1e9 * total) / nanos;
+}
+
+// Picks the fastest implementation and logs all of them.
+SIMD fastest(
+    const std::string& name,
+    std::ostream& log,
+    std::function<double(SIMD)> measure) {
+  SIMD best = SIMD::NONE;
+  double bestRate = 0.0;
+  log << "  " << name << ":";
+  for (auto simd : supported(name)) {
+    auto rate = measure(simd);
+    log << " " << simdName(simd) << "=" << (rate / 1e6) << "M";
+    if (rate > bestRate) {
+      best = simd;
+      bestRate = rate;
+    }
+  }
+  log << " -> " << simdName(best) << std::endl;
+  return best;
+}
+
+// Returns samples per second through the chain built by the factory,
+// from the source conversion up to and including quantization.
+double measureChain(
+    const ChainFactory& chain,
+    const std::map<std::string, SIMD>& kernels,
+    uint32_t blockSize) {
+  auto step = chain(kernels, blockSize);
+  uint64_t nsamples = 0;
+  auto start = Clock::now();
+  while (Clock::now() - start < chainDuration) {
+    step();
+    nsamples += blockSize;
+  }
+  return (1e9 * nsamples) / elapsed(start);
+}
+
+} // namespace
+
+BenchmarkSource::BenchmarkSource(
+    Format format,
+    uint32_t sampleRate,
+    uint32_t symbolRate,
+    uint32_t blockSize)
+    : format_(format),
+      sampleRate_(sampleRate),
+      blockSize_(blockSize) {
+  const auto samples = signal(blockSize, sampleRate, symbolRate);
+  switch (format_) {
+  case Format::CU8:
+    raw_ = signalU8(samples);
+    break;
+  case Format::CS8:
+    raw_.resize(blockSize * 2 * sizeof(int8_t));
+    for (size_t i = 0; i < blockSize * 2; i++) {
+      const auto v = ((const float*) samples.data())[i];
+      ((int8_t*) raw_.data())[i] = std::max(-128.0f, std::min(127.0f, v * 128.0f));
+    }
+    break;
+  case Format::CS16:
+    raw_.resize(blockSize * 2 * sizeof(int16_t));
+    for (size_t i = 0; i < blockSize * 2; i++) {
+      const auto v = ((const float*) samples.data())[i];
+      ((int16_t*) raw_.data())[i] = std::max(-32768.0f, std::min(32767.0f, v * 32768.0f));
+    }
+    break;
+  case Format::CF32:
+    raw_.resize(blockSize * sizeof(std::complex<float>));
+    memcpy(raw_.data(), samples.data(), raw_.size());
+    break;
+  case Format::S16_REAL:
+    // Undo the mixing of the downconverter: real samples alternate
+    // between the real and imaginary part of the signal, and every
+    // other pair is negated.
+    raw_.resize(blockSize * 2 * sizeof(int16_t));
+    for (size_t i = 0; i < blockSize * 2; i++) {
+      const auto v = ((const float*) samples.data())[i] * ((i & 2) ? -1.0f : 1.0f);
+      ((int16_t*) raw_.data())[i] = std::max(-32768.0f, std::min(32767.0f, v * 32768.0f));
+    }
+    downconverter_ = std::make_unique<RealDownconverter>();
+    break;
+  }
+}
+
+void BenchmarkSource::produce(Queue<Samples>& queue) {
+  auto out = queue.popForWrite();
+  out->resize(blockSize_);
+  switch (format_) {
+  case Format::CU8:
+    convertU8(simd_, blockSize_, raw_.data(), out->data());
+    break;
+  case Format::CS8:
+    convertS8(simd_, blockSize_, (const int8_t*) raw_.data(), out->data());
+    break;
+  case Format::CS16:
+    convertS16(simd_, blockSize_, (const int16_t*) raw_.data(), out->data());
+    break;
+  case Format::CF32:
+    memcpy(out->data(), raw_.data(), raw_.size());
+    break;
+  case Format::S16_REAL:
+    downconverter_->work(
+      simd_,
+      blockSize_ * 2,
+      (const int16_t*) raw_.data(),
+      out->data());
+    break;
+  }
+  queue.pushWrite(std::move(out));
+}
+
+uint32_t blockSizeMultiple(int decimation) {
+  uint32_t a = 4;
+  uint32_t b = decimation;
+  while (b != 0) {
+    const auto t = a % b;
+    a = b;
+    b = t;
+  }
+  return (4 * decimation) / a;
+}
+
+Tuning autotune(
+    uint32_t sampleRate,
+    uint32_t symbolRate,
+    int decimation,
+    const ChainFactory& chain,
+    std::ostream& log) {
+  Tuning tuning;
+  const auto multiple = blockSizeMultiple(decimation);
+  const auto n = kernelBlockSize - (kernelBlockSize % multiple);
+  const auto input = signal(n, sampleRate, symbolRate);
+  const auto inputRRC = signal(n, sampleRate / decimation, symbolRate);
+
+  log << "Kernels (samples per second):" << std::endl;
+  tuning.kernels["source"] = fastest("source", log, [&] (SIMD simd) {
+      return measureConvert(simd, signalU8(input));
+    });
+  tuning.kernels["frontend"] = fastest("frontend", log, [&] (SIMD simd) {
+      // Include both the frequency shift and (at least) one filter
+      const auto bandwidth = 0.75 * symbolRate;
+      const auto decimation = std::max(
+        2, FrontEnd::decimation(sampleRate, symbolRate, bandwidth));
+      FrontEnd frontEnd(sampleRate, decimation, 0.01 * sampleRate, bandwidth);
+      frontEnd.setSIMD(simd);
+      return measureStage<FrontEnd, Samples>(frontEnd, input);
+    });
+  tuning.kernels["agc"] = fastest("agc", log, [&] (SIMD simd) {
+      AGC agc;
+      agc.setSIMD(simd);
+      return measureStage<AGC, Samples>(agc, input);
+    });
+  tuning.kernels["costas"] = fastest("costas", log, [&] (SIMD simd) {
+      Costas costas;
+      costas.setSIMD(simd);
+      return measureStage<Costas, Samples>(costas, input);
+    });
+  tuning.kernels["rrc"] = fastest("rrc", log, [&] (SIMD simd) {
+      RRC rrc(decimation, sampleRate, symbolRate);
+      rrc.setSIMD(simd);
+      return measureStage<RRC, Samples>(rrc, input);
+    });
+  tuning.kernels["clock_recovery"] = fastest("clock_recovery", log, [&] (SIMD simd) {
+      ClockRecovery clockRecovery(sampleRate / decimation, symbolRate);
+      clockRecovery.setSIMD(simd);
+      return measureStage<ClockRecovery, Samples>(clockRecovery, inputRRC);
+    });
+  tuning.kernels["quantization"] = fastest("quantization", log, [&] (SIMD simd) {
+      Quantize quantize;
+      quantize.setSIMD(simd);
+      return measureStage<Quantize, std::vector<int8_t> >(quantize, inputRRC);
+    });
+
+  // Larger blocks amortize per block overhead but may no longer fit
+  // in cache, and they add latency. Prefer the smaller block size if
+  // the difference in throughput is within a few percent.
+  log << "Block sizes (samples per second):" << std::endl;
+  double bestRate = 0.0;
+  for (auto blockSize : blockSizes) {
+    auto rate = measureChain(
+      chain, tuning.kernels, blockSize - (blockSize % multiple));
+    log << "  " << blockSize << ": " << (rate / 1e6) << "M" << std::endl;
+    if (rate > 1.05 * bestRate) {
+      tuning.blockSize = blockSize;
+      bestRate = rate;
+    }
+  }
+  log << "  -> " << tuning.blockSize << std::endl;
+
+  return tuning;
+}
+
+void saveTuning(const std::string& path, const Tuning& tuning) {
+  std::ofstream out(path);
+  if (!out) {
+    std::stringstream ss;
+    ss << "Unable to open " << path << ": " << strerror(errno);
+    throw std::runtime_error(ss.str());
+  }
+
+  out << "# Generated by goesrecv --autotune at " << util::stringTime() << std::endl;
+  out << "# Remove this file to use the defaults." << std::endl;
+  out << "block_size = " << tuning.blockSize << std::endl;
+  out << std::endl;
+  out << "[kernels]" << std::endl;
+  for (const auto& it : tuning.kernels) {
+    out << it.first << " = \"" << simdName(it.second) << "\"" << std::endl;
+  }
+
+  out.close();
+  if (!out) {
+    std::stringstream ss;
+    ss << "Unable to write " << path << ": " << strerror(errno);
+    throw std::runtime_error(ss.str());
+  }
+}
+
+Tuning loadTuning(const std::string& path) {
+  Tuning out;
+
+  auto pr = toml::parseFile(path);
+  if (!pr.valid()) {
+    throw std::invalid_argument(path + ": " + pr.errorReason);
+  }
+
+  const auto& table = pr.value.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key == "block_size") {
+      out.blockSize = value.as<int>();
+      continue;
+    }
+
+    if (key == "kernels") {
+      for (const auto& jt : value.as<toml::Table>()) {
+        out.kernels[jt.first] = simdFromName(jt.second.as<std::string>());
+      }
+      continue;
+    }
+
+    throw std::invalid_argument(path + ": invalid key: " + key);
+  }
+
+  return out;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "downconvert.h"
+#include "simd.h"
+#include "source.h"
+
+// Result of benchmarking the DSP kernels on this host.
+struct Tuning {
+  // Fastest implementation of every kernel, keyed by kernel name
+  // ("source", "frontend", "agc", "costas", "rrc", "clock_recovery",
+  // "quantization").
+  std::map<std::string, SIMD> kernels;
+
+  // Number of samples per block with the highest throughput through
+  // the complete chain of kernels (0 if unknown).
+  uint32_t blockSize = 0;
+};
+
+// BenchmarkSource produces blocks of a noisy BPSK signal in the raw
+// sample format of the configured source, converted with the "source"
+// kernel, such that the chain measured by autotune includes the same
+// conversion as the real source. Blocks are produced on the calling
+// thread, on every call to produce; start and stop do nothing.
+class BenchmarkSource : public Source {
+public:
+  enum class Format {
+    // Interleaved I/Q (RTL-SDR, rtl_tcp, nanomsg, and files)
+    CU8,
+    CS8,
+    CS16,
+    CF32,
+    // Real samples at twice the sample rate (raw Airspy samples)
+    S16_REAL,
+  };
+
+  explicit BenchmarkSource(
+      Format format,
+      uint32_t sampleRate,
+      uint32_t symbolRate,
+      uint32_t blockSize);
+
+  virtual uint32_t getSampleRate() const override {
+    return sampleRate_;
+  }
+
+  virtual void start(const std::shared_ptr<Queue<Samples> >& queue) override {
+  }
+
+  virtual void stop() override {
+  }
+
+  // Writes a single block to the queue.
+  void produce(Queue<Samples>& queue);
+
+protected:
+  const Format format_;
+  const uint32_t sampleRate_;
+  const uint32_t blockSize_;
+
+  // A single block of raw samples, replayed on every call
+  std::vector<uint8_t> raw_;
+
+  std::unique_ptr<RealDownconverter> downconverter_;
+};
+
+// Builds the demodulator chain for the specified kernels and block
+// size, and returns a function that runs a single block through it.
+using ChainFactory = std::function<std::function<void()>(
+    const std::map<std::string, SIMD>& kernels,
+    uint32_t blockSize)>;
+
+// Returns the block size multiple that every stage accepts: AGC and
+// Costas process groups of 4 samples, and the RRC filter decimates.
+uint32_t blockSizeMultiple(int decimation);
+
+// Benchmarks every implementation of every kernel that this CPU
+// supports, followed by the complete chain of kernels for a range of
+// block sizes. Progress is written to the specified stream.
+Tuning autotune(
+    uint32_t sampleRate,
+    uint32_t symbolRate,
+    int decimation,
+    const ChainFactory& chain,
+    std::ostream& log);
+
+// Writes tuning to file (in TOML format).
+void saveTuning(const std::string& path, const Tuning& tuning);
+
+// Reads tuning from file written by saveTuning.
+Tuning loadTuning(const std::string& path);
@@ -0,0 +1,188 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+#include "assembler/vcdu.h"
+
+#include "decoder.h"
+#include "file_source.h"
+
+namespace {
+
+// Identifies a packet by virtual channel and counter. The counter is
+// 24 bits wide and doesn't wrap within a pair of chunks.
+uint32_t packetKey(const Batch::Packet& packet) {
+  VCDU vcdu(packet);
+  return ((uint32_t) vcdu.getVCID() << 24) | vcdu.getCounter();
+}
+
+} // namespace
+
+Batch::Batch(Demodulator::Type type, Config& config)
+    : type_(type),
+      config_(config) {
+  if (config_.demodulator.source != "file") {
+    throw std::invalid_argument(
+      "Batch mode requires the \"file\" source");
+  }
+
+  // Every chunk runs its own demodulator and decoder. Publishers are
+  // not shared between them, and stats of a single chunk are of
+  // little use; packets are only written to the output.
+  config_.demodulator.statsPublisher.bind.clear();
+  config_.file.samplePublisher.reset();
+  config_.frontend.samplePublisher.reset();
+  config_.agc.samplePublisher.reset();
+  config_.costas.samplePublisher.reset();
+  config_.rrc.samplePublisher.reset();
+  config_.clockRecovery.samplePublisher.reset();
+  config_.quantization.softBitPublisher.reset();
+  config_.spectrum.publisher.reset();
+
+  // Chunks are processed in parallel instead of pipeline stages
+  config_.demodulator.pipeline.clear();
+
+  auto file = FileSource::open(config_.file);
+  sampleRate_ = file->getSampleRate();
+  samples_ = file->getSamples();
+  chunkSamples_ = std::max<uint64_t>(1, config_.file.chunkDuration * sampleRate_);
+  overlapSamples_ = config_.file.chunkOverlap * sampleRate_;
+  chunks_ = (samples_ + chunkSamples_ - 1) / chunkSamples_;
+}
+
+std::vector<Batch::Packet> Batch::process(uint64_t chunk) {
+  const auto begin = chunk * chunkSamples_;
+  const auto end = std::min(begin + chunkSamples_, samples_);
+  const auto start = (begin > overlapSamples_) ? (begin - overlapSamples_) : 0;
+
+  auto file = FileSource::open(config_.file);
+  file->setRange(start, end - start);
+  file->setThrottle(false);
+  file->setExitAtEnd(false);
+
+  Demodulator demod(type_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    demod.initialize(config_, std::move(file));
+  }
+
+  Decoder decode(demod.getSoftBitsQueue());
+  std::vector<Packet> packets;
+  demod.start();
+  decode.setPacketCallback([&demod] {
+      demod.notifyPacket();
+    });
+  decode.run([&packets] (const Packet& packet) {
+      packets.push_back(packet);
+    });
+  demod.stop();
+  return packets;
+}
+
+uint64_t Batch::run(int jobs, std::ostream& out, std::ostream& log) {
+  if (jobs <= 0) {
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  const auto t0 = std::chrono::steady_clock::now();
+
+  // Chunks are handed out in order, and written out in order as soon
+  // as they and all chunks before them have been processed.
+  std::vector<std::vector<Packet> > results(chunks_);
+  std::vector<bool> done(chunks_, false);
+  std::exception_ptr error;
+  std::atomic<uint64_t> next(0);
+  std::mutex m;
+  std::condition_variable cv;
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < jobs; i++) {
+    threads.emplace_back([&] {
+        for (;;) {
+          const auto chunk = next++;
+          if (chunk >= chunks_) {
+            break;
+          }
+
+          std::vector<Packet> packets;
+          std::exception_ptr e;
+          try {
+            packets = process(chunk);
+          } catch (...) {
+            e = std::current_exception();
+          }
+
+          std::lock_guard<std::mutex> lock(m);
+          results[chunk] = std::move(packets);
+          done[chunk] = true;
+          if (e && !error) {
+            error = e;
+            next = chunks_;
+          }
+          cv.notify_all();
+        }
+      });
+  }
+
+  uint64_t written = 0;
+  std::unordered_set<uint32_t> previous;
+  for (uint64_t chunk = 0; chunk < chunks_; chunk++) {
+    std::vector<Packet> packets;
+    {
+      std::unique_lock<std::mutex> lock(m);
+      cv.wait(lock, [&] { return done[chunk] || error; });
+      if (error) {
+        break;
+      }
+      packets = std::move(results[chunk]);
+    }
+
+    // Drop packets that the previous chunk decoded from the overlap
+    std::unordered_set<uint32_t> keys;
+    uint64_t duplicates = 0;
+    for (const auto& packet : packets) {
+      const auto key = packetKey(packet);
+      keys.insert(key);
+      if (previous.count(key) > 0) {
+        duplicates++;
+        continue;
+      }
+      out.write((const char*) packet.data(), packet.size());
+      written++;
+    }
+    previous = std::move(keys);
+
+    log
+      << "Chunk " << (chunk + 1) << "/" << chunks_ << ": "
+      << (packets.size() - duplicates) << " packets"
+      << " (" << duplicates << " from overlap)"
+      << std::endl;
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  const auto elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - t0).count();
+  const auto duration = (double) samples_ / sampleRate_;
+  log
+    << "Wrote " << written << " packets "
+    << "from " << duration << "s of samples "
+    << "in " << elapsed << "s "
+    << "(" << (duration / elapsed) << "x real time, "
+    << jobs << " threads)"
+    << std::endl;
+  return written;
+}
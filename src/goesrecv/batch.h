@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "config.h"
+#include "demodulator.h"
+
+// Batch demodulates and decodes a recording (see FileSource) on all
+// cores. The demodulator itself is sequential (the AGC, Costas loop,
+// and clock recovery carry state from one sample to the next), so the
+// recording is split into chunks that are processed independently,
+// each by its own demodulator and decoder.
+//
+// Every chunk starts with the final seconds of the previous chunk,
+// such that the loops have converged, and the decoder has found frame
+// sync, by the time the chunk proper begins. Packets decoded from the
+// overlap are decoded by the previous chunk as well. They are dropped
+// by virtual channel and counter when the packets of consecutive
+// chunks are stitched together.
+//
+class Batch {
+public:
+  using Packet = std::array<uint8_t, 892>;
+
+  explicit Batch(Demodulator::Type type, Config& config);
+
+  // Processes the recording on the specified number of threads, and
+  // writes the packets (VCDUs) to the output stream in order.
+  // Returns the number of packets written.
+  uint64_t run(int jobs, std::ostream& out, std::ostream& log);
+
+protected:
+  // Demodulates and decodes a single chunk (incl. overlap).
+  std::vector<Packet> process(uint64_t chunk);
+
+  const Demodulator::Type type_;
+  Config& config_;
+
+  uint32_t sampleRate_;
+  uint64_t samples_;
+  uint64_t chunkSamples_;
+  uint64_t overlapSamples_;
+  uint64_t chunks_;
+
+  // Demodulator initialization writes to the configuration
+  std::mutex mutex_;
+};
@@ -1,12 +1,27 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <functional>
 #include <iostream>
 #include <numeric>
+#include <random>
+#include <thread>
 
 #include "agc.h"
+#include "channelizer.h"
 #include "clock_recovery.h"
+#include "convert.h"
 #include "costas.h"
+#include "downconvert.h"
+#include "frontend.h"
+#include "fused.h"
+#include "history.h"
+#include "polyphase_clock_recovery.h"
 #include "quantize.h"
 #include "rrc.h"
+#include "simd.h"
+#include "spsc_queue.h"
 #include "types.h"
 
 class Timer {
@@ -28,17 +43,39 @@ protected:
   std::chrono::time_point<std::chrono::high_resolution_clock> start_;
 };
 
+// Noisy BPSK-like signal with a small carrier offset, such that the
+// loops in the stages have something to track.
+Samples syntheticInput(int blockSize) {
+  std::mt19937 gen(1);
+  std::normal_distribution<float> noise(0.0f, 0.1f);
+  std::uniform_int_distribution<int> bit(0, 1);
+  Samples samples(blockSize);
+  const double sps = 3000000.0 / 927000.0;
+  float symbol = 1.0f;
+  for (int i = 0, j = 0; i < blockSize; i++) {
+    if (i >= j * sps) {
+      symbol = bit(gen) ? 1.0f : -1.0f;
+      j++;
+    }
+    auto carrier = std::polar(0.5f, 0.001f * i);
+    samples[i] = carrier * symbol + std::complex<float>(noise(gen), noise(gen));
+  }
+  return samples;
+}
+
 template <typename T>
 class Benchmark {
 public:
   explicit Benchmark(T& t, int blockSize)
     : t_(t),
       blockSize_(blockSize) {
-    inQueue_ = std::make_shared<Queue<Samples> >(4);
-    outQueue_ = std::make_shared<Queue<Samples> >(4);
+    inQueue_ = std::make_shared<LockingQueue<Samples> >(4);
+    outQueue_ = std::make_shared<LockingQueue<Samples> >(4);
+    input_ = syntheticInput(blockSize);
   }
 
-  void run() {
+  // Returns number of samples per second.
+  double run() {
     Timer dt;
 
     // Run for N seconds
@@ -69,26 +106,706 @@ public:
               << ((nsamples * 1000000000) / sum) / 1e6f
               << "M"
               << std::endl;
+    return (nsamples * 1e9) / sum;
   }
 
   void fillQueue() {
     auto input = inQueue_->popForWrite();
-    input->resize(blockSize_);
+    input->assign(input_.begin(), input_.end());
     inQueue_->pushWrite(std::move(input));
   }
 
-  void drainQueue() {
+  void drainQueue(Samples* out = nullptr) {
     auto output = outQueue_->popForRead();
+    if (out != nullptr) {
+      out->insert(out->end(), output->begin(), output->end());
+    }
     outQueue_->pushRead(std::move(output));
   }
 
+  // Process a number of blocks and return the output.
+  Samples collect(int nblocks) {
+    Samples out;
+    for (auto i = 0; i < nblocks; i++) {
+      fillQueue();
+      t_.work(inQueue_, outQueue_);
+      drainQueue(&out);
+    }
+    return out;
+  }
+
 protected:
   T& t_;
   int blockSize_;
+  Samples input_;
   std::shared_ptr<Queue<Samples> > inQueue_;
   std::shared_ptr<Queue<Samples> > outQueue_;
 };
 
+// Runs the benchmark for every kernel implementation this CPU
+// supports, and compares the output with the scalar implementation.
+template <typename T>
+void runVariants(
+    const std::string& title,
+    int blockSize,
+    std::function<std::unique_ptr<T>()> factory) {
+  const auto nblocks = 8;
+  auto scalar = factory();
+  scalar->setSIMD(SIMD::NONE);
+  auto expected = Benchmark<T>(*scalar, blockSize).collect(nblocks);
+
+  double baseline = 0.0;
+  for (auto simd : { SIMD::NONE, SIMD::NEON, SIMD::SSE41, SIMD::AVX2 }) {
+    if (!simdSupported(simd)) {
+      continue;
+    }
+
+    std::cerr << title << " [" << simdName(simd) << "]" << std::endl;
+    auto t = factory();
+    t->setSIMD(simd);
+    auto rate = Benchmark<T>(*t, blockSize).run();
+    if (simd == SIMD::NONE) {
+      baseline = rate;
+      continue;
+    }
+
+    std::cerr << "  Speedup:              "
+              << (rate / baseline)
+              << "x"
+              << std::endl;
+
+    // Compare output of fresh instance with scalar output
+    t = factory();
+    t->setSIMD(simd);
+    auto actual = Benchmark<T>(*t, blockSize).collect(nblocks);
+    if (actual.size() != expected.size()) {
+      std::cerr << "  Output size mismatch: "
+                << actual.size()
+                << " (expected "
+                << expected.size()
+                << ")"
+                << std::endl;
+      continue;
+    }
+    float deviation = 0.0f;
+    for (size_t i = 0; i < actual.size(); i++) {
+      deviation = std::max(deviation, std::abs(actual[i] - expected[i]));
+    }
+    std::cerr.unsetf(std::ios::floatfield);
+    std::cerr << "  Max deviation:        "
+              << deviation
+              << std::endl;
+  }
+}
+
+// Compares the NCO oscillator with the sin/cos oscillator, both using
+// the best kernel implementation, and reports the phase difference of
+// their output once the loops have locked.
+void runOscillators(const std::string& title, int blockSize) {
+  const auto nblocks = 8;
+  std::vector<double> rates;
+  std::vector<Samples> outputs;
+  for (auto oscillator : { Costas::Oscillator::SINCOS, Costas::Oscillator::NCO }) {
+    const auto name = (oscillator == Costas::Oscillator::NCO) ? "nco" : "sincos";
+    std::cerr << title << " [" << name << "]" << std::endl;
+    Costas costas;
+    costas.setOscillator(oscillator);
+    outputs.push_back(Benchmark<Costas>(costas, blockSize).collect(nblocks));
+    rates.push_back(Benchmark<Costas>(costas, blockSize).run());
+  }
+
+  std::cerr << "  Speedup:              "
+            << (rates[1] / rates[0])
+            << "x"
+            << std::endl;
+
+  // Skip first block to give the loops time to lock
+  float phase = 0.0f;
+  for (size_t i = blockSize; i < outputs[0].size(); i++) {
+    auto d = std::arg(outputs[1][i] * std::conj(outputs[0][i]));
+    phase = std::max(phase, std::abs(d));
+  }
+  std::cerr.unsetf(std::ios::floatfield);
+  std::cerr << "  Max phase difference: "
+            << phase
+            << " rad"
+            << std::endl;
+}
+
+// Runs AGC, Costas, and RRC one after the other, like the demodulator
+// does when they share a thread, to compare against Fused.
+class Staged {
+public:
+  explicit Staged(AGC& agc, Costas& costas, RRC& rrc)
+    : agc_(agc),
+      costas_(costas),
+      rrc_(rrc) {
+    agcQueue_ = std::make_shared<LockingQueue<Samples> >(1);
+    costasQueue_ = std::make_shared<LockingQueue<Samples> >(1);
+  }
+
+  size_t work(
+      const std::shared_ptr<Queue<Samples> >& qin,
+      const std::shared_ptr<Queue<Samples> >& qout) {
+    auto nsamples = agc_.work(qin, agcQueue_);
+    costas_.work(agcQueue_, costasQueue_);
+    rrc_.work(costasQueue_, qout);
+    return nsamples;
+  }
+
+protected:
+  AGC& agc_;
+  Costas& costas_;
+  RRC& rrc_;
+  std::shared_ptr<Queue<Samples> > agcQueue_;
+  std::shared_ptr<Queue<Samples> > costasQueue_;
+};
+
+// Compares the staged and fused AGC, Costas, and RRC.
+void runFused(const std::string& title, int blockSize, int decimation) {
+  const auto nblocks = 8;
+  Samples expected;
+  Samples actual;
+  double staged = 0.0;
+  double fused = 0.0;
+
+  {
+    std::cerr << title << " [staged]" << std::endl;
+    AGC agc;
+    Costas costas;
+    RRC rrc(decimation, 3000000, 927000);
+    Staged t(agc, costas, rrc);
+    expected = Benchmark<Staged>(t, blockSize).collect(nblocks);
+    staged = Benchmark<Staged>(t, blockSize).run();
+  }
+
+  {
+    std::cerr << title << " [fused]" << std::endl;
+    AGC agc;
+    Costas costas;
+    RRC rrc(decimation, 3000000, 927000);
+    Fused t(agc, costas, rrc, decimation);
+    actual = Benchmark<Fused>(t, blockSize).collect(nblocks);
+    fused = Benchmark<Fused>(t, blockSize).run();
+  }
+
+  std::cerr << "  Speedup:              "
+            << (fused / staged)
+            << "x"
+            << std::endl;
+
+  float deviation = 0.0f;
+  for (size_t i = 0; i < actual.size(); i++) {
+    deviation = std::max(deviation, std::abs(actual[i] - expected[i]));
+  }
+  std::cerr.unsetf(std::ios::floatfield);
+  std::cerr << "  Max deviation:        "
+            << deviation
+            << std::endl;
+}
+
+// Runs the front end ahead of AGC, Costas, and RRC.
+class Decimated {
+public:
+  explicit Decimated(FrontEnd& frontEnd, Staged& staged)
+    : frontEnd_(frontEnd),
+      staged_(staged) {
+    frontEndQueue_ = std::make_shared<LockingQueue<Samples> >(1);
+  }
+
+  size_t work(
+      const std::shared_ptr<Queue<Samples> >& qin,
+      const std::shared_ptr<Queue<Samples> >& qout) {
+    auto nsamples = frontEnd_.work(qin, frontEndQueue_);
+    staged_.work(frontEndQueue_, qout);
+    return nsamples;
+  }
+
+protected:
+  FrontEnd& frontEnd_;
+  Staged& staged_;
+  std::shared_ptr<Queue<Samples> > frontEndQueue_;
+};
+
+// Compares decimating in the RRC filter with decimating in the front
+// end, for HRIT at 10 Msps. Both produce the same sample rate.
+void runFrontEnd(const std::string& title, int blockSize) {
+  const uint32_t sampleRate = 10000000;
+  const uint32_t symbolRate = 927000;
+  const auto bandwidth = 0.75 * symbolRate + 20000;
+  const auto decimation = FrontEnd::decimation(sampleRate, symbolRate, bandwidth);
+  double rates[2];
+
+  {
+    std::cerr << title << " [rrc decimation=" << decimation << "]" << std::endl;
+    AGC agc;
+    Costas costas;
+    RRC rrc(decimation, sampleRate, symbolRate);
+    Staged t(agc, costas, rrc);
+    rates[0] = Benchmark<Staged>(t, blockSize).run();
+  }
+
+  {
+    std::cerr << title << " [frontend decimation=" << decimation << "]" << std::endl;
+    FrontEnd frontEnd(sampleRate, decimation, 100000, bandwidth);
+    AGC agc;
+    Costas costas;
+    RRC rrc(1, sampleRate / decimation, symbolRate);
+    Staged staged(agc, costas, rrc);
+    Decimated t(frontEnd, staged);
+    rates[1] = Benchmark<Decimated>(t, blockSize).run();
+  }
+
+  std::cerr << "  Speedup:              "
+            << (rates[1] / rates[0])
+            << "x"
+            << std::endl;
+}
+
+// Runs a front end per downlink on a copy of every block, as separate
+// receivers for every downlink would.
+class Separate {
+public:
+  explicit Separate(std::vector<std::unique_ptr<FrontEnd> >& frontEnds)
+    : frontEnds_(frontEnds) {
+    for (size_t i = 0; i < frontEnds_.size(); i++) {
+      inQueues_.push_back(std::make_shared<LockingQueue<Samples> >(1));
+      outQueues_.push_back(std::make_shared<LockingQueue<Samples> >(1));
+    }
+  }
+
+  size_t work(
+      const std::shared_ptr<Queue<Samples> >& qin,
+      const std::shared_ptr<Queue<Samples> >& qout) {
+    auto input = qin->popForRead();
+    const auto nsamples = input->size();
+    for (size_t i = 0; i < frontEnds_.size(); i++) {
+      auto copy = inQueues_[i]->popForWrite();
+      copy->assign(input->begin(), input->end());
+      inQueues_[i]->pushWrite(std::move(copy));
+      frontEnds_[i]->work(inQueues_[i], (i == 0) ? qout : outQueues_[i]);
+      if (i > 0) {
+        outQueues_[i]->pushRead(outQueues_[i]->popForRead());
+      }
+    }
+    qin->pushRead(std::move(input));
+    return nsamples;
+  }
+
+protected:
+  std::vector<std::unique_ptr<FrontEnd> >& frontEnds_;
+  std::vector<std::shared_ptr<Queue<Samples> > > inQueues_;
+  std::vector<std::shared_ptr<Queue<Samples> > > outQueues_;
+};
+
+// Runs the channelizer followed by a front end per downlink.
+class Channelized {
+public:
+  explicit Channelized(
+      Channelizer& channelizer,
+      std::vector<std::unique_ptr<FrontEnd> >& frontEnds,
+      const std::vector<int>& channels)
+    : channelizer_(channelizer),
+      frontEnds_(frontEnds) {
+    for (size_t i = 0; i < frontEnds_.size(); i++) {
+      channelQueues_.push_back(std::make_shared<LockingQueue<Samples> >(1));
+      outQueues_.push_back(std::make_shared<LockingQueue<Samples> >(1));
+      sources_.push_back(channelizer_.open(channels[i]));
+      sources_.back()->start(channelQueues_.back());
+    }
+  }
+
+  size_t work(
+      const std::shared_ptr<Queue<Samples> >& qin,
+      const std::shared_ptr<Queue<Samples> >& qout) {
+    const auto nsamples = channelizer_.work(qin);
+    for (size_t i = 0; i < frontEnds_.size(); i++) {
+      frontEnds_[i]->work(channelQueues_[i], (i == 0) ? qout : outQueues_[i]);
+      if (i > 0) {
+        outQueues_[i]->pushRead(outQueues_[i]->popForRead());
+      }
+    }
+    return nsamples;
+  }
+
+protected:
+  Channelizer& channelizer_;
+  std::vector<std::unique_ptr<FrontEnd> >& frontEnds_;
+  std::vector<std::unique_ptr<Source> > sources_;
+  std::vector<std::shared_ptr<Queue<Samples> > > channelQueues_;
+  std::vector<std::shared_ptr<Queue<Samples> > > outQueues_;
+};
+
+// Compares a front end per downlink at the full sample rate with the
+// channelizer followed by a front end per downlink at the channel
+// sample rate, for 3 HRIT downlinks at 10 Msps.
+void runChannelizer(const std::string& title, int blockSize) {
+  const uint32_t sampleRate = 10000000;
+  const uint32_t symbolRate = 927000;
+  const auto bandwidth = 0.75 * symbolRate + 20000;
+  const std::vector<double> frequencies = { -2500000, 0, 2500000 };
+  double rates[2];
+
+  {
+    const auto decimation = FrontEnd::decimation(sampleRate, symbolRate, bandwidth);
+    std::cerr << title << " [separate, decimation=" << decimation << "]" << std::endl;
+    std::vector<std::unique_ptr<FrontEnd> > frontEnds;
+    for (auto frequency : frequencies) {
+      frontEnds.push_back(std::make_unique<FrontEnd>(
+        sampleRate, decimation, frequency, bandwidth));
+    }
+    Separate t(frontEnds);
+    rates[0] = Benchmark<Separate>(t, blockSize).run();
+  }
+
+  {
+    std::vector<std::pair<double, double> > signals;
+    for (auto frequency : frequencies) {
+      signals.emplace_back(frequency, bandwidth);
+    }
+    Channelizer channelizer(sampleRate, Channelizer::channels(sampleRate, signals));
+    const auto channelRate = channelizer.getChannelRate();
+    const auto decimation = FrontEnd::decimation(channelRate, symbolRate, bandwidth);
+    std::cerr << title << " [channelizer, channels=" << channelizer.getChannels()
+              << ", decimation=" << decimation << "]" << std::endl;
+    std::vector<std::unique_ptr<FrontEnd> > frontEnds;
+    std::vector<int> channels;
+    for (auto frequency : frequencies) {
+      const auto channel = channelizer.channel(frequency);
+      frontEnds.push_back(std::make_unique<FrontEnd>(
+        channelRate,
+        decimation,
+        frequency - channelizer.getFrequency(channel),
+        bandwidth));
+      channels.push_back(channel);
+    }
+    Channelized t(channelizer, frontEnds, channels);
+    rates[1] = Benchmark<Channelized>(t, blockSize).run();
+  }
+
+  std::cerr << "  Speedup:              "
+            << (rates[1] / rates[0])
+            << "x"
+            << std::endl;
+}
+
+// Runs the RRC filter followed by the interpolating clock recovery,
+// to compare against the polyphase clock recovery.
+class Interpolator {
+public:
+  explicit Interpolator(RRC& rrc, ClockRecovery& clockRecovery)
+    : rrc_(rrc),
+      clockRecovery_(clockRecovery) {
+    rrcQueue_ = std::make_shared<LockingQueue<Samples> >(1);
+  }
+
+  size_t work(
+      const std::shared_ptr<Queue<Samples> >& qin,
+      const std::shared_ptr<Queue<Samples> >& qout) {
+    auto nsamples = rrc_.work(qin, rrcQueue_);
+    clockRecovery_.work(rrcQueue_, qout);
+    return nsamples;
+  }
+
+protected:
+  RRC& rrc_;
+  ClockRecovery& clockRecovery_;
+  std::shared_ptr<Queue<Samples> > rrcQueue_;
+};
+
+// Compares RRC + clock recovery with polyphase clock recovery.
+// Their output is not comparable sample for sample, so this compares
+// the number of symbols they produce once the loops have settled.
+void runPolyphase(const std::string& title, int blockSize) {
+  const auto nblocks = 8;
+  double rates[2];
+  size_t symbols[2];
+
+  {
+    std::cerr << title << " [rrc+interpolator]" << std::endl;
+    RRC rrc(1, 3000000, 927000);
+    ClockRecovery clockRecovery(3000000, 927000);
+    Interpolator t(rrc, clockRecovery);
+    symbols[0] = Benchmark<Interpolator>(t, blockSize).collect(nblocks).size();
+    rates[0] = Benchmark<Interpolator>(t, blockSize).run();
+  }
+
+  {
+    std::cerr << title << " [polyphase]" << std::endl;
+    PolyphaseClockRecovery t(3000000, 927000);
+    symbols[1] = Benchmark<PolyphaseClockRecovery>(t, blockSize).collect(nblocks).size();
+    rates[1] = Benchmark<PolyphaseClockRecovery>(t, blockSize).run();
+  }
+
+  std::cerr << "  Speedup:              "
+            << (rates[1] / rates[0])
+            << "x"
+            << std::endl;
+  std::cerr << "  Symbols:              "
+            << symbols[1]
+            << " (expected "
+            << symbols[0]
+            << ")"
+            << std::endl;
+}
+
+// Runs a sample conversion for every kernel implementation this CPU
+// supports, and compares the output with the scalar implementation.
+template <typename T>
+void runConvert(
+    const std::string& title,
+    int blockSize,
+    std::function<void(SIMD, size_t, const T*, std::complex<float>*)> convert) {
+  std::mt19937 gen(1);
+  std::vector<T> input(2 * blockSize);
+  for (auto& v : input) {
+    v = (T) gen();
+  }
+
+  Samples expected(blockSize);
+  convert(SIMD::NONE, blockSize, input.data(), expected.data());
+
+  double baseline = 0.0;
+  for (auto simd : { SIMD::NONE, SIMD::NEON, SIMD::SSE2, SIMD::SSE41, SIMD::AVX2 }) {
+    if (!simdSupported(simd)) {
+      continue;
+    }
+
+    std::cerr << title << " [" << simdName(simd) << "]" << std::endl;
+    Samples output(blockSize);
+    Timer dt;
+    long long nblocks = 0;
+    while ((dt.ns() / 1000000000) < 2) {
+      convert(simd, blockSize, input.data(), output.data());
+      nblocks++;
+    }
+    const double rate = (1e9 * nblocks * blockSize) / dt.ns();
+    std::cerr.setf(std::ios::fixed, std:: ios::floatfield);
+    std::cerr.precision(3);
+    std::cerr << "  Samples per second:   "
+              << rate / 1e6f
+              << "M"
+              << std::endl;
+    if (simd == SIMD::NONE) {
+      baseline = rate;
+      continue;
+    }
+
+    std::cerr << "  Speedup:              "
+              << (rate / baseline)
+              << "x"
+              << std::endl;
+
+    float deviation = 0.0f;
+    for (size_t i = 0; i < output.size(); i++) {
+      deviation = std::max(deviation, std::abs(output[i] - expected[i]));
+    }
+    std::cerr.unsetf(std::ios::floatfield);
+    std::cerr << "  Max deviation:        "
+              << deviation
+              << std::endl;
+  }
+}
+
+// Runs the real downconverter (raw Airspy samples) for every kernel
+// implementation this CPU supports, and compares the output with the
+// scalar implementation. Samples per second are complex output
+// samples; the input rate is twice that.
+void runDownconvert(const std::string& title, int blockSize) {
+  std::mt19937 gen(1);
+  std::vector<int16_t> input(2 * blockSize);
+  for (auto& v : input) {
+    v = (int16_t) gen();
+  }
+
+  // The downconverter keeps the final samples of every block for the
+  // next. The input is the same block every time, so every output
+  // after the first is the same too. Compare against the second.
+  Samples expected(blockSize);
+  {
+    RealDownconverter scalar;
+    scalar.work(SIMD::NONE, input.size(), input.data(), expected.data());
+    scalar.work(SIMD::NONE, input.size(), input.data(), expected.data());
+  }
+
+  double baseline = 0.0;
+  for (auto simd : { SIMD::NONE, SIMD::NEON, SIMD::SSE41, SIMD::AVX2 }) {
+    if (!simdSupported(simd)) {
+      continue;
+    }
+
+    std::cerr << title << " [" << simdName(simd) << "]" << std::endl;
+    RealDownconverter downconverter;
+    Samples output(blockSize);
+    Timer dt;
+    long long nblocks = 0;
+    while ((dt.ns() / 1000000000) < 2 || nblocks < 2) {
+      downconverter.work(simd, input.size(), input.data(), output.data());
+      nblocks++;
+    }
+    const double rate = (1e9 * nblocks * blockSize) / dt.ns();
+    std::cerr.setf(std::ios::fixed, std:: ios::floatfield);
+    std::cerr.precision(3);
+    std::cerr << "  Samples per second:   "
+              << rate / 1e6f
+              << "M"
+              << std::endl;
+    if (simd == SIMD::NONE) {
+      baseline = rate;
+      continue;
+    }
+
+    std::cerr << "  Speedup:              "
+              << (rate / baseline)
+              << "x"
+              << std::endl;
+
+    float deviation = 0.0f;
+    for (size_t i = 0; i < output.size(); i++) {
+      deviation = std::max(deviation, std::abs(output[i] - expected[i]));
+    }
+    std::cerr.unsetf(std::ios::floatfield);
+    std::cerr << "  Max deviation:        "
+              << deviation
+              << std::endl;
+  }
+}
+
+// Compares carrying samples over between blocks by copying every block
+// behind the history (what RRC and ClockRecovery used to do) with the
+// History class, for the RRC filter (31 samples carried over).
+void runHistory(int blockSize) {
+  const size_t ntaps = RRC::NTAPS;
+  auto input = syntheticInput(blockSize);
+
+  {
+    std::cerr << "History (copy, block size=" << blockSize << ")" << std::endl;
+    Samples tmp(ntaps);
+    Timer dt;
+    long long nblocks = 0;
+    while ((dt.ns() / 1000000000) < 2) {
+      tmp.insert(tmp.end(), input.begin(), input.end());
+      tmp.erase(tmp.begin(), tmp.end() - ntaps);
+      nblocks++;
+    }
+    std::cerr << "  Time per block:       "
+              << (dt.ns() / nblocks)
+              << "ns"
+              << std::endl;
+    std::cerr << "  Bytes copied:         "
+              << (blockSize + ntaps) * sizeof(std::complex<float>)
+              << std::endl;
+  }
+
+  {
+    std::cerr << "History (join, block size=" << blockSize << ")" << std::endl;
+    History history(ntaps);
+    Timer dt;
+    long long nblocks = 0;
+    while ((dt.ns() / 1000000000) < 2) {
+      history.join(input.data(), ntaps);
+      history.keep(input.data(), input.size(), input.size());
+      nblocks++;
+    }
+    std::cerr << "  Time per block:       "
+              << (dt.ns() / nblocks)
+              << "ns"
+              << std::endl;
+    std::cerr << "  Bytes copied:         "
+              << (2 * ntaps) * sizeof(std::complex<float>)
+              << std::endl;
+  }
+}
+
+// Measures the overhead of handing blocks between two threads.
+template <template <class> class Q>
+class QueueBenchmark {
+  struct Block {
+    std::chrono::time_point<std::chrono::high_resolution_clock> pushed;
+  };
+
+public:
+  void run() {
+    throughput();
+    latency();
+  }
+
+  // Producer and consumer exchange blocks as fast as they can.
+  void throughput() {
+    auto queue = std::make_shared<Q<Block> >(4);
+    std::atomic<bool> stop(false);
+    long long nblocks = 0;
+    std::thread consumer([&] {
+        for (;;) {
+          auto block = queue->popForRead();
+          if (!block) {
+            break;
+          }
+          nblocks++;
+          queue->pushRead(std::move(block));
+        }
+      });
+
+    Timer dt;
+    while ((dt.ns() / 1000000000) < 2) {
+      for (auto i = 0; i < 1000; i++) {
+        auto block = queue->popForWrite();
+        queue->pushWrite(std::move(block));
+      }
+    }
+    queue->close();
+    consumer.join();
+    auto ns = dt.ns();
+
+    std::cerr << "  Blocks per second:    "
+              << ((nblocks * 1000000000) / ns) / 1e6f
+              << "M"
+              << std::endl;
+  }
+
+  // The producer only pushes a block after the previous one has been
+  // returned by the consumer, so every block finds the consumer idle.
+  void latency() {
+    auto queue = std::make_shared<Q<Block> >(1);
+    std::vector<long> samples;
+    samples.reserve(1000000);
+    std::thread consumer([&] {
+        for (;;) {
+          auto block = queue->popForRead();
+          if (!block) {
+            break;
+          }
+          auto now = std::chrono::high_resolution_clock::now();
+          samples.push_back(std::chrono::nanoseconds(now - block->pushed).count());
+          queue->pushRead(std::move(block));
+        }
+      });
+
+    Timer dt;
+    while ((dt.ns() / 1000000000) < 2) {
+      auto block = queue->popForWrite();
+      block->pushed = std::chrono::high_resolution_clock::now();
+      queue->pushWrite(std::move(block));
+    }
+
+    // Wait for final block to be returned
+    queue->popForWrite();
+    queue->close();
+    consumer.join();
+
+    std::sort(samples.begin(), samples.end());
+    auto sum = std::accumulate(samples.begin(), samples.end(), (long long) 0);
+    std::cerr << "  Handoff latency:      "
+              << (sum / (long long) samples.size())
+              << "ns (avg), "
+              << samples[samples.size() / 2]
+              << "ns (p50), "
+              << samples[(samples.size() * 99) / 100]
+              << "ns (p99)"
+              << std::endl;
+  }
+};
+
 int main(int argc, char** argv) {
   std::string name;
   if (argc == 2) {
@@ -96,29 +813,75 @@ int main(int argc, char** argv) {
   }
 
   auto blockSize = 128 * 1024;
+  auto suffix = " (block size=" + std::to_string(blockSize) + ")";
+  if (name.empty() || name == "convert") {
+    runConvert<uint8_t>("Convert u8" + suffix, blockSize, convertU8);
+    runConvert<int8_t>("Convert s8" + suffix, blockSize, convertS8);
+    runConvert<int16_t>("Convert s16" + suffix, blockSize, convertS16);
+  }
+  if (name.empty() || name == "downconvert") {
+    runDownconvert("Real downconvert" + suffix, blockSize);
+  }
+  if (name.empty() || name == "frontend") {
+    runVariants<FrontEnd>("Front end (decimation=4)" + suffix, blockSize, [] {
+        return std::make_unique<FrontEnd>(10000000, 4, 100000, 715250);
+      });
+    runFrontEnd("AGC+Costas+RRC" + suffix, blockSize);
+  }
+  if (name.empty() || name == "channelizer") {
+    runChannelizer("Front end for 3 downlinks" + suffix, blockSize);
+  }
   if (name.empty() || name == "agc") {
-    std::cerr << "AGC (block size=" << blockSize << ")" << std::endl;
-    auto agc = std::make_unique<AGC>();
-    auto benchmark = Benchmark<AGC>(*agc, blockSize);
-    benchmark.run();
+    runVariants<AGC>("AGC" + suffix, blockSize, [] {
+        return std::make_unique<AGC>();
+      });
+  }
+  if (name.empty() || name == "costas") {
+    runVariants<Costas>("Costas" + suffix, blockSize, [] {
+        return std::make_unique<Costas>();
+      });
   }
   if (name.empty() || name == "costas") {
-    std::cerr << "Costas (block size=" << blockSize << ")" << std::endl;
-    auto costas = std::make_unique<Costas>();
-    auto benchmark = Benchmark<Costas>(*costas, blockSize);
-    benchmark.run();
+    runVariants<Costas>("Costas NCO" + suffix, blockSize, [] {
+        auto costas = std::make_unique<Costas>();
+        costas->setOscillator(Costas::Oscillator::NCO);
+        return costas;
+      });
+    runOscillators("Costas oscillator" + suffix, blockSize);
   }
   if (name.empty() || name == "rrc") {
-    std::cerr << "FIR (N=31, block size=" << blockSize << ")" << std::endl;
     // Note: filter runs WITHOUT decimation
-    auto rrc = std::make_unique<RRC>(1, 3000000, 927000);
-    auto benchmark = Benchmark<RRC>(*rrc, 128 * 1024);
-    benchmark.run();
+    auto title = "FIR (N=31, block size=" + std::to_string(blockSize) + ")";
+    runVariants<RRC>(title, blockSize, [] {
+        return std::make_unique<RRC>(1, 3000000, 927000);
+      });
   }
   if (name.empty() || name == "clock") {
-    std::cerr << "Clock recovery (block size=" << blockSize << ")" << std::endl;
-    auto clock = std::make_unique<ClockRecovery>(3000000, 927000);
-    auto benchmark = Benchmark<ClockRecovery>(*clock, 128 * 1024);
-    benchmark.run();
+    runVariants<ClockRecovery>("Clock recovery" + suffix, blockSize, [] {
+        return std::make_unique<ClockRecovery>(3000000, 927000);
+      });
+  }
+  if (name.empty() || name == "polyphase") {
+    runVariants<PolyphaseClockRecovery>("Polyphase clock recovery" + suffix, blockSize, [] {
+        return std::make_unique<PolyphaseClockRecovery>(3000000, 927000);
+      });
+    runPolyphase("RRC + clock recovery" + suffix, blockSize);
+  }
+  if (name.empty() || name == "fused") {
+    for (auto decimation : { 1, 2 }) {
+      auto title =
+        "AGC+Costas+RRC (decimation=" + std::to_string(decimation) +
+        ", block size=" + std::to_string(blockSize) + ")";
+      runFused(title, blockSize, decimation);
+    }
+  }
+  if (name.empty() || name == "history") {
+    runHistory(blockSize);
+  }
+  if (name.empty() || name == "queue") {
+    std::cerr << "Queue (locking)" << std::endl;
+    QueueBenchmark<LockingQueue>().run();
+    std::cerr << "Queue (spsc)" << std::endl;
+    QueueBenchmark<SPSCQueue>().run();
   }
 }
@@ -0,0 +1,340 @@
+#include "channelizer.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <util/error.h>
+
+#include "scheduling.h"
+
+namespace {
+
+// Attenuation of everything that aliases onto a channel (dB)
+constexpr double attenuation = 60.0;
+
+// Passband and stopband of every channel, relative to channel spacing.
+// With 2x oversampling, the stopband starts where the passband of the
+// neighboring alias ends.
+constexpr double passband = 0.8;
+constexpr double stopband = 1.2;
+
+// Upper limit for the number of channels
+constexpr int maxChannels = 1024;
+
+// Zeroth order modified Bessel function of the first kind.
+double bessel(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+// Returns the taps of the Kaiser windowed prototype filter, rounded up
+// to a multiple of twice the number of channels (see work), with unit
+// gain.
+std::vector<float> prototype(int channels) {
+  const double transition = (stopband - passband) / channels;
+  const double beta = 0.1102 * (attenuation - 8.7);
+  const double order = (attenuation - 8) / (2.285 * 2 * M_PI * transition);
+  const int ntaps = 2 * channels * ((int) std::ceil((order + 1) / (2 * channels)));
+  const double center = (ntaps - 1) / 2.0;
+
+  // The cutoff is halfway the transition band: the channel spacing
+  const double cutoff = 1.0 / channels;
+  std::vector<float> taps(ntaps);
+  double sum = 0.0;
+  for (int i = 0; i < ntaps; i++) {
+    const double t = i - center;
+    const double x = t / center;
+    const double w = bessel(beta * sqrt(1 - x * x)) / bessel(beta);
+    const double h = w * sin(2 * M_PI * cutoff * t) / (M_PI * t);
+    taps[i] = h;
+    sum += h;
+  }
+
+  for (auto& tap : taps) {
+    tap /= sum;
+  }
+
+  return taps;
+}
+
+} // namespace
+
+class Channelizer::Channel : public Source {
+public:
+  Channel(Channelizer& channelizer, int channel)
+      : channelizer_(channelizer),
+        channel_(channel) {
+  }
+
+  virtual uint32_t getSampleRate() const override {
+    return channelizer_.getChannelRate();
+  }
+
+  virtual void start(const std::shared_ptr<Queue<Samples> >& queue) override {
+    channelizer_.connect(channel_, queue);
+  }
+
+  virtual void stop() override {
+    // The channelizer closes the queue when it stops
+  }
+
+  // Every channel loses what the shared source drops
+  virtual uint64_t getDroppedSamples() const override {
+    return channelizer_.source_ ? channelizer_.source_->getDroppedSamples() : 0;
+  }
+
+  virtual uint64_t getDroppedBlocks() const override {
+    return channelizer_.source_ ? channelizer_.source_->getDroppedBlocks() : 0;
+  }
+
+protected:
+  Channelizer& channelizer_;
+  const int channel_;
+};
+
+int Channelizer::channels(
+    uint32_t sampleRate,
+    const std::vector<std::pair<double, double> >& signals) {
+  for (int m = maxChannels; m >= 2; m /= 2) {
+    const double spacing = (double) sampleRate / m;
+    bool fit = true;
+    for (const auto& signal : signals) {
+      const auto c = std::round(signal.first / spacing);
+      const auto offset = std::abs(signal.first - c * spacing);
+      fit &= (offset + signal.second) <= passband * spacing;
+    }
+    if (fit) {
+      return m;
+    }
+  }
+  return 0;
+}
+
+Channelizer::Channelizer(uint32_t sampleRate, int channels)
+    : sampleRate_(sampleRate),
+      channels_(channels),
+      folded_(channels),
+      fft_(channels, true),
+      useFFT_(false),
+      odd_(false) {
+  ASSERT(channels >= 1 && (channels & (channels - 1)) == 0);
+  if (channels == 1) {
+    return;
+  }
+  auto taps = prototype(channels);
+  std::reverse(taps.begin(), taps.end());
+  for (const auto& tap : taps) {
+    taps_.push_back(tap);
+    taps_.push_back(tap);
+  }
+  acc_.resize(2 * channels);
+  history_ = History(taps.size() - 1);
+}
+
+Channelizer::~Channelizer() {
+}
+
+double Channelizer::getPassband() const {
+  if (channels_ == 1) {
+    return sampleRate_ / 2.0;
+  }
+  return (passband * sampleRate_) / channels_;
+}
+
+int Channelizer::channel(double frequency) const {
+  const double spacing = (double) sampleRate_ / channels_;
+  const int c = std::round(frequency / spacing);
+  return ((c % channels_) + channels_) % channels_;
+}
+
+double Channelizer::getFrequency(int channel) const {
+  if (channels_ == 1) {
+    return 0.0;
+  }
+  const double spacing = (double) sampleRate_ / channels_;
+  if (channel < channels_ / 2) {
+    return channel * spacing;
+  }
+  return (channel - channels_) * spacing;
+}
+
+void Channelizer::connect(int channel, std::shared_ptr<Queue<Samples> > queue) {
+  outputs_.emplace_back(channel, std::move(queue));
+  buffers_.resize(outputs_.size());
+  if (channels_ == 1) {
+    return;
+  }
+
+  // Row of the inverse DFT for this channel, indexed like the folded
+  // sums (see work)
+  std::vector<float> row(2 * channels_);
+  for (int k = 0; k < channels_; k++) {
+    const auto r = channels_ - 1 - k;
+    const auto w = std::polar(1.0, 2 * M_PI * channel * r / channels_);
+    row[2 * k] = w.real();
+    row[2 * k + 1] = w.imag();
+  }
+  rows_.push_back(std::move(row));
+
+  // The FFT computes every channel at once, which is cheaper only if
+  // more than log2(M) channels are used
+  int log2 = 0;
+  while ((1 << log2) < channels_) {
+    log2++;
+  }
+  useFFT_ = (int) outputs_.size() > log2;
+}
+
+std::unique_ptr<Source> Channelizer::open(int channel) {
+  ASSERT(channel >= 0 && channel < channels_);
+  return std::make_unique<Channel>(*this, channel);
+}
+
+// Channel c is shifted down by c/M cycles per sample, filtered, and
+// decimated by R = M/2. Output m is computed from the L most recent
+// input samples x[mR - i], i = 0..L-1, as:
+//
+//   y_c[m] = sum_i h[i] x[mR - i] e^(-j2pi c (mR - i) / M)
+//          = e^(-j2pi c mR / M) sum_r v[r] e^(j2pi c r / M)
+//
+// where v[r] sums every Mth product h[i] x[mR - i] starting at i = r.
+// The sum over r is an inverse FFT of v, which yields all channels at
+// once, and e^(-j2pi c mR / M) = (-1)^(cm).
+//
+size_t Channelizer::work(const std::shared_ptr<Queue<Samples> >& qin) {
+  auto input = qin->popForRead();
+  if (!input) {
+    for (auto& output : outputs_) {
+      output.second->close();
+    }
+    return 0;
+  }
+
+  const size_t n = input->size();
+  const auto* block = input->data();
+
+  // Without a filter bank, every channel gets a copy of the input
+  if (channels_ == 1) {
+    for (size_t i = 0; i < outputs_.size(); i++) {
+      buffers_[i] = outputs_[i].second->popForWrite();
+      buffers_[i]->assign(block, block + n);
+    }
+    qin->pushRead(std::move(input));
+    for (size_t i = 0; i < outputs_.size(); i++) {
+      outputs_[i].second->pushWrite(std::move(buffers_[i]));
+    }
+    return n;
+  }
+
+  const size_t m = channels_;
+  const size_t r = m / 2;
+  const size_t ntaps = taps_.size() / 2;
+  const size_t h = history_.size();
+
+  // Number of outputs is a multiple of 4 (see AGC); the remainder is
+  // carried over to the next block
+  size_t nout = (h + n >= ntaps) ? ((h + n - ntaps) / r + 1) : 0;
+  nout &= ~((size_t) 3);
+
+  // Outputs computed from the history are read from a joined copy
+  const auto* joined = history_.join(block, std::min(n, ntaps - 1));
+
+  for (size_t i = 0; i < outputs_.size(); i++) {
+    buffers_[i] = outputs_[i].second->popForWrite();
+    buffers_[i]->resize(nout);
+  }
+
+  const float* __restrict__ taps = taps_.data();
+  float* __restrict__ acc = acc_.data();
+  for (size_t j = 0; j < nout; j++) {
+    const size_t pos = j * r;
+    const auto* w = (pos < h) ? &joined[pos] : &block[pos - h];
+    const float* __restrict__ x = reinterpret_cast<const float*>(w);
+
+    // The taps are time reversed, such that w[k] is multiplied by
+    // taps[k], and v[r] is found at index M-1-r of the folded sums.
+    // Every tap is stored twice, for the real and imaginary part, and
+    // the sums are accumulated 4 floats at a time, so that this loop
+    // vectorizes. Alternating between two sums halves the chain of
+    // dependent additions (the number of taps is a multiple of 2M).
+    for (size_t k = 0; k < 2 * m; k += 4) {
+      float sum0[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      float sum1[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for (size_t p = k; p < 2 * ntaps; p += 4 * m) {
+        for (size_t i = 0; i < 4; i++) {
+          sum0[i] += taps[p + i] * x[p + i];
+          sum1[i] += taps[p + 2 * m + i] * x[p + 2 * m + i];
+        }
+      }
+      for (size_t i = 0; i < 4; i++) {
+        acc[k + i] = sum0[i] + sum1[i];
+      }
+    }
+    if (useFFT_) {
+      for (size_t k = 0; k < m; k++) {
+        folded_[m - 1 - k] = std::complex<float>(acc[2 * k], acc[2 * k + 1]);
+      }
+      fft_.run(folded_.data());
+    }
+
+    for (size_t i = 0; i < outputs_.size(); i++) {
+      const auto c = outputs_[i].first;
+      std::complex<float> y;
+      if (useFFT_) {
+        y = folded_[c];
+      } else {
+        const float* __restrict__ row = rows_[i].data();
+        float yr = 0.0f;
+        float yi = 0.0f;
+        for (size_t k = 0; k < 2 * m; k += 2) {
+          yr += acc[k] * row[k] - acc[k + 1] * row[k + 1];
+          yi += acc[k] * row[k + 1] + acc[k + 1] * row[k];
+        }
+        y = std::complex<float>(yr, yi);
+      }
+      (*buffers_[i])[j] = (odd_ && (c & 1)) ? -y : y;
+    }
+    odd_ = !odd_;
+  }
+
+  history_.keep(block, n, nout * r);
+  qin->pushRead(std::move(input));
+
+  for (size_t i = 0; i < outputs_.size(); i++) {
+    outputs_[i].second->pushWrite(std::move(buffers_[i]));
+  }
+
+  return n;
+}
+
+void Channelizer::setSource(std::unique_ptr<Source> source) {
+  source_ = std::move(source);
+}
+
+void Channelizer::start(std::shared_ptr<Queue<Samples> > queue) {
+  ASSERT(source_);
+  queue_ = std::move(queue);
+  thread_ = std::thread([this] {
+      Scheduling::apply("channelizer");
+      while (work(queue_) > 0) {
+      }
+    });
+#ifdef __APPLE__
+  pthread_setname_np("channelizer");
+#else
+  pthread_setname_np(thread_.native_handle(), "channelizer");
+#endif
+  source_->start(queue_);
+}
+
+void Channelizer::stop() {
+  source_->stop();
+  thread_.join();
+}
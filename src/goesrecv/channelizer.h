@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "fft.h"
+#include "history.h"
+#include "source.h"
+#include "types.h"
+
+// Channelizer splits the wideband stream of a single source into
+// narrowband channels, such that a single SDR can feed a demodulator
+// for every downlink within its bandwidth.
+//
+// It is a polyphase FFT filter bank with M channels, spaced by the
+// sample rate divided by M. Every channel is filtered by the same
+// prototype low pass filter and decimated by M/2 (2x oversampled), so
+// every channel has a sample rate of 2/M times the input sample rate.
+// The cost per input sample is that of a single filter with M times
+// fewer taps than a channel filter, plus a small FFT (or, when only a
+// few channels are used, a DFT of only those channels).
+//
+// A downlink is received from the channel nearest to it, and is
+// typically not at the center of that channel. The passband of every
+// channel therefore extends beyond the channel spacing, to 0.8 times
+// the spacing on either side. Everything that aliases onto the
+// passband as a result of decimation is attenuated by ~60 dB. The
+// remaining offset is removed after the channelizer (see FrontEnd).
+//
+class Channelizer {
+public:
+  // Returns the largest number of channels (a power of 2, at least 2)
+  // for which every signal fits the passband of its channel, or 0 if
+  // there is none. Signals are specified by their offset from the
+  // tuned frequency and their one-sided bandwidth, both in Hz.
+  static int channels(
+      uint32_t sampleRate,
+      const std::vector<std::pair<double, double> >& signals);
+
+  // The number of channels must be a power of 2 (1 for no filter bank).
+  explicit Channelizer(uint32_t sampleRate, int channels);
+  ~Channelizer();
+
+  int getChannels() const {
+    return channels_;
+  }
+
+  // Sample rate of every channel
+  uint32_t getChannelRate() const {
+    if (channels_ == 1) {
+      return sampleRate_;
+    }
+    return (2 * sampleRate_) / channels_;
+  }
+
+  // One-sided passband of every channel in Hz
+  double getPassband() const;
+
+  // Returns the channel nearest to the specified frequency offset.
+  int channel(double frequency) const;
+
+  // Returns the frequency offset of the center of a channel.
+  double getFrequency(int channel) const;
+
+  // Returns a source that produces the samples of a channel. It is
+  // started by the demodulator it is passed to, and its queue is
+  // closed when the channelizer stops. It must not outlive the
+  // channelizer, and must be started before the channelizer is.
+  std::unique_ptr<Source> open(int channel);
+
+  // Processes a single block of samples and writes the output of every
+  // connected channel to its queue. The number of output samples is
+  // always a multiple of 4 (see AGC), unless there is no filter bank.
+  // Returns the number of samples consumed (0 if the input has closed).
+  size_t work(const std::shared_ptr<Queue<Samples> >& qin);
+
+  // Sets the source to read samples from. This must happen before the
+  // channels are started, for them to report what the source drops.
+  void setSource(std::unique_ptr<Source> source);
+
+  // Starts the source, and distributes its samples on a separate thread.
+  void start(std::shared_ptr<Queue<Samples> > queue);
+
+  // Stops the source and closes the queues of all channels once the
+  // remaining samples of the source have been processed.
+  void stop();
+
+protected:
+  class Channel;
+
+  void connect(int channel, std::shared_ptr<Queue<Samples> > queue);
+
+  const uint32_t sampleRate_;
+  const int channels_;
+
+  // Prototype filter (time reversed), a multiple of 2 * channels_ taps,
+  // with every tap stored twice (see work)
+  std::vector<float> taps_;
+  History history_;
+
+  // Filter output folded onto channels_ samples (interleaved real and
+  // imaginary parts), reversed and transformed in place
+  std::vector<float> acc_;
+  std::vector<std::complex<float> > folded_;
+  FFT fft_;
+
+  // With few channels, they are computed from the folded sums directly,
+  // with a row of the inverse DFT per channel
+  std::vector<std::vector<float> > rows_;
+  bool useFFT_;
+
+  // Every other output of an odd channel is negated (see work)
+  bool odd_;
+
+  // Channels and the queues of their demodulators
+  std::vector<std::pair<int, std::shared_ptr<Queue<Samples> > > > outputs_;
+
+  // Output buffer of every channel (kept to avoid allocating per block)
+  std::vector<std::unique_ptr<Samples> > buffers_;
+
+  std::unique_ptr<Source> source_;
+  std::shared_ptr<Queue<Samples> > queue_;
+  std::thread thread_;
+};
@@ -1,7 +1,14 @@
 #include "clock_recovery.h"
 
+#include <algorithm>
 #include <cmath>
 
+#include <util/error.h>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
 static constexpr int NUM_TAPS = 8;
 static constexpr int NUM_STEPS = 128;
 
@@ -139,7 +146,62 @@ static const float mmseTaps[NUM_STEPS+1][NUM_TAPS] = {
   {  0.00000e+00, 0.00000e+00,  0.00000e+00, 0.00000e+00, 1.00000e+00,  0.00000e+00, 0.00000e+00,  0.00000e+00 },
 };
 
-ClockRecovery::ClockRecovery(uint32_t sampleRate, uint32_t symbolRate) {
+namespace {
+
+#ifdef SIMD_X86
+
+// Interpolator taps with every tap repeated twice, such that they
+// can be multiplied with interleaved complex samples directly.
+struct InterleavedTaps {
+  InterleavedTaps() {
+    for (int i = 0; i < NUM_STEPS + 1; i++) {
+      for (int j = 0; j < NUM_TAPS; j++) {
+        taps[i][2 * j + 0] = mmseTaps[i][j];
+        taps[i][2 * j + 1] = mmseTaps[i][j];
+      }
+    }
+  }
+
+  alignas(32) float taps[NUM_STEPS+1][2*NUM_TAPS];
+};
+
+const InterleavedTaps mmseTaps2;
+
+// The interpolator below sums the products of taps and samples in
+// the same order as the scalar interpolator. Any difference in
+// rounding can make the loop skip or repeat a symbol, so the
+// implementations must produce identical output.
+TARGET_SSE41
+inline std::complex<float> interpolateSSE41(
+    const float* taps,
+    const std::complex<float>* s) {
+  const float* f = (const float*) s;
+  __m128 acc0 = _mm_mul_ps(_mm_loadu_ps(&f[0]), _mm_load_ps(&taps[0]));
+  __m128 acc1 = _mm_mul_ps(_mm_loadu_ps(&f[4]), _mm_load_ps(&taps[4]));
+  acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&f[8]), _mm_load_ps(&taps[8])));
+  acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(&f[12]), _mm_load_ps(&taps[12])));
+  __m128 acc = _mm_add_ps(acc0, acc1);
+  acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+  std::complex<float> out;
+  _mm_storel_pi((__m64*) &out, acc);
+  return out;
+}
+
+#endif
+
+} // namespace
+
+ClockRecovery::ClockRecovery(uint32_t sampleRate, uint32_t symbolRate)
+  : ClockRecovery(sampleRate, symbolRate, NUM_TAPS, NUM_STEPS) {
+}
+
+ClockRecovery::ClockRecovery(
+    uint32_t sampleRate,
+    uint32_t symbolRate,
+    int ntaps,
+    int nsteps)
+  : ntaps_(ntaps),
+    nsteps_(nsteps) {
   mu_ = 0.0f;
   omega_ = ((float) sampleRate / (float) symbolRate);
   setLoopBandwidth(1e-3f);
@@ -148,6 +210,7 @@ ClockRecovery::ClockRecovery(uint32_t sampleRate, uint32_t symbolRate) {
   constexpr auto deviate = 0.002f;
   omegaMin_ = omega_ - deviate * omega_;
   omegaMax_ = omega_ + deviate * omega_;
+  reportedOmega_ = omega_;
 
   p0t_ = 0.0f;
   p1t_ = 0.0f;
@@ -155,6 +218,16 @@ ClockRecovery::ClockRecovery(uint32_t sampleRate, uint32_t symbolRate) {
   c0t_ = 0.0f;
   c1t_ = 0.0f;
   c2t_ = 0.0f;
+
+  simd_ = simdBest();
+}
+
+ClockRecovery::~ClockRecovery() {
+}
+
+void ClockRecovery::setSIMD(SIMD simd) {
+  ASSERT(simdSupported(simd));
+  simd_ = simd;
 }
 
 void ClockRecovery::setLoopBandwidth(float bw) {
@@ -163,109 +236,112 @@ void ClockRecovery::setLoopBandwidth(float bw) {
   omegaGain_ = (4 * bw * bw) / (1.0 + 2.0 * damp * bw + bw * bw);
 }
 
-void ClockRecovery::work(
+size_t ClockRecovery::work(
+    const std::complex<float>* fi,
+    size_t i,
+    size_t nsamples,
+    Samples& output) {
+  switch (simd_) {
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+  case SIMD::AVX2:
+    // The 8 tap interpolator doesn't benefit from wider registers.
+    return workSSE41(fi, i, nsamples, output);
+#endif
+  default:
+    // There is no NEON specific implementation.
+    return workScalar(fi, i, nsamples, output);
+  }
+}
+
+// Process 1 sample per iteration.
+// This does not allow vectorization but is more stable than the
+// vectorized implementation (see git history of this file).
+// It is roughly 15% slower than previous implementation.
+size_t ClockRecovery::workScalar(
+    const std::complex<float>* fi,
+    size_t i,
+    size_t nsamples,
+    Samples& output) {
+  int index;
+  while (next(i, nsamples, index)) {
+    const std::complex<float>* s = &fi[i];
+
+    // Run interpolator to get interpolated samples at offset mu.
+    // The products are summed in the same order as the
+    // vectorized interpolators such that the output is identical.
+    std::complex<float> p[NUM_TAPS];
+    const auto taps = mmseTaps[index];
+    for (auto k = 0; k < NUM_TAPS; k++) {
+      p[k] = taps[k] * s[k];
+    }
+
+    update(((p[0] + p[4]) + (p[2] + p[6])) +
+           ((p[1] + p[5]) + (p[3] + p[7])), output);
+  }
+
+  return i;
+}
+
+#ifdef SIMD_X86
+
+// The loop itself is inherently serial; only the interpolator
+// is vectorized. The loop is duplicated such that the interpolator
+// can be inlined.
+
+TARGET_SSE41
+size_t ClockRecovery::workSSE41(
+    const std::complex<float>* fi,
+    size_t i,
+    size_t nsamples,
+    Samples& output) {
+  int index;
+  while (next(i, nsamples, index)) {
+    update(interpolateSSE41(mmseTaps2.taps[index], &fi[i]), output);
+  }
+
+  return i;
+}
+
+#endif
+
+size_t ClockRecovery::work(
     const std::shared_ptr<Queue<Samples> >& qin,
     const std::shared_ptr<Queue<Samples> >& qout) {
   auto input = qin->popForRead();
   if (!input) {
     qout->close();
-    return;
+    return 0;
   }
 
   auto output = qout->popForWrite();
-  tmp_.insert(tmp_.end(), input->begin(), input->end());
-
-  // Return read buffer (it has been copied into tmp_)
-  qin->pushRead(std::move(input));
+  auto ninput = input->size();
+  std::complex<float>* fi = input->data();
 
   // Omega is number of samples per symbol, so this
   // estimates the number of symbols we should find in this call.
-  auto nsamples = tmp_.size();
+  const auto h = history_.size();
   output->clear();
-  output->reserve(nsamples / omega_);
-
-  // Process 1 sample per iteration.
-  // This does not allow vectorization but is more stable than the
-  // vectorized implementation (see git history of this file).
-  // It is roughly 15% slower than previous implementation.
-  size_t i = 0;
-  while (i < nsamples) {
-    float muf;
-    int mui;
-    const std::complex<float>* s;
-
-    // Populate phase and sample pointer
-    muf = (float) mu_;
-    mui = (int) mu_;
-    s = &tmp_[i + mui];
-
-    // Check that we don't go out of range
-    if ((i + mui + 7) >= nsamples) {
-      break;
-    }
-
-    // In range; update sample index and phase
-    i += mui;
-    mu_ -= mui;
+  output->reserve((h + ninput) / omega_);
 
-    // Normalize mu to [0.0, 1.0) so we can use it to
-    // choose the right interpolation filter.
-    muf = muf - (float) mui;
-
-    // Run interpolator to get interpolated samples at offset mu
-    std::complex<float> acc = 0.0f;
-    const auto taps = mmseTaps[(int) (muf * 128.0f)];
-    for (auto k = 0; k < NUM_TAPS; k++) {
-      acc += taps[k] * s[k];
-    }
-
-    // Push down sample
-    p2t_ = p1t_;
-    p1t_ = p0t_;
-    p0t_ = acc;
-
-    // Push down associated complex quadrant
-    c2t_ = c1t_;
-    c1t_ = c0t_;
-    c0t_.real((p0t_.real() > 0.0f ? 1.0f : 0.0f));
-    c0t_.imag((p0t_.imag() > 0.0f ? 1.0f : 0.0f));
-
-    // Use interpolated sample as output
-    // Then use the estimated error to update omega_ and mu_
-    output->push_back(p0t_);
-
-    // Compute error
-    std::complex<float> x = (c0t_ - c2t_) * std::conj(p1t_);
-    std::complex<float> y = (p0t_ - p2t_) * std::conj(c1t_);
-    std::complex<float> u = y - x;
-
-    // Clip error to [-1.0, 1.0]
-    float mm = u.real();
-    mm = 0.5f * (fabsf(mm + 1.0f) - fabsf(mm - 1.0f));
-
-    // Update omega
-    omega_ += omegaGain_ * mm;
-
-    // Wrap omega if it hits the lower or upper bound.
-    // If the algorithm is biased to always increase omega at a
-    // certain point, it will wrap and start from minimum, in the
-    // hope it locks on to the signal again.
-    if (omega_ < omegaMin_) {
-      omega_ = omegaMax_;
-    }
-    if (omega_ > omegaMax_) {
-      omega_ = omegaMin_;
-    }
-
-    // Update mu with new omega
-    // It is OK if this is bigger than 1.0 because that means
-    // we need to skip a few samples in the next iteration.
-    mu_ += omega_ + muGain_ * mm;
+  // Symbols whose interpolation window starts in the history are
+  // interpolated from a joined copy. It extends far enough into the
+  // block for the loop to move past the history before it runs out
+  // of samples; a symbol advances at most omegaMax_ + 2 samples.
+  const auto nhead = std::min<size_t>(ntaps_ + (size_t) omegaMax_ + 2, ninput);
+  size_t i = work(history_.join(fi, nhead), 0, h + nhead, *output);
+  if (nhead < ninput) {
+    ASSERT(i >= h);
+    i = h + work(fi, i - h, ninput, *output);
   }
 
-  // Index i was not used yet. Copy the sample at index i and
-  // everything after it to the beginning of the sample buffer.
-  tmp_.erase(tmp_.begin(), tmp_.begin() + i);
+  // Index i was not used yet. Keep the sample at index i and
+  // everything after it for the next block.
+  history_.keep(fi, ninput, i);
+  reportedOmega_.store(omega_, std::memory_order_relaxed);
+
+  // Return read buffer
+  qin->pushRead(std::move(input));
 
   // Publish output if applicable
   if (samplePublisher_) {
@@ -274,4 +350,5 @@ void ClockRecovery::work(
 
   // Return output buffer
   qout->pushWrite(std::move(output));
+  return ninput;
 }
@@ -1,14 +1,27 @@
 #pragma once
 
+#include <atomic>
+#include <cmath>
 #include <memory>
 
+#include "history.h"
 #include "sample_publisher.h"
+#include "simd.h"
 #include "types.h"
 
 class ClockRecovery {
 public:
   explicit ClockRecovery(uint32_t sampleRate, uint32_t symbolRate);
 
+  virtual ~ClockRecovery();
+
+  // Select interpolator implementation (defaults to best supported).
+  void setSIMD(SIMD simd);
+
+  SIMD getSIMD() const {
+    return simd_;
+  }
+
   void setSamplePublisher(std::unique_ptr<SamplePublisher> samplePublisher) {
     samplePublisher_ = std::move(samplePublisher);
   }
@@ -17,21 +30,66 @@ public:
   void setLoopBandwidth(float bw);
 
   // Returns number of samples per symbol.
+  // Safe to call from any thread; updated once per block.
   float getOmega() const {
-    return omega_;
+    return reportedOmega_.load(std::memory_order_relaxed);
   }
 
-  void work(
+  // Processes a single block of samples.
+  // Returns the number of samples consumed (0 if the input has closed).
+  size_t work(
       const std::shared_ptr<Queue<Samples> >& qin,
       const std::shared_ptr<Queue<Samples> >& qout);
 
 protected:
+  // Used by subclasses with a different interpolator. The interpolator
+  // uses ntaps samples and has nsteps + 1 fractional delays in [0, 1].
+  explicit ClockRecovery(
+      uint32_t sampleRate,
+      uint32_t symbolRate,
+      int ntaps,
+      int nsteps);
+
+  // Processes samples starting at index i and returns the index of
+  // the first sample that was not used.
+  virtual size_t work(
+      const std::complex<float>* fi,
+      size_t i,
+      size_t nsamples,
+      Samples& output);
+
+  size_t workScalar(
+      const std::complex<float>* fi,
+      size_t i,
+      size_t nsamples,
+      Samples& output);
+
+#ifdef SIMD_X86
+  TARGET_SSE41 size_t workSSE41(
+      const std::complex<float>* fi,
+      size_t i,
+      size_t nsamples,
+      Samples& output);
+#endif
+
+  // Advances sample index to the next symbol and returns the index
+  // of the interpolation filter to use, or false if out of range.
+  bool next(size_t& i, size_t nsamples, int& index);
+
+  // Updates loop state with newly interpolated symbol.
+  void update(std::complex<float> sample, Samples& output);
+
+  const int ntaps_;
+  const int nsteps_;
+
   float omega_;
   float omegaMin_;
   float omegaMax_;
   float omegaGain_;
   float mu_;
   float muGain_;
+  std::atomic<float> reportedOmega_;
+  SIMD simd_;
 
   // Past samples
   std::complex<float> p0t_;
@@ -43,7 +101,76 @@ protected:
   std::complex<float> c1t_;
   std::complex<float> c2t_;
 
-  Samples tmp_;
+  // Samples that were not used by the previous block
+  History history_;
 
   std::unique_ptr<SamplePublisher> samplePublisher_;
 };
+
+// The loop functions below are defined here, such that they can be
+// inlined into the kernels of subclasses.
+
+SIMD_INLINE
+bool ClockRecovery::next(size_t& i, size_t nsamples, int& index) {
+  const int mui = (int) mu_;
+
+  // Check that we don't go out of range
+  if ((i + mui + ntaps_ - 1) >= nsamples) {
+    return false;
+  }
+
+  // In range; update sample index and phase
+  i += mui;
+  mu_ -= mui;
+
+  // Mu is now normalized to [0.0, 1.0) so we can use it to
+  // choose the right interpolation filter.
+  index = (int) (mu_ * nsteps_);
+  return true;
+}
+
+SIMD_INLINE
+void ClockRecovery::update(std::complex<float> sample, Samples& output) {
+  // Push down sample
+  p2t_ = p1t_;
+  p1t_ = p0t_;
+  p0t_ = sample;
+
+  // Push down associated complex quadrant
+  c2t_ = c1t_;
+  c1t_ = c0t_;
+  c0t_.real((p0t_.real() > 0.0f ? 1.0f : 0.0f));
+  c0t_.imag((p0t_.imag() > 0.0f ? 1.0f : 0.0f));
+
+  // Use interpolated sample as output
+  // Then use the estimated error to update omega_ and mu_
+  output.push_back(p0t_);
+
+  // Compute error
+  std::complex<float> x = (c0t_ - c2t_) * std::conj(p1t_);
+  std::complex<float> y = (p0t_ - p2t_) * std::conj(c1t_);
+  std::complex<float> u = y - x;
+
+  // Clip error to [-1.0, 1.0]
+  float mm = u.real();
+  mm = 0.5f * (fabsf(mm + 1.0f) - fabsf(mm - 1.0f));
+
+  // Update omega
+  omega_ += omegaGain_ * mm;
+
+  // Wrap omega if it hits the lower or upper bound.
+  // If the algorithm is biased to always increase omega at a
+  // certain point, it will wrap and start from minimum, in the
+  // hope it locks on to the signal again.
+  if (omega_ < omegaMin_) {
+    omega_ = omegaMax_;
+  }
+  if (omega_ > omegaMax_) {
+    omega_ = omegaMin_;
+  }
+
+  // Update mu with new omega
+  // It is OK if this is bigger than 1.0 because that means
+  // we need to skip a few samples in the next iteration.
+  mu_ += omega_ + muGain_ * mm;
+}
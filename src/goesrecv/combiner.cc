@@ -0,0 +1,422 @@
+#include "combiner.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include <nanomsg/nn.h>
+#include <nanomsg/pubsub.h>
+
+#include "decoder/correlator.h"
+
+#include "scheduling.h"
+
+namespace {
+
+// Minimum number of matching bits of two consecutive sync words to
+// find them (random bits match 64 +/- 6), and of the sync word to
+// keep finding it where it is expected (32 +/- 4)
+constexpr int acquireThreshold = 100;
+constexpr int trackThreshold = 44;
+
+// Consecutive frames without sync word before searching again
+constexpr int maxMisses = 4;
+
+// Frames queued per stream before the oldest is dropped
+constexpr size_t maxFrames = 64;
+
+// Fraction of the hard bits that matching frames agree on. Unrelated
+// frames agree on half of them, give or take 1/180th.
+constexpr double matchThreshold = 0.55;
+
+// Interval to check for frames that waited long enough
+constexpr std::chrono::milliseconds pollInterval{10};
+
+// Returns hard bits of 64 soft bits, the first in the most
+// significant bit (a negative soft bit is a 1, as in correlate)
+uint64_t hardBits(const int8_t* bits) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < 64; i++) {
+    v = (v << 1) | (bits[i] < 0);
+  }
+  return v;
+}
+
+int syncWordErrors(const int8_t* bits, uint64_t syncWord) {
+  return __builtin_popcountll(hardBits(bits) ^ syncWord);
+}
+
+} // namespace
+
+constexpr size_t Combiner::frameBits;
+constexpr size_t Combiner::syncWordBits;
+constexpr size_t Combiner::matchBits;
+
+Combiner::Combiner(const Config& config)
+    : maxDelay_(config.combiner.maxDelay),
+      stopping_(false) {
+  if (config.demodulator.downlinkType == "hrit") {
+    syncWord_ = decoder::encodedSyncWord(decoder::HRIT_PHASE_000);
+  } else {
+    syncWord_ = decoder::encodedSyncWord(decoder::LRIT_PHASE_000);
+  }
+
+  for (const auto& endpoint : config.combiner.connect) {
+    auto fd = nn_socket(AF_SP, NN_SUB);
+    if (fd < 0) {
+      std::stringstream ss;
+      ss << "nn_socket: " << nn_strerror(nn_errno());
+      throw std::runtime_error(ss.str());
+    }
+
+    auto rv = nn_connect(fd, endpoint.c_str());
+    if (rv < 0) {
+      nn_close(fd);
+      std::stringstream ss;
+      ss << "nn_connect: " << nn_strerror(nn_errno());
+      ss << " (" << endpoint << ")";
+      throw std::runtime_error(ss.str());
+    }
+
+    int size = config.combiner.receiveBuffer;
+    if (size > 0) {
+      rv = nn_setsockopt(fd, NN_SOL_SOCKET, NN_RCVBUF, &size, sizeof(size));
+      if (rv < 0) {
+        nn_close(fd);
+        std::stringstream ss;
+        ss << "nn_setsockopt: " << nn_strerror(nn_errno());
+        throw std::runtime_error(ss.str());
+      }
+    }
+
+    rv = nn_setsockopt(fd, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+    if (rv < 0) {
+      nn_close(fd);
+      std::stringstream ss;
+      ss << "nn_setsockopt: " << nn_strerror(nn_errno());
+      ss << " (" << endpoint << ")";
+      throw std::runtime_error(ss.str());
+    }
+
+    auto stream = std::make_unique<Stream>();
+    stream->endpoint = endpoint;
+    stream->fd = fd;
+    stream->locked = false;
+    stream->misses = 0;
+    stream->negate = false;
+    streams_.push_back(std::move(stream));
+  }
+
+  queue_ = std::make_shared<LockingQueue<std::vector<int8_t> > >(2);
+}
+
+Combiner::~Combiner() {
+  for (auto& stream : streams_) {
+    if (stream->fd >= 0) {
+      nn_close(stream->fd);
+    }
+  }
+}
+
+void Combiner::receive(Stream& stream) {
+  Scheduling::apply("combiner");
+
+  void* buf = nullptr;
+  int nbytes;
+  for (;;) {
+    nbytes = nn_recv(stream.fd, &buf, NN_MSG, 0);
+    if (nbytes <= 0) {
+      return;
+    }
+
+    const int8_t* bits = (const int8_t*) buf;
+    stream.buffer.insert(stream.buffer.end(), bits, bits + nbytes);
+    nn_freemsg(buf);
+
+    split(stream);
+  }
+}
+
+void Combiner::split(Stream& stream) {
+  const auto& buf = stream.buffer;
+  size_t pos = 0;
+  for (;;) {
+    if (!stream.locked) {
+      // Find the best pair of sync words a frame apart, over a frame
+      // worth of positions
+      const size_t n = frameBits + syncWordBits - 1;
+      if (buf.size() - pos < frameBits + n) {
+        break;
+      }
+
+      uint64_t v0 = 0;
+      uint64_t v1 = 0;
+      int max = 0;
+      size_t offset = 0;
+      for (size_t i = 0; i < n; i++) {
+        v0 = (v0 << 1) | (buf[pos + i] < 0);
+        v1 = (v1 << 1) | (buf[pos + frameBits + i] < 0);
+        if (i < syncWordBits - 1) {
+          continue;
+        }
+        const int errors =
+          __builtin_popcountll(v0 ^ syncWord_) +
+          __builtin_popcountll(v1 ^ syncWord_);
+        const int matches = std::max(128 - errors, errors);
+        if (matches > max) {
+          max = matches;
+          offset = i - (syncWordBits - 1);
+        }
+      }
+
+      if (max < acquireThreshold) {
+        pos += frameBits;
+        continue;
+      }
+
+      pos += offset;
+      stream.locked = true;
+      stream.misses = 0;
+    }
+
+    // Wait for the complete frame
+    if (buf.size() - pos < frameBits) {
+      break;
+    }
+
+    // The sign of the sync word tells the phase; without sync word,
+    // assume the phase didn't change
+    const int errors = syncWordErrors(&buf[pos], syncWord_);
+    const bool sync = std::max(64 - errors, errors) >= trackThreshold;
+    if (sync) {
+      stream.negate = (errors > 32);
+      stream.misses = 0;
+    } else if (++stream.misses >= maxMisses) {
+      stream.locked = false;
+      continue;
+    }
+
+    push(stream, &buf[pos], sync);
+    pos += frameBits;
+  }
+
+  stream.buffer.erase(stream.buffer.begin(), stream.buffer.begin() + pos);
+}
+
+void Combiner::push(Stream& stream, const int8_t* bits, bool sync) {
+  Frame frame;
+  frame.bits.resize(frameBits);
+  if (stream.negate) {
+    for (size_t i = 0; i < frameBits; i++) {
+      frame.bits[i] = std::min(-bits[i], 127);
+    }
+  } else {
+    std::copy(bits, bits + frameBits, frame.bits.begin());
+  }
+
+  // Mean and variance of the absolute soft bits; the noise is the
+  // variance around the mean (see quality.h for its bias). Moment
+  // estimators that are unbiased for Gaussian noise do worse, because
+  // the soft bits are clipped.
+  int64_t sum = 0;
+  int64_t sumSquares = 0;
+  for (size_t i = 0; i < frameBits; i++) {
+    const int v = frame.bits[i];
+    sum += std::abs(v);
+    sumSquares += v * v;
+  }
+  const float mean = (float) sum / frameBits;
+  frame.amplitude = mean;
+  frame.variance = std::max(
+    (float) sumSquares / frameBits - mean * mean,
+    1.0f);
+
+  for (size_t i = 0; i < matchBits / 64; i++) {
+    frame.key[i] = hardBits(&frame.bits[syncWordBits + 64 * i]);
+  }
+
+  frame.sync = sync;
+  frame.time = std::chrono::steady_clock::now();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  stream.frames.push_back(std::move(frame));
+  if (stream.frames.size() > maxFrames) {
+    stream.frames.pop_front();
+  }
+  cv_.notify_one();
+}
+
+int Combiner::match(const Stream& stream, const Frame& frame) const {
+  const int threshold = matchThreshold * matchBits;
+  for (size_t k = 0; k < stream.frames.size(); k++) {
+    const auto& other = stream.frames[k];
+    int errors = 0;
+    for (size_t i = 0; i < matchBits / 64; i++) {
+      errors += __builtin_popcountll(frame.key[i] ^ other.key[i]);
+    }
+    if ((int) matchBits - errors >= threshold) {
+      return k;
+    }
+  }
+  return -1;
+}
+
+bool Combiner::next(std::vector<Frame>& frames) {
+  // Start with the frame that arrived first
+  Stream* candidate = nullptr;
+  for (auto& stream : streams_) {
+    if (stream->frames.empty()) {
+      continue;
+    }
+    if (!candidate ||
+        stream->frames.front().time < candidate->frames.front().time) {
+      candidate = stream.get();
+    }
+  }
+
+  if (!candidate) {
+    return false;
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  std::vector<int> index(streams_.size());
+  for (size_t attempt = 0; attempt < streams_.size(); attempt++) {
+    const auto& frame = candidate->frames.front();
+
+    // If another stream has frames before the matching one, they
+    // were transmitted before this frame, and go first
+    Stream* earlier = nullptr;
+    bool complete = true;
+    for (size_t i = 0; i < streams_.size(); i++) {
+      auto& stream = *streams_[i];
+      index[i] = (&stream == candidate) ? 0 : match(stream, frame);
+      if (index[i] < 0) {
+        complete = false;
+      } else if (index[i] > 0 && !earlier) {
+        earlier = &stream;
+      }
+    }
+
+    if (earlier) {
+      candidate = earlier;
+      continue;
+    }
+
+    // Wait for the other streams, unless they had enough time
+    if (!complete && now - frame.time < maxDelay_) {
+      return false;
+    }
+
+    for (size_t i = 0; i < streams_.size(); i++) {
+      if (index[i] == 0) {
+        frames.push_back(std::move(streams_[i]->frames.front()));
+        streams_[i]->frames.pop_front();
+      }
+    }
+    return true;
+  }
+
+  // The streams don't agree on the order of their frames
+  frames.push_back(std::move(candidate->frames.front()));
+  candidate->frames.pop_front();
+  return true;
+}
+
+void Combiner::combine(
+    const std::vector<Frame>& frames,
+    std::vector<int8_t>& out) {
+  out.resize(frameBits);
+  if (frames.size() == 1) {
+    std::copy(frames[0].bits.begin(), frames[0].bits.end(), out.begin());
+    return;
+  }
+
+  // The soft bits of a frame are its amplitude times the transmitted
+  // symbol plus noise. Weighing them by the amplitude over the noise
+  // variance maximizes the SNR of the sum. The sum is scaled to the
+  // largest amplitude of the frames.
+  std::vector<float> weights;
+  float amplitude = 0.0f;
+  float sum = 0.0f;
+  for (const auto& frame : frames) {
+    weights.push_back(frame.amplitude / frame.variance);
+    amplitude = std::max(amplitude, frame.amplitude);
+    sum += weights.back() * frame.amplitude;
+  }
+  for (auto& weight : weights) {
+    weight *= amplitude / sum;
+  }
+
+  for (size_t j = 0; j < frameBits; j++) {
+    float v = 0.0f;
+    for (size_t i = 0; i < frames.size(); i++) {
+      v += weights[i] * frames[i].bits[j];
+    }
+    out[j] = std::max(std::min(lrintf(v), 127L), -127L);
+  }
+}
+
+void Combiner::loop() {
+  Scheduling::apply("combiner");
+
+  std::vector<Frame> frames;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    frames.clear();
+    if (!next(frames)) {
+      cv_.wait_for(lock, pollInterval);
+      continue;
+    }
+
+    // A frame that matches no other stream, and that doesn't start
+    // with the sync word, is most likely noise
+    if (frames.size() == 1 && !frames[0].sync) {
+      continue;
+    }
+
+    lock.unlock();
+    auto out = queue_->popForWrite();
+    combine(frames, *out);
+    queue_->pushWrite(std::move(out));
+    lock.lock();
+  }
+}
+
+void Combiner::start() {
+  for (auto& stream : streams_) {
+    auto& s = *stream;
+    s.thread = std::thread([this, &s] { receive(s); });
+#ifndef __APPLE__
+    pthread_setname_np(s.thread.native_handle(), "combiner");
+#endif
+  }
+
+  thread_ = std::thread(&Combiner::loop, this);
+#ifdef __APPLE__
+  pthread_setname_np("combiner");
+#else
+  pthread_setname_np(thread_.native_handle(), "combiner");
+#endif
+}
+
+void Combiner::stop() {
+  // Unblocks the receive of every stream
+  for (auto& stream : streams_) {
+    nn_close(stream->fd);
+    stream->fd = -1;
+    stream->thread.join();
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+    cv_.notify_one();
+  }
+  thread_.join();
+
+  // Close queue to signal downstream
+  queue_->close();
+}
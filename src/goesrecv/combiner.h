@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "queue.h"
+
+// Combiner receives the soft bits of the same downlink from multiple
+// receivers (their soft bit publishers), and combines them into a
+// single stream of soft bits for the decoder. A packet that none of
+// the receivers can decode on its own (e.g. during rain fade) can
+// still be decodable from the sum of their soft bits.
+//
+// Every stream is split into frames at its sync words. Frames start
+// with the sync word, and are negated if the sync word is inverted
+// (the phase ambiguity of the Costas loop), such that the frames of
+// different receivers have the same sign.
+//
+// Frames of different streams are matched by correlating their hard
+// bits. The receivers and the network between them and the combiner
+// have different delays, so every stream is queued until either all
+// of them have the frame, or the oldest frame waited for maxDelay.
+// Fill frames are nearly identical to each other and can be combined
+// with the wrong one, which is harmless; frames with data are not.
+//
+// Matching frames are summed with maximum ratio weighting: the soft
+// bit of every frame is weighted by its amplitude over its noise
+// variance, estimated from the frame itself. A receiver that lost the
+// signal adds (next to) nothing.
+//
+class Combiner {
+public:
+  // Soft bits per frame, including the sync word
+  static constexpr size_t frameBits = 16384;
+
+  // Soft bits of the sync word
+  static constexpr size_t syncWordBits = 64;
+
+  // Soft bits after the sync word used to match frames
+  static constexpr size_t matchBits = 8192;
+
+  // Connects to the soft bit publishers in the [combiner] section.
+  // The sync word follows from the downlink type.
+  explicit Combiner(const Config& config);
+  ~Combiner();
+
+  std::shared_ptr<Queue<std::vector<int8_t> > > getSoftBitsQueue() {
+    return queue_;
+  }
+
+  void start();
+  void stop();
+
+protected:
+  struct Frame {
+    std::vector<int8_t> bits;
+
+    // Hard bits of the soft bits used for matching
+    uint64_t key[matchBits / 64];
+
+    // Mean absolute soft bit and noise variance around it
+    float amplitude;
+    float variance;
+
+    // If the frame started with the sync word (rather than where
+    // the sync word was expected)
+    bool sync;
+
+    std::chrono::steady_clock::time_point time;
+  };
+
+  struct Stream {
+    std::string endpoint;
+    int fd;
+    std::thread thread;
+
+    // Soft bits that are not part of a frame yet
+    std::vector<int8_t> buffer;
+
+    bool locked;
+    int misses;
+
+    // If the frames are inverted (sync word found inverted)
+    bool negate;
+
+    // Frames waiting to be combined (guarded by mutex_)
+    std::deque<Frame> frames;
+  };
+
+  // Receives the soft bits of a stream and splits them into frames
+  void receive(Stream& stream);
+
+  // Appends frames to the stream for every sync word in its buffer
+  void split(Stream& stream);
+
+  // Appends a frame (if the stream is inverted, negated)
+  void push(Stream& stream, const int8_t* bits, bool sync);
+
+  // Returns index of the frame of the stream that matches the frame,
+  // or -1 if there is none
+  int match(const Stream& stream, const Frame& frame) const;
+
+  // Takes the next set of matching frames from the streams, if the
+  // streams have them (or if waiting for them timed out)
+  bool next(std::vector<Frame>& frames);
+
+  // Sums the frames into the output
+  void combine(const std::vector<Frame>& frames, std::vector<int8_t>& out);
+
+  void loop();
+
+  uint64_t syncWord_;
+  std::chrono::milliseconds maxDelay_;
+
+  std::vector<std::unique_ptr<Stream> > streams_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_;
+  std::thread thread_;
+
+  std::shared_ptr<Queue<std::vector<int8_t> > > queue_;
+};
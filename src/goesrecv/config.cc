@@ -1,5 +1,8 @@
 #include "config.h"
 
+#include <sched.h>
+#include <unistd.h>
+
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
@@ -21,32 +24,85 @@ void setIfZero(T& out, T value) {
   }
 }
 
-std::unique_ptr<SamplePublisher> createSamplePublisher(const toml::Value& v) {
+// Sample and soft bit publishers can publish to a nanomsg socket, to a
+// shared memory ring, or both.
+template <typename T>
+std::unique_ptr<T> createTapPublisher(const toml::Value& v, uint32_t elementSize) {
   auto bind = v.find("bind");
-  if (!bind) {
-    throw std::invalid_argument("Expected publisher section to have \"bind\" key");
+  auto shm = v.find("shm");
+  if (!bind && !shm) {
+    throw std::invalid_argument("Expected publisher section to have \"bind\" or \"shm\" key");
   }
 
-  // Only need bind value to create publisher
-  auto p = SamplePublisher::create(bind->as<std::string>());
+  std::unique_ptr<T> p;
+  if (bind) {
+    p = T::create(bind->as<std::string>());
 
-  // Optional send buffer size
-  auto sendBuffer = v.find("send_buffer");
-  if (sendBuffer) {
-    p->setSendBuffer(sendBuffer->as<int>());
+    // Optional send buffer size
+    auto sendBuffer = v.find("send_buffer");
+    if (sendBuffer) {
+      p->setSendBuffer(sendBuffer->as<int>());
+    }
+  } else {
+    p = std::make_unique<T>(-1);
+  }
+
+  if (shm) {
+    // Optional ring size (default 4MB)
+    size_t size = 4 * 1024 * 1024;
+    auto shmSize = v.find("shm_size");
+    if (shmSize) {
+      if (shmSize->as<int>() <= 0) {
+        throwInvalidKey("shm_size");
+      }
+      size = shmSize->as<int>();
+    }
+
+    // Optional permissions (octal string, default owner only)
+    mode_t mode = ShmRing::defaultMode;
+    auto shmMode = v.find("shm_mode");
+    if (shmMode) {
+      const auto str = shmMode->as<std::string>();
+      size_t pos = 0;
+      unsigned long value = 0;
+      try {
+        value = std::stoul(str, &pos, 8);
+      } catch (const std::logic_error&) {
+        throwInvalidKey("shm_mode");
+      }
+      if (pos != str.size() || value > 0777) {
+        throwInvalidKey("shm_mode");
+      }
+      mode = value;
+    }
+
+    const auto name = shm->as<std::string>();
+    if (name.size() < 2 || name[0] != '/' || name.find('/', 1) != std::string::npos) {
+      throwInvalidKey("shm");
+    }
+    p->setRing(ShmRing::create(name, size, elementSize, mode));
   }
 
   return p;
 }
 
+std::unique_ptr<SamplePublisher> createSamplePublisher(const toml::Value& v) {
+  // Samples are published as complex int8
+  return createTapPublisher<SamplePublisher>(v, 2);
+}
+
 std::unique_ptr<SoftBitPublisher> createSoftBitPublisher(const toml::Value& v) {
+  return createTapPublisher<SoftBitPublisher>(v, 1);
+}
+
+std::unique_ptr<PacketPublisher> createPacketPublisher(const toml::Value& v) {
   auto bind = v.find("bind");
   if (!bind) {
     throw std::invalid_argument("Expected publisher section to have \"bind\" key");
   }
 
   // Only need bind value to create publisher
-  auto p = SoftBitPublisher::create(bind->as<std::string>());
+  auto p = PacketPublisher::create(bind->as<std::string>());
 
   // Optional send buffer size
   auto sendBuffer = v.find("send_buffer");
@@ -57,14 +113,14 @@ std::unique_ptr<SoftBitPublisher> createSoftBitPublisher(const toml::Value& v) {
   return p;
 }
 
-std::unique_ptr<PacketPublisher> createPacketPublisher(const toml::Value& v) {
+std::unique_ptr<SpectrumPublisher> createSpectrumPublisher(const toml::Value& v) {
   auto bind = v.find("bind");
   if (!bind) {
     throw std::invalid_argument("Expected publisher section to have \"bind\" key");
   }
 
   // Only need bind value to create publisher
-  auto p = PacketPublisher::create(bind->as<std::string>());
+  auto p = SpectrumPublisher::create(bind->as<std::string>());
 
   // Optional send buffer size
   auto sendBuffer = v.find("send_buffer");
@@ -90,6 +146,113 @@ Config::StatsPublisher createStatsPublisher(const toml::Value& v) {
     out.sendBuffer = sendBuffer->as<int>();
   }
 
+  // Optional minimum time between messages
+  auto interval = v.find("interval");
+  if (interval) {
+    if (interval->as<int>() < 0) {
+      throwInvalidKey("interval");
+    }
+    out.interval = interval->as<int>();
+  }
+
+  return out;
+}
+
+// Every element of the pipeline array is either a single stage name
+// or an array of stage names that share a thread.
+std::vector<std::vector<std::string> > loadPipeline(const toml::Value& v) {
+  std::vector<std::vector<std::string> > out;
+  for (const auto& group : v.as<toml::Array>()) {
+    if (group.is<std::string>()) {
+      out.push_back({group.as<std::string>()});
+      continue;
+    }
+
+    std::vector<std::string> names;
+    for (const auto& name : group.as<toml::Array>()) {
+      names.push_back(name.as<std::string>());
+    }
+    if (names.empty()) {
+      throw std::invalid_argument("Expected 'pipeline' groups to be non-empty");
+    }
+    out.push_back(std::move(names));
+  }
+  return out;
+}
+
+std::map<std::string, SIMD> loadKernels(const toml::Value& v) {
+  std::map<std::string, SIMD> out;
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key != "source" &&
+        key != "frontend" &&
+        key != "agc" &&
+        key != "costas" &&
+        key != "rrc" &&
+        key != "clock_recovery" &&
+        key != "quantization") {
+      throwInvalidKey(key);
+    }
+
+    // Leave kernel out to use autotune result or default
+    const auto name = value.as<std::string>();
+    if (name != "auto") {
+      out[key] = simdFromName(name);
+    }
+  }
+  return out;
+}
+
+Config::Demodulator::QueueDepth loadQueueDepth(const toml::Value& v) {
+  Config::Demodulator::QueueDepth out;
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto depth = it.second.as<int>();
+    if (depth < 1) {
+      throw std::invalid_argument("Expected queue depth to be at least 1");
+    }
+
+    if (key == "source") {
+      out.source = depth;
+      continue;
+    }
+
+    if (key == "frontend") {
+      out.frontend = depth;
+      continue;
+    }
+
+    if (key == "agc") {
+      out.agc = depth;
+      continue;
+    }
+
+    if (key == "costas") {
+      out.costas = depth;
+      continue;
+    }
+
+    if (key == "rrc") {
+      out.rrc = depth;
+      continue;
+    }
+
+    if (key == "clock_recovery") {
+      out.clockRecovery = depth;
+      continue;
+    }
+
+    if (key == "quantization") {
+      out.quantization = depth;
+      continue;
+    }
+
+    throwInvalidKey(key);
+  }
   return out;
 }
 
@@ -119,6 +282,71 @@ void loadDemodulator(Config::Demodulator& out, const toml::Value& v) {
       continue;
     }
 
+    if (key == "frontend") {
+      out.frontend = value.as<bool>();
+      continue;
+    }
+
+    if (key == "pipeline") {
+      out.pipeline = loadPipeline(value);
+      continue;
+    }
+
+    if (key == "queue") {
+      out.queue = value.as<std::string>();
+      if (out.queue != "locking" && out.queue != "spsc") {
+        throw std::invalid_argument("Expected 'queue' to be \"locking\" or \"spsc\"");
+      }
+      continue;
+    }
+
+    if (key == "queue_depth") {
+      out.queueDepth = loadQueueDepth(value);
+      continue;
+    }
+
+    if (key == "latency") {
+      out.latency = value.as<double>();
+      if (out.latency <= 0) {
+        throw std::invalid_argument("Expected 'latency' to be positive");
+      }
+      continue;
+    }
+
+    if (key == "source_overflow") {
+      out.sourceOverflow = value.as<std::string>();
+      if (out.sourceOverflow != "block" &&
+          out.sourceOverflow != "drop_newest" &&
+          out.sourceOverflow != "drop_oldest") {
+        throw std::invalid_argument(
+          "Expected 'source_overflow' to be \"block\", \"drop_newest\", or \"drop_oldest\"");
+      }
+      continue;
+    }
+
+    if (key == "timing_recovery") {
+      out.timingRecovery = value.as<std::string>();
+      if (out.timingRecovery != "interpolator" && out.timingRecovery != "polyphase") {
+        throw std::invalid_argument("Expected 'timing_recovery' to be \"interpolator\" or \"polyphase\"");
+      }
+      continue;
+    }
+
+    if (key == "fused") {
+      out.fused = value.as<bool>();
+      continue;
+    }
+
+    if (key == "kernels") {
+      out.kernels = loadKernels(value);
+      continue;
+    }
+
+    if (key == "autotune_file") {
+      out.autotuneFile = value.as<std::string>();
+      continue;
+    }
+
     throwInvalidKey(key);
   }
 }
@@ -154,6 +382,14 @@ void loadAirspySource(Config::Airspy& out, const toml::Value& v) {
       continue;
     }
 
+    if (key == "sample_type") {
+      out.sampleType = value.as<std::string>();
+      if (out.sampleType != "float32_iq" && out.sampleType != "int16_real") {
+        throw std::invalid_argument("Expected 'sample_type' to be \"float32_iq\" or \"int16_real\"");
+      }
+      continue;
+    }
+
     throwInvalidKey(key);
   }
 }
@@ -194,10 +430,77 @@ void loadRTLSDRSource(Config::RTLSDR& out, const toml::Value& v) {
       continue;
     }
 
+    if (key == "block_size") {
+      out.blockSize = value.as<int>();
+      if (out.blockSize == 0 || (out.blockSize % 256) != 0) {
+        throw std::invalid_argument("Expected 'block_size' to be a multiple of 256");
+      }
+      continue;
+    }
+
     throwInvalidKey(key);
   }
 }
 
+void loadRTLTCPSource(Config::RTLTCP& out, const toml::Value& v) {
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key == "connect") {
+      out.connect = value.as<std::string>();
+      continue;
+    }
+
+    if (key == "frequency") {
+      out.frequency = value.as<int>();
+      continue;
+    }
+
+    if (key == "sample_rate") {
+      out.sampleRate = value.as<int>();
+      continue;
+    }
+
+    if (key == "gain") {
+      out.gain = value.as<int>();
+      continue;
+    }
+
+    if (key == "bias_tee") {
+      out.bias_tee = value.as<bool>();
+      continue;
+    }
+
+    if (key == "receive_buffer") {
+      out.receiveBuffer = value.as<int>();
+      continue;
+    }
+
+    if (key == "block_size") {
+      out.blockSize = value.as<int>();
+      if (out.blockSize == 0 || (out.blockSize % 4) != 0) {
+        throw std::invalid_argument("Expected 'block_size' to be a multiple of 4");
+      }
+      continue;
+    }
+
+    if (key == "sample_publisher") {
+      out.samplePublisher = createSamplePublisher(value);
+      continue;
+    }
+
+    throwInvalidKey(key);
+  }
+
+  if (out.connect.empty()) {
+    std::stringstream ss;
+    ss << "Key not set: connect";
+    throw std::invalid_argument(ss.str());
+  }
+}
+
 void loadNanomsgSource(Config::Nanomsg& out, const toml::Value& v) {
   const auto& table = v.as<toml::Table>();
   for (const auto& it : table) {
@@ -234,6 +537,106 @@ void loadNanomsgSource(Config::Nanomsg& out, const toml::Value& v) {
   }
 }
 
+void loadFileSource(Config::File& out, const toml::Value& v) {
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key == "path") {
+      out.path = value.as<std::string>();
+      continue;
+    }
+
+    if (key == "format") {
+      out.format = value.as<std::string>();
+      if (out.format != "cu8" &&
+          out.format != "cs8" &&
+          out.format != "cs16" &&
+          out.format != "cf32") {
+        throw std::invalid_argument(
+          "Expected 'format' to be \"cu8\", \"cs8\", \"cs16\", or \"cf32\"");
+      }
+      continue;
+    }
+
+    if (key == "sample_rate") {
+      out.sampleRate = value.as<int>();
+      continue;
+    }
+
+    if (key == "throttle") {
+      out.throttle = value.as<bool>();
+      continue;
+    }
+
+    if (key == "block_size") {
+      out.blockSize = value.as<int>();
+      if (out.blockSize == 0 || (out.blockSize % 4) != 0) {
+        throw std::invalid_argument("Expected 'block_size' to be a multiple of 4");
+      }
+      continue;
+    }
+
+    if (key == "chunk_duration") {
+      out.chunkDuration = value.as<double>();
+      if (out.chunkDuration <= 0) {
+        throw std::invalid_argument("Expected 'chunk_duration' to be positive");
+      }
+      continue;
+    }
+
+    if (key == "chunk_overlap") {
+      out.chunkOverlap = value.as<double>();
+      if (out.chunkOverlap < 0) {
+        throw std::invalid_argument("Expected 'chunk_overlap' to be non-negative");
+      }
+      continue;
+    }
+
+    if (key == "sample_publisher") {
+      out.samplePublisher = createSamplePublisher(value);
+      continue;
+    }
+
+    throwInvalidKey(key);
+  }
+
+  if (out.path.empty()) {
+    std::stringstream ss;
+    ss << "Key not set: path";
+    throw std::invalid_argument(ss.str());
+  }
+}
+
+void loadFrontEnd(Config::FrontEnd& out, const toml::Value& v) {
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key == "frequency_offset") {
+      out.frequencyOffset = value.as<double>();
+      continue;
+    }
+
+    if (key == "decimation") {
+      out.decimation = value.as<int>();
+      if (out.decimation <= 0 || (out.decimation & (out.decimation - 1)) != 0) {
+        throw std::invalid_argument("Expected 'decimation' to be a power of 2");
+      }
+      continue;
+    }
+
+    if (key == "sample_publisher") {
+      out.samplePublisher = createSamplePublisher(value);
+      continue;
+    }
+
+    throwInvalidKey(key);
+  }
+}
+
 void loadAGC(Config::AGC& out, const toml::Value& v) {
   const auto& table = v.as<toml::Table>();
   for (const auto& it : table) {
@@ -273,6 +676,19 @@ void loadCostas(Config::Costas& out, const toml::Value& v) {
       continue;
     }
 
+    if (key == "oscillator") {
+      out.oscillator = value.as<std::string>();
+      if (out.oscillator != "sincos" && out.oscillator != "nco") {
+        throw std::invalid_argument("Expected 'oscillator' to be \"sincos\" or \"nco\"");
+      }
+      continue;
+    }
+
+    if (key == "acquisition") {
+      out.acquisition = value.as<bool>();
+      continue;
+    }
+
     if (key == "sample_publisher") {
       out.samplePublisher = createSamplePublisher(value);
       continue;
@@ -347,6 +763,157 @@ void loadDecoder(Config::Decoder& out, const toml::Value& v) {
   }
 }
 
+void loadChannelizer(Config::Channelizer& out, const toml::Value& v) {
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key == "channels") {
+      out.channels = value.as<int>();
+      if (out.channels < 1 || (out.channels & (out.channels - 1)) != 0) {
+        throw std::invalid_argument(
+          "Expected 'channels' to be a power of 2");
+      }
+      continue;
+    }
+
+    throwInvalidKey(key);
+  }
+}
+
+void loadCombiner(Config::Combiner& out, const toml::Value& v) {
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key == "connect") {
+      for (const auto& endpoint : value.as<toml::Array>()) {
+        out.connect.push_back(endpoint.as<std::string>());
+      }
+      continue;
+    }
+
+    if (key == "max_delay") {
+      out.maxDelay = value.as<int>();
+      continue;
+    }
+
+    if (key == "receive_buffer") {
+      out.receiveBuffer = value.as<int>();
+      continue;
+    }
+
+    throwInvalidKey(key);
+  }
+
+  if (out.connect.size() < 2) {
+    throw std::invalid_argument(
+      "Expected 'connect' to list at least 2 soft bit publishers");
+  }
+}
+
+void loadSpectrum(Config::Spectrum& out, const toml::Value& v) {
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key == "tap") {
+      out.tap = value.as<std::string>();
+      if (out.tap != "source" && out.tap != "agc") {
+        throw std::invalid_argument(
+          "Expected 'tap' to be \"source\" or \"agc\"");
+      }
+      continue;
+    }
+
+    if (key == "size") {
+      out.size = value.as<int>();
+      if (out.size < 16 || out.size > 65536 || (out.size & (out.size - 1)) != 0) {
+        throw std::invalid_argument(
+          "Expected 'size' to be a power of 2 (16 to 65536)");
+      }
+      continue;
+    }
+
+    if (key == "window") {
+      out.window = value.as<std::string>();
+      if (out.window != "rectangular" &&
+          out.window != "hann" &&
+          out.window != "blackman") {
+        throw std::invalid_argument(
+          "Expected 'window' to be \"rectangular\", \"hann\", or \"blackman\"");
+      }
+      continue;
+    }
+
+    if (key == "interval") {
+      out.interval = value.as<int>();
+      if (out.interval <= 0) {
+        throwInvalidKey(key);
+      }
+      continue;
+    }
+
+    if (key == "publisher") {
+      out.publisher = createSpectrumPublisher(value);
+      continue;
+    }
+
+    throwInvalidKey(key);
+  }
+}
+
+Config::Downlink loadDownlink(const toml::Value& v) {
+  Config::Downlink out;
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key == "mode") {
+      out.downlinkType = value.as<std::string>();
+      if (out.downlinkType != "lrit" && out.downlinkType != "hrit") {
+        throw std::invalid_argument(
+          "Expected downlink 'mode' to be \"lrit\" or \"hrit\"");
+      }
+      continue;
+    }
+
+    if (key == "frequency_offset") {
+      out.frequencyOffset = value.as<double>();
+      continue;
+    }
+
+    if (key == "packet_publisher") {
+      out.packetPublisher = createPacketPublisher(value);
+      continue;
+    }
+
+    if (key == "demodulator_stats_publisher") {
+      out.demodulatorStatsPublisher = createStatsPublisher(value);
+      continue;
+    }
+
+    if (key == "decoder_stats_publisher") {
+      out.decoderStatsPublisher = createStatsPublisher(value);
+      continue;
+    }
+
+    throwInvalidKey(key);
+  }
+
+  if (out.downlinkType.empty()) {
+    std::stringstream ss;
+    ss << "Key not set: mode";
+    throw std::invalid_argument(ss.str());
+  }
+
+  return out;
+}
+
 void loadMonitor(Config::Monitor& out, const toml::Value& v) {
   const auto& table = v.as<toml::Table>();
   for (const auto& it : table) {
@@ -362,6 +929,126 @@ void loadMonitor(Config::Monitor& out, const toml::Value& v) {
   }
 }
 
+// Loads the settings of a thread role into the map. The demodulator
+// role can hold the settings of its pipeline threads, keyed by the
+// first stage of the thread.
+void loadThread(
+    std::map<std::string, Config::Thread>& out,
+    const std::string& role,
+    const toml::Value& v) {
+  Config::Thread thread;
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key == "cpus") {
+      const long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+      for (const auto& cpu : value.as<toml::Array>()) {
+        const auto n = cpu.as<int>();
+        if (n < 0 || n >= ncpus) {
+          std::stringstream ss;
+          ss << "Expected 'cpus' of threads." << role
+             << " to be between 0 and " << (ncpus - 1);
+          throw std::invalid_argument(ss.str());
+        }
+        thread.cpus.push_back(n);
+      }
+      continue;
+    }
+
+    if (key == "policy") {
+      thread.policy = value.as<std::string>();
+      if (thread.policy != "other" &&
+          thread.policy != "fifo" &&
+          thread.policy != "rr") {
+        throw std::invalid_argument(
+          "Expected 'policy' to be \"other\", \"fifo\", or \"rr\"");
+      }
+      continue;
+    }
+
+    if (key == "priority") {
+      thread.priority = value.as<int>();
+      continue;
+    }
+
+    if (key == "nice") {
+      thread.nice = value.as<int>();
+      if (thread.nice < -20 || thread.nice > 19) {
+        throw std::invalid_argument(
+          "Expected 'nice' to be between -20 and 19");
+      }
+      continue;
+    }
+
+    if (role == "demodulator" &&
+        (key == "frontend" ||
+         key == "agc" ||
+         key == "agc_costas_rrc" ||
+         key == "costas" ||
+         key == "rrc" ||
+         key == "clock_recovery" ||
+         key == "quantization")) {
+      loadThread(out, role + "." + key, value);
+      continue;
+    }
+
+    throwInvalidKey(key);
+  }
+
+  // Real-time priorities only apply to the real-time policies, and
+  // nice levels only to the time sharing policy
+  if (thread.policy == "other") {
+    if (thread.priority != 0) {
+      std::stringstream ss;
+      ss << "Expected 'priority' of threads." << role
+         << " to be used with policy \"fifo\" or \"rr\"";
+      throw std::invalid_argument(ss.str());
+    }
+  } else {
+    const auto policy = (thread.policy == "fifo") ? SCHED_FIFO : SCHED_RR;
+    const auto min = sched_get_priority_min(policy);
+    const auto max = sched_get_priority_max(policy);
+    if (thread.priority < min || thread.priority > max) {
+      std::stringstream ss;
+      ss << "Expected 'priority' of threads." << role
+         << " to be between " << min << " and " << max;
+      throw std::invalid_argument(ss.str());
+    }
+    if (thread.nice != 0) {
+      std::stringstream ss;
+      ss << "Expected 'nice' of threads." << role
+         << " to be used with policy \"other\"";
+      throw std::invalid_argument(ss.str());
+    }
+  }
+
+  out[role] = std::move(thread);
+}
+
+void loadThreads(
+    std::map<std::string, Config::Thread>& out,
+    const toml::Value& v) {
+  const auto& table = v.as<toml::Table>();
+  for (const auto& it : table) {
+    const auto& key = it.first;
+    const auto& value = it.second;
+
+    if (key != "source" &&
+        key != "demodulator" &&
+        key != "decoder" &&
+        key != "monitor" &&
+        key != "channelizer" &&
+        key != "combiner" &&
+        key != "spectrum") {
+      throwInvalidKey(key);
+    }
+
+    loadThread(out, key, value);
+  }
+}
+
 } // namespace
 
 Config Config::load(const std::string& file) {
@@ -392,11 +1079,26 @@ Config Config::load(const std::string& file) {
       continue;
     }
 
+    if (key == "rtltcp") {
+      loadRTLTCPSource(out.rtltcp, value);
+      continue;
+    }
+
     if (key == "nanomsg") {
       loadNanomsgSource(out.nanomsg, value);
       continue;
     }
 
+    if (key == "file") {
+      loadFileSource(out.file, value);
+      continue;
+    }
+
+    if (key == "frontend") {
+      loadFrontEnd(out.frontend, value);
+      continue;
+    }
+
     if (key == "agc") {
       loadAGC(out.agc, value);
       continue;
@@ -427,29 +1129,51 @@ Config Config::load(const std::string& file) {
       continue;
     }
 
+    if (key == "channelizer") {
+      loadChannelizer(out.channelizer, value);
+      continue;
+    }
+
+    if (key == "downlink") {
+      for (const auto& downlink : value.as<toml::Array>()) {
+        out.downlinks.push_back(loadDownlink(downlink));
+      }
+      continue;
+    }
+
+    if (key == "combiner") {
+      loadCombiner(out.combiner, value);
+      continue;
+    }
+
+    if (key == "spectrum") {
+      loadSpectrum(out.spectrum, value);
+      continue;
+    }
+
     if (key == "monitor") {
       loadMonitor(out.monitor, value);
       continue;
     }
 
+    if (key == "threads") {
+      loadThreads(out.threads, value);
+      continue;
+    }
+
     throwInvalidKey(key);
   }
 
-  const auto demodulatorStatsEndpoint = "inproc://demodulator_stats";
-  const auto decoderStatsEndpoint = "inproc://decoder_stats";
-
-  // Add inproc endpoints for the stats publishers
-  out.demodulator.statsPublisher.bind.push_back(demodulatorStatsEndpoint);
-  out.decoder.statsPublisher.bind.push_back(decoderStatsEndpoint);
-
   // If the mode field is used, we can populate sane defaults
   if (out.demodulator.downlinkType == "lrit") {
     setIfZero(out.airspy.frequency, 1691000000u);
     setIfZero(out.rtlsdr.frequency, 1691000000u);
+    setIfZero(out.rtltcp.frequency, 1691000000u);
   }
   if (out.demodulator.downlinkType == "hrit") {
     setIfZero(out.airspy.frequency, 1694100000u);
     setIfZero(out.rtlsdr.frequency, 1694100000u);
+    setIfZero(out.rtltcp.frequency, 1694100000u);
   }
 
   return out;
@@ -1,27 +1,34 @@
 #pragma once
 
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "packet_publisher.h"
 #include "sample_publisher.h"
+#include "simd.h"
 #include "soft_bit_publisher.h"
+#include "spectrum_publisher.h"
 
 struct Config {
   struct StatsPublisher {
-    // Addresses to bind to. This is a vector because we always add an
-    // inproc:// endpoint for the in-process monitoring code.
+    // Addresses to bind to
     std::vector<std::string> bind;
 
     // Optional send buffer size
     size_t sendBuffer = 0;
+
+    // Minimum time between messages in milliseconds (demodulator only;
+    // the decoder publishes stats for every packet)
+    int interval = 100;
   };
 
   struct Demodulator {
     // LRIT or HRIT
     std::string downlinkType;
 
-    // String "airspy" or "rtlsdr"
+    // String "airspy", "rtlsdr", "rtltcp", "nanomsg", or "file"
     std::string source;
 
     // Demodulator statistics (gain, frequency correction, etc.)
@@ -29,6 +36,68 @@ struct Config {
 
     // Signal decimation (applied at FIR stage)
     int decimation = 1;
+
+    // Decimate ahead of the AGC (see frontend.h and the [frontend]
+    // section). The decimation above is ignored if enabled.
+    bool frontend = false;
+
+    // Groups of DSP stages that each run on their own thread.
+    // Stage names are "frontend", "agc", "costas", "rrc",
+    // "clock_recovery", and "quantization". When empty, all stages
+    // run on a single thread.
+    std::vector<std::vector<std::string> > pipeline;
+
+    // Queue implementation between stages: "locking" or "spsc".
+    // The latter is lock-free and preallocates its buffers.
+    std::string queue = "locking";
+
+    // Number of buffers of every queue, named after the stage that
+    // writes to it. More buffers absorb longer hiccups of the stage
+    // reading from the queue, at the cost of latency while they fill.
+    struct QueueDepth {
+      int source = 4;
+      int frontend = 2;
+      int agc = 2;
+      int costas = 2;
+      int rrc = 2;
+      int clockRecovery = 2;
+      int quantization = 2;
+    };
+
+    QueueDepth queueDepth;
+
+    // Target latency from the antenna to the soft bits in
+    // milliseconds. Sources whose block size is not configured (see
+    // the block size of the rtlsdr, rtltcp, and file sources) then use
+    // blocks of half this duration. By default, the sources use large
+    // blocks, which minimizes the overhead per block.
+    double latency = 0;
+
+    // What the source does when the demodulator falls behind and
+    // the source queue is full: "block", "drop_newest", or
+    // "drop_oldest" (see Source::Overflow).
+    std::string sourceOverflow = "block";
+
+    // Timing recovery: "interpolator" runs the RRC filter on every
+    // sample and interpolates symbols from its output. "polyphase"
+    // uses a polyphase matched filter that is evaluated once per
+    // symbol (see polyphase_clock_recovery.h), without an RRC stage.
+    std::string timingRecovery = "interpolator";
+
+    // Run AGC, Costas, and RRC as a single stage that processes small
+    // tiles of every block (see fused.h). Ignored if any of these
+    // stages has a sample publisher, or with polyphase timing recovery.
+    bool fused = false;
+
+    // Instruction set to use per kernel, keyed by kernel name ("source",
+    // "frontend", "agc", "costas", "rrc", "clock_recovery", or
+    // "quantization").
+    // Kernels that are not listed use the autotune result if there is
+    // one, or the best instruction set this CPU supports.
+    std::map<std::string, SIMD> kernels;
+
+    // File written by --autotune and read on startup
+    std::string autotuneFile;
   };
 
   Demodulator demodulator;
@@ -43,6 +112,10 @@ struct Config {
     // Enable/disable bias tee
     bool bias_tee = 0;
 
+    // Sample type requested from libairspy: "float32_iq" (converted
+    // by libairspy) or "int16_real" (raw, converted by goesrecv)
+    std::string sampleType = "float32_iq";
+
     std::unique_ptr<SamplePublisher> samplePublisher;
  };
 
@@ -61,11 +134,40 @@ struct Config {
     // Optional device index (if you have multiple devices)
     uint32_t deviceIndex = 0;
 
+    // Number of samples per USB transfer (0 for the default). Must be
+    // a multiple of 256. Taken from the autotune result, if any.
+    uint32_t blockSize = 0;
+
     std::unique_ptr<SamplePublisher> samplePublisher;
   };
 
   RTLSDR rtlsdr;
 
+  struct RTLTCP {
+    // Address of the rtl_tcp server ("host:port")
+    std::string connect;
+
+    uint32_t frequency = 0;
+    uint32_t sampleRate = 0;
+
+    // Applies to the tuner gain setting
+    uint8_t gain = 30;
+
+    // Enable/disable bias tee
+    bool bias_tee = 0;
+
+    // Optional receive buffer size
+    size_t receiveBuffer = 0;
+
+    // Number of samples per block (0 for the default). Must be a
+    // multiple of 4.
+    uint32_t blockSize = 0;
+
+    std::unique_ptr<SamplePublisher> samplePublisher;
+  };
+
+  RTLTCP rtltcp;
+
   struct Nanomsg {
     uint32_t sampleRate = 0;
 
@@ -80,6 +182,50 @@ struct Config {
 
   Nanomsg nanomsg;
 
+  struct File {
+    // Path to recording of raw I/Q samples
+    std::string path;
+
+    // Sample format: "cu8", "cs8", "cs16", or "cf32" (interleaved
+    // I/Q, native byte order). Taken from the SigMF metadata file
+    // next to the recording if not set.
+    std::string format;
+
+    // Taken from the SigMF metadata file if not set
+    uint32_t sampleRate = 0;
+
+    // Produce samples no faster than the sample rate. By default,
+    // samples are produced as fast as the demodulator consumes them.
+    bool throttle = false;
+
+    // Number of samples per block (0 for the default). Must be a
+    // multiple of 4.
+    uint32_t blockSize = 0;
+
+    // Batch mode (see batch.h) demodulates chunks of this many
+    // seconds in parallel. Every chunk starts with the final seconds
+    // of the previous one, for the loops to converge on.
+    double chunkDuration = 60.0;
+    double chunkOverlap = 2.0;
+
+    std::unique_ptr<SamplePublisher> samplePublisher;
+  };
+
+  File file;
+
+  struct FrontEnd {
+    // Offset of the signal from the tuned frequency in Hz
+    double frequencyOffset = 0.0;
+
+    // Power of 2 decimation factor (0 to derive it from the sample
+    // rate and symbol rate)
+    int decimation = 0;
+
+    std::unique_ptr<SamplePublisher> samplePublisher;
+  };
+
+  FrontEnd frontend;
+
   struct AGC {
     // Minimum gain
     float min = 1e-6f;
@@ -96,6 +242,13 @@ struct Config {
     // Maximum frequency deviation in Hz (defaults to 20 KHz)
     int maxDeviation = 20000;
 
+    // Oscillator implementation: "sincos" or "nco" (see costas.h)
+    std::string oscillator = "sincos";
+
+    // Seed the loop with an FFT based frequency estimate until the
+    // decoder reports packets (see acquisition.h)
+    bool acquisition = false;
+
     std::unique_ptr<SamplePublisher> samplePublisher;
   };
 
@@ -128,6 +281,73 @@ struct Config {
 
   Decoder decoder;
 
+  struct Channelizer {
+    // Number of channels (a power of 2; 1 for no filter bank).
+    // Defaults to 1 with fewer than 5 downlinks, where a front end
+    // per downlink is cheaper, and to the largest number for which
+    // every downlink fits the passband of the channel nearest to it
+    // otherwise.
+    int channels = 0;
+  };
+
+  Channelizer channelizer;
+
+  // Downlinks received in addition to the one configured by the
+  // sections above. If there are any, all downlinks are received from
+  // the same source through the channelizer, each with its own
+  // demodulator and decoder (see receiver.h).
+  struct Downlink {
+    // "lrit" or "hrit"
+    std::string downlinkType;
+
+    // Offset of the downlink from the tuned frequency in Hz
+    double frequencyOffset = 0;
+
+    std::unique_ptr<PacketPublisher> packetPublisher;
+
+    // Not published unless configured
+    StatsPublisher demodulatorStatsPublisher;
+    StatsPublisher decoderStatsPublisher;
+  };
+
+  std::vector<Downlink> downlinks;
+
+  // Soft bits of the same downlink from other receivers, to combine
+  // and decode instead of demodulating a source (see combiner.h).
+  struct Combiner {
+    // Addresses of the soft bit publishers to connect to
+    std::vector<std::string> connect;
+
+    // Time to wait for a frame from every receiver in milliseconds
+    int maxDelay = 500;
+
+    // Optional receive buffer size
+    size_t receiveBuffer = 0;
+  };
+
+  Combiner combiner;
+
+  // Averaged power spectrum of the source or AGC output, for remote
+  // monitoring without streaming samples (see spectrum.h). Only
+  // computed if the publisher is configured.
+  struct Spectrum {
+    // Samples to compute the spectrum of ("source" or "agc")
+    std::string tap = "source";
+
+    // FFT size (a power of 2)
+    int size = 1024;
+
+    // "rectangular", "hann", or "blackman"
+    std::string window = "hann";
+
+    // Averaging interval in milliseconds (one frame per interval)
+    int interval = 1000;
+
+    std::unique_ptr<SpectrumPublisher> publisher;
+  };
+
+  Spectrum spectrum;
+
   struct Monitor {
     // Address to send UDP statsd packets to (e.g. localhost:8125)
     std::string statsdAddress;
@@ -135,5 +355,26 @@ struct Config {
 
   Monitor monitor;
 
+  // CPU affinity and scheduling of a thread (see scheduling.h)
+  struct Thread {
+    // CPUs the thread may run on (any if empty)
+    std::vector<int> cpus;
+
+    // "other" (the default time sharing policy), "fifo", or "rr"
+    std::string policy = "other";
+
+    // Real-time priority for "fifo" and "rr" (1-99 on Linux)
+    int priority = 0;
+
+    // Nice level for "other" (-20 to 19; 0 leaves it alone)
+    int nice = 0;
+  };
+
+  // Keyed by thread role: "source", "demodulator", "decoder",
+  // "monitor", "channelizer", "combiner", or "spectrum". Threads that
+  // run part of the demodulator pipeline use the settings keyed by
+  // "demodulator.<first stage of the thread>", if there are any.
+  std::map<std::string, Thread> threads;
+
   static Config load(const std::string& file);
 };
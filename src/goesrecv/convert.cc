@@ -0,0 +1,473 @@
+#include "convert.h"
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Number to subtract from samples for normalization
+// See http://cgit.osmocom.org/gr-osmosdr/tree/lib/rtl/rtl_source_c.cc#n176
+constexpr float u8Norm = 127.4f / 128.0f;
+
+// Every byte maps to a single float, so the scalar conversions can
+// look up both components of a sample instead of computing them.
+struct Tables {
+  Tables() {
+    for (int i = 0; i < 256; i++) {
+      u8[i] = (i / 128.0f) - u8Norm;
+      s8[i] = (float) (int8_t) i / 127.0f;
+    }
+  }
+
+  float u8[256];
+  float s8[256];
+};
+
+const Tables& tables() {
+  static const Tables tables;
+  return tables;
+}
+
+void convertU8Scalar(
+    size_t nsamples,
+    const uint8_t* buf,
+    std::complex<float>* co) {
+  const float* lut = tables().u8;
+  float* fo = (float*) co;
+  for (size_t i = 0; i < nsamples * 2; i++) {
+    fo[i] = lut[buf[i]];
+  }
+}
+
+void convertS8Scalar(
+    size_t nsamples,
+    const int8_t* buf,
+    std::complex<float>* co) {
+  const float* lut = tables().s8;
+  float* fo = (float*) co;
+  for (size_t i = 0; i < nsamples * 2; i++) {
+    fo[i] = lut[(uint8_t) buf[i]];
+  }
+}
+
+void convertS16Scalar(
+    size_t nsamples,
+    const int16_t* buf,
+    std::complex<float>* co) {
+  float* fo = (float*) co;
+  for (size_t i = 0; i < nsamples * 2; i++) {
+    fo[i] = buf[i] * (1.0f / 32768.0f);
+  }
+}
+
+#ifdef __ARM_NEON
+
+// The I/Q bytes are in the same order as the real/imaginary parts
+// of the output, so they are widened in place (no deinterleaving).
+
+void convertU8NEON(
+    size_t nsamples,
+    const uint8_t* buf,
+    std::complex<float>* co) {
+  const float32x4_t norm = vdupq_n_f32(u8Norm);
+  float* fo = (float*) co;
+
+  // Process 8 samples (16 bytes) at a time
+  size_t i = 0;
+  for (; i + 8 <= nsamples; i += 8) {
+    uint8x16_t v = vld1q_u8(&buf[i * 2]);
+    uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+    uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+    uint32x4_t w[4] = {
+      vmovl_u16(vget_low_u16(lo)),
+      vmovl_u16(vget_high_u16(lo)),
+      vmovl_u16(vget_low_u16(hi)),
+      vmovl_u16(vget_high_u16(hi)),
+    };
+    for (size_t j = 0; j < 4; j++) {
+      // Convert to float and divide by 2^7 (128)
+      float32x4_t f = vcvtq_n_f32_u32(w[j], 7);
+      vst1q_f32(&fo[i * 2 + j * 4], vsubq_f32(f, norm));
+    }
+  }
+
+  // Remainder
+  convertU8Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+void convertS8NEON(
+    size_t nsamples,
+    const int8_t* buf,
+    std::complex<float>* co) {
+  const float32x4_t scale = vdupq_n_f32(1.0f / 127.0f);
+  float* fo = (float*) co;
+
+  // Process 8 samples (16 bytes) at a time
+  size_t i = 0;
+  for (; i + 8 <= nsamples; i += 8) {
+    int8x16_t v = vld1q_s8(&buf[i * 2]);
+    int16x8_t lo = vmovl_s8(vget_low_s8(v));
+    int16x8_t hi = vmovl_s8(vget_high_s8(v));
+    int32x4_t w[4] = {
+      vmovl_s16(vget_low_s16(lo)),
+      vmovl_s16(vget_high_s16(lo)),
+      vmovl_s16(vget_low_s16(hi)),
+      vmovl_s16(vget_high_s16(hi)),
+    };
+    for (size_t j = 0; j < 4; j++) {
+      float32x4_t f = vcvtq_f32_s32(w[j]);
+      vst1q_f32(&fo[i * 2 + j * 4], vmulq_f32(f, scale));
+    }
+  }
+
+  // Remainder
+  convertS8Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+void convertS16NEON(
+    size_t nsamples,
+    const int16_t* buf,
+    std::complex<float>* co) {
+  float* fo = (float*) co;
+
+  // Process 4 samples (8 values) at a time
+  size_t i = 0;
+  for (; i + 4 <= nsamples; i += 4) {
+    int16x8_t v = vld1q_s16(&buf[i * 2]);
+    vst1q_f32(&fo[i * 2 + 0], vcvtq_n_f32_s32(vmovl_s16(vget_low_s16(v)), 15));
+    vst1q_f32(&fo[i * 2 + 4], vcvtq_n_f32_s32(vmovl_s16(vget_high_s16(v)), 15));
+  }
+
+  // Remainder
+  convertS16Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+#endif
+
+#ifdef SIMD_X86
+
+// The I/Q bytes are in the same order as the real/imaginary parts
+// of the output, so the bytes can be widened in place without
+// shuffling them around.
+
+// SSE2 has no instructions to widen integers (pmovzx/pmovsx are
+// SSE4.1). Unsigned values are widened by interleaving them with zero.
+// Signed values are interleaved with themselves, which puts a copy in
+// the upper half of every wider lane, and shifted back down
+// arithmetically, which extends the sign.
+
+TARGET_SSE2
+void convertU8SSE2(
+    size_t nsamples,
+    const uint8_t* buf,
+    std::complex<float>* co) {
+  const __m128 scale = _mm_set1_ps(1.0f / 128.0f);
+  const __m128 norm = _mm_set1_ps(u8Norm);
+  const __m128i zero = _mm_setzero_si128();
+  float* fo = (float*) co;
+
+  // Process 8 samples (16 bytes) at a time
+  size_t i = 0;
+  for (; i + 8 <= nsamples; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &buf[i * 2]);
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    __m128i w[4] = {
+      _mm_unpacklo_epi16(lo, zero),
+      _mm_unpackhi_epi16(lo, zero),
+      _mm_unpacklo_epi16(hi, zero),
+      _mm_unpackhi_epi16(hi, zero),
+    };
+    for (size_t j = 0; j < 4; j++) {
+      __m128 f = _mm_cvtepi32_ps(w[j]);
+      f = _mm_sub_ps(_mm_mul_ps(f, scale), norm);
+      _mm_storeu_ps(&fo[i * 2 + j * 4], f);
+    }
+  }
+
+  // Remainder
+  convertU8Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+TARGET_SSE2
+void convertS8SSE2(
+    size_t nsamples,
+    const int8_t* buf,
+    std::complex<float>* co) {
+  const __m128 scale = _mm_set1_ps(1.0f / 127.0f);
+  float* fo = (float*) co;
+
+  // Process 8 samples (16 bytes) at a time
+  size_t i = 0;
+  for (; i + 8 <= nsamples; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &buf[i * 2]);
+    __m128i lo = _mm_unpacklo_epi8(v, v);
+    __m128i hi = _mm_unpackhi_epi8(v, v);
+    __m128i w[4] = {
+      _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 24),
+      _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 24),
+      _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 24),
+      _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 24),
+    };
+    for (size_t j = 0; j < 4; j++) {
+      __m128 f = _mm_cvtepi32_ps(w[j]);
+      _mm_storeu_ps(&fo[i * 2 + j * 4], _mm_mul_ps(f, scale));
+    }
+  }
+
+  // Remainder
+  convertS8Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+TARGET_SSE2
+void convertS16SSE2(
+    size_t nsamples,
+    const int16_t* buf,
+    std::complex<float>* co) {
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  float* fo = (float*) co;
+
+  // Process 4 samples (8 values) at a time
+  size_t i = 0;
+  for (; i + 4 <= nsamples; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &buf[i * 2]);
+    __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+    _mm_storeu_ps(&fo[i * 2 + 0], _mm_mul_ps(lo, scale));
+    _mm_storeu_ps(&fo[i * 2 + 4], _mm_mul_ps(hi, scale));
+  }
+
+  // Remainder
+  convertS16Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+TARGET_SSE41
+void convertU8SSE41(
+    size_t nsamples,
+    const uint8_t* buf,
+    std::complex<float>* co) {
+  const __m128 scale = _mm_set1_ps(1.0f / 128.0f);
+  const __m128 norm = _mm_set1_ps(u8Norm);
+  float* fo = (float*) co;
+
+  // Process 8 samples (16 bytes) at a time
+  size_t i = 0;
+  for (; i + 8 <= nsamples; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &buf[i * 2]);
+    for (size_t j = 0; j < 4; j++) {
+      __m128 f = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(v));
+      f = _mm_sub_ps(_mm_mul_ps(f, scale), norm);
+      _mm_storeu_ps(&fo[i * 2 + j * 4], f);
+      v = _mm_srli_si128(v, 4);
+    }
+  }
+
+  // Remainder
+  convertU8Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+TARGET_SSE41
+void convertS8SSE41(
+    size_t nsamples,
+    const int8_t* buf,
+    std::complex<float>* co) {
+  const __m128 scale = _mm_set1_ps(1.0f / 127.0f);
+  float* fo = (float*) co;
+
+  // Process 8 samples (16 bytes) at a time
+  size_t i = 0;
+  for (; i + 8 <= nsamples; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &buf[i * 2]);
+    for (size_t j = 0; j < 4; j++) {
+      __m128 f = _mm_cvtepi32_ps(_mm_cvtepi8_epi32(v));
+      _mm_storeu_ps(&fo[i * 2 + j * 4], _mm_mul_ps(f, scale));
+      v = _mm_srli_si128(v, 4);
+    }
+  }
+
+  // Remainder
+  convertS8Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+TARGET_AVX2
+void convertU8AVX2(
+    size_t nsamples,
+    const uint8_t* buf,
+    std::complex<float>* co) {
+  const __m256 scale = _mm256_set1_ps(1.0f / 128.0f);
+  const __m256 norm = _mm256_set1_ps(u8Norm);
+  float* fo = (float*) co;
+
+  // Process 16 samples (32 bytes) at a time
+  size_t i = 0;
+  for (; i + 16 <= nsamples; i += 16) {
+    for (size_t j = 0; j < 4; j++) {
+      __m128i v = _mm_loadl_epi64((const __m128i*) &buf[i * 2 + j * 8]);
+      __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v));
+      f = _mm256_fmsub_ps(f, scale, norm);
+      _mm256_storeu_ps(&fo[i * 2 + j * 8], f);
+    }
+  }
+
+  // Remainder
+  convertU8Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+TARGET_AVX2
+void convertS8AVX2(
+    size_t nsamples,
+    const int8_t* buf,
+    std::complex<float>* co) {
+  const __m256 scale = _mm256_set1_ps(1.0f / 127.0f);
+  float* fo = (float*) co;
+
+  // Process 16 samples (32 bytes) at a time
+  size_t i = 0;
+  for (; i + 16 <= nsamples; i += 16) {
+    for (size_t j = 0; j < 4; j++) {
+      __m128i v = _mm_loadl_epi64((const __m128i*) &buf[i * 2 + j * 8]);
+      __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(v));
+      _mm256_storeu_ps(&fo[i * 2 + j * 8], _mm256_mul_ps(f, scale));
+    }
+  }
+
+  // Remainder
+  convertS8Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+TARGET_SSE41
+void convertS16SSE41(
+    size_t nsamples,
+    const int16_t* buf,
+    std::complex<float>* co) {
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  float* fo = (float*) co;
+
+  // Process 4 samples (8 values) at a time
+  size_t i = 0;
+  for (; i + 4 <= nsamples; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &buf[i * 2]);
+    __m128 lo = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(v));
+    __m128 hi = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(v, 8)));
+    _mm_storeu_ps(&fo[i * 2 + 0], _mm_mul_ps(lo, scale));
+    _mm_storeu_ps(&fo[i * 2 + 4], _mm_mul_ps(hi, scale));
+  }
+
+  // Remainder
+  convertS16Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+TARGET_AVX2
+void convertS16AVX2(
+    size_t nsamples,
+    const int16_t* buf,
+    std::complex<float>* co) {
+  const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+  float* fo = (float*) co;
+
+  // Process 8 samples (16 values) at a time
+  size_t i = 0;
+  for (; i + 8 <= nsamples; i += 8) {
+    for (size_t j = 0; j < 2; j++) {
+      __m128i v = _mm_loadu_si128((const __m128i*) &buf[i * 2 + j * 8]);
+      __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v));
+      _mm256_storeu_ps(&fo[i * 2 + j * 8], _mm256_mul_ps(f, scale));
+    }
+  }
+
+  // Remainder
+  convertS16Scalar(nsamples - i, &buf[i * 2], &co[i]);
+}
+
+#endif
+
+} // namespace
+
+void convertU8(
+    SIMD simd,
+    size_t nsamples,
+    const uint8_t* in,
+    std::complex<float>* out) {
+  switch (simd) {
+#ifdef __ARM_NEON
+  case SIMD::NEON:
+    convertU8NEON(nsamples, in, out);
+    break;
+#endif
+#ifdef SIMD_X86
+  case SIMD::SSE2:
+    convertU8SSE2(nsamples, in, out);
+    break;
+  case SIMD::SSE41:
+    convertU8SSE41(nsamples, in, out);
+    break;
+  case SIMD::AVX2:
+    convertU8AVX2(nsamples, in, out);
+    break;
+#endif
+  default:
+    convertU8Scalar(nsamples, in, out);
+    break;
+  }
+}
+
+void convertS8(
+    SIMD simd,
+    size_t nsamples,
+    const int8_t* in,
+    std::complex<float>* out) {
+  switch (simd) {
+#ifdef __ARM_NEON
+  case SIMD::NEON:
+    convertS8NEON(nsamples, in, out);
+    break;
+#endif
+#ifdef SIMD_X86
+  case SIMD::SSE2:
+    convertS8SSE2(nsamples, in, out);
+    break;
+  case SIMD::SSE41:
+    convertS8SSE41(nsamples, in, out);
+    break;
+  case SIMD::AVX2:
+    convertS8AVX2(nsamples, in, out);
+    break;
+#endif
+  default:
+    convertS8Scalar(nsamples, in, out);
+    break;
+  }
+}
+
+void convertS16(
+    SIMD simd,
+    size_t nsamples,
+    const int16_t* in,
+    std::complex<float>* out) {
+  switch (simd) {
+#ifdef __ARM_NEON
+  case SIMD::NEON:
+    convertS16NEON(nsamples, in, out);
+    break;
+#endif
+#ifdef SIMD_X86
+  case SIMD::SSE2:
+    convertS16SSE2(nsamples, in, out);
+    break;
+  case SIMD::SSE41:
+    convertS16SSE41(nsamples, in, out);
+    break;
+  case SIMD::AVX2:
+    convertS16AVX2(nsamples, in, out);
+    break;
+#endif
+  default:
+    convertS16Scalar(nsamples, in, out);
+    break;
+  }
+}
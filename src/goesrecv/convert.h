@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <complex>
+
+#include "simd.h"
+
+// Converts interleaved unsigned 8 bit I/Q samples (as produced by
+// the RTL-SDR) to complex floats in [-1.0, 1.0].
+void convertU8(
+    SIMD simd,
+    size_t nsamples,
+    const uint8_t* in,
+    std::complex<float>* out);
+
+// Converts interleaved signed 8 bit I/Q samples to complex floats
+// in [-1.0, 1.0].
+void convertS8(
+    SIMD simd,
+    size_t nsamples,
+    const int8_t* in,
+    std::complex<float>* out);
+
+// Converts interleaved signed 16 bit I/Q samples (native byte order)
+// to complex floats in [-1.0, 1.0).
+void convertS16(
+    SIMD simd,
+    size_t nsamples,
+    const int16_t* in,
+    std::complex<float>* out);
@@ -8,24 +8,184 @@
 #include "./neon/neon_mathfun.h"
 #endif
 
+#ifdef SIMD_X86
+#include "./x86/sse_mathfun.h"
+#endif
+
 #define M_2PI (2 * M_PI)
 
+namespace {
+
+// Returns exp(-i * d). The Taylor polynomials are accurate to 4e-10
+// for |d| <= 0.25 and to 2e-9 for |d| <= 1. The shorter one covers
+// the frequency of the loop for any sensible maximum deviation.
+SIMD_INLINE
+void rotator(float d, float& re, float& im) {
+  const float d2 = d * d;
+  if (d2 <= 0.25f * 0.25f) {
+    re = 1.0f - d2 * (1.0f / 2 - d2 * (1.0f / 24 - d2 * (1.0f / 720)));
+    im = -d * (1.0f - d2 * (1.0f / 6 - d2 * (1.0f / 120 - d2 * (1.0f / 5040))));
+    return;
+  }
+
+  if (d2 <= 1.0f) {
+    re = 1.0f - d2 * (1.0f / 2 - d2 * (1.0f / 24 - d2 * (1.0f / 720 -
+      d2 * (1.0f / 40320 - d2 * (1.0f / 3628800)))));
+    im = -d * (1.0f - d2 * (1.0f / 6 - d2 * (1.0f / 120 - d2 * (1.0f / 5040 -
+      d2 * (1.0f / 362880 - d2 * (1.0f / 39916800))))));
+    return;
+  }
+
+  re = cosf(d);
+  im = -sinf(d);
+}
+
+// Returns the gain of the AGC for the group of 4 samples starting at
+// fi if it is fused with the loop (see Costas::process), or 1.
+SIMD_INLINE
+float groupGain(AGC* agc, const std::complex<float>* fi) {
+  if (!agc) {
+    return 1.0f;
+  }
+  const float re = fi->real();
+  const float im = fi->imag();
+  return agc->update(sqrtf(re * re + im * im));
+}
+
+} // namespace
+
 Costas::Costas() {
-  float damp = sqrtf(2.0f)/2.0f;
-  float bw = 0.005f;
   phase_ = 0.0f;
   freq_ = 0.0f;
+  phasorRe_ = 1.0f;
+  phasorIm_ = 0.0f;
+  acquiring_ = false;
+  setLoopBandwidth(0.005f);
+  maxDeviation_ = M_2PI;
+  reportedFreq_ = freq_;
+  simd_ = simdBest();
+  oscillator_ = Oscillator::SINCOS;
+}
+
+void Costas::setLoopBandwidth(float bw) {
+  bandwidth_ = bw;
+  setCoefficients(acquiring_ ? acquisitionGain * bw : bw);
+}
+
+void Costas::setCoefficients(float bw) {
+  float damp = sqrtf(2.0f)/2.0f;
   alpha_ = (4 * damp * bw) / (1.0 + 2.0 * damp * bw + bw * bw);
   beta_ = (4 * bw * bw) / (1.0 + 2.0 * damp * bw + bw * bw);
-  maxDeviation_ = M_2PI;
 }
 
-#ifdef __ARM_NEON
+void Costas::setSIMD(SIMD simd) {
+  ASSERT(simdSupported(simd));
+  simd_ = simd;
+}
 
 void Costas::work(
     size_t nsamples,
     std::complex<float>* fi,
-    std::complex<float>* fo) {
+    std::complex<float>* fo,
+    AGC* agc) {
+  if (oscillator_ == Oscillator::NCO) {
+    switch (simd_) {
+#ifdef SIMD_X86
+    case SIMD::SSE41:
+    case SIMD::AVX2:
+      // The loop is bound by the latency of the phasor recurrence,
+      // so the NCO doesn't benefit from wider registers.
+      workNCOSSE41(nsamples, fi, fo, agc);
+      break;
+#endif
+    default:
+      workNCOScalar(nsamples, fi, fo, agc);
+      break;
+    }
+    return;
+  }
+
+  switch (simd_) {
+#ifdef __ARM_NEON
+  case SIMD::NEON:
+    workNEON(nsamples, fi, fo, agc);
+    break;
+#endif
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+    workSSE41(nsamples, fi, fo, agc);
+    break;
+  case SIMD::AVX2:
+    workAVX2(nsamples, fi, fo, agc);
+    break;
+#endif
+  default:
+    workScalar(nsamples, fi, fo, agc);
+    break;
+  }
+}
+
+SIMD_INLINE
+float Costas::update(float terr) {
+  // Update frequency and phase
+  freq_ += beta_ * terr;
+  const float delta = alpha_ * terr + freq_;
+  phase_ += delta;
+
+  // Clamp frequency
+  freq_ = (0.5f * (fabsf(freq_ + maxDeviation_) -
+                   fabsf(freq_ - maxDeviation_)));
+
+  // Wrap phase if needed
+  if (phase_ > M_2PI || phase_ < -M_2PI) {
+    float frac = phase_ * (1.0 / M_2PI);
+    phase_ = (frac - (float)((int)frac)) * M_2PI;
+  }
+
+  return delta;
+}
+
+SIMD_INLINE
+void Costas::phasors(float* re, float* im) {
+  // The rotations are independent of each other, so they don't
+  // add to the latency of the loop like repeated multiplication.
+  re[0] = phasorRe_;
+  im[0] = phasorIm_;
+  for (size_t j = 1; j < 4; j++) {
+    float wr;
+    float wi;
+    rotator(j * freq_, wr, wi);
+    re[j] = phasorRe_ * wr - phasorIm_ * wi;
+    im[j] = phasorRe_ * wi + phasorIm_ * wr;
+  }
+}
+
+SIMD_INLINE
+void Costas::advance(float delta) {
+  // First order correction of the magnitude (1 / sqrt(x) ~ (3 - x) / 2).
+  // It drifts by a few roundings per update, so this keeps it at 1.
+  // It only depends on the current phasor, so it is computed while
+  // the phase error of the current samples is computed.
+  const float g = 0.5f * (3.0f - (phasorRe_ * phasorRe_ + phasorIm_ * phasorIm_));
+
+  float wr;
+  float wi;
+  rotator(delta, wr, wi);
+  wr *= g;
+  wi *= g;
+  float re = phasorRe_ * wr - phasorIm_ * wi;
+  float im = phasorRe_ * wi + phasorIm_ * wr;
+  phasorRe_ = re;
+  phasorIm_ = im;
+}
+
+#ifdef __ARM_NEON
+
+void Costas::workNEON(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo,
+    AGC* agc) {
   // Needed for clipping in loop body
   float pos1_ = +1.0f;
   float neg1_ = -1.0f;
@@ -50,6 +210,11 @@ void Costas::work(
     // Load 4 samples into 2 registers (in-phase and quadrature)
     float32x4x2_t f = vld2q_f32((const float32_t*) &fi[i]);
 
+    // Apply the gain, if any
+    const float g = groupGain(agc, &fi[i]);
+    f.val[0] = vmulq_n_f32(f.val[0], g);
+    f.val[1] = vmulq_n_f32(f.val[1], g);
+
     // Complex multiplication
     // (a + ib) * (c + id) expands to:
     // Real: (ac - bd)
@@ -74,28 +239,17 @@ void Costas::work(
     err = vmulq_f32(half, vsubq_f32(err_pos1, err_neg1));
     float terr = (err[0] + err[1] + err[2] + err[3]) / 4.0f;
 
-    // Update frequency and phase
-    freq_ += beta_ * terr;
-    phase_ += alpha_ * terr + freq_;
-
-    // Clamp frequency
-    freq_ = (0.5f * (fabsf(freq_ + maxDeviation_) -
-                     fabsf(freq_ - maxDeviation_)));
-
-    // Wrap phase if needed
-    if (phase_ > M_2PI || phase_ < -M_2PI) {
-      float frac = phase_ * (1.0 / M_2PI);
-      phase_ = (frac - (float)((int)frac)) * M_2PI;
-    }
+    update(terr);
   }
 }
 
-#else
+#endif
 
-void Costas::work(
+void Costas::workScalar(
     size_t nsamples,
     std::complex<float>* fi,
-    std::complex<float>* fo) {
+    std::complex<float>* fo,
+    AGC* agc) {
   for (size_t i = 0; i < nsamples; i += 4) {
     float phase[4] = {
       -(phase_ + 0 * freq_),
@@ -111,9 +265,10 @@ void Costas::work(
       sincos[j].imag(sinf(phase[j]));
     }
 
-    // Complex multiplication
+    // Complex multiplication (after the gain, if any)
+    const float g = groupGain(agc, &fi[i]);
     for (size_t j = 0; j < 4; j++) {
-      fo[i + j] = fi[i + j] * sincos[j];
+      fo[i + j] = (fi[i + j] * g) * sincos[j];
     }
 
     // Phase detector is executed for all samples,
@@ -125,31 +280,248 @@ void Costas::work(
       terr += (0.5f * (fabsf(err + 1.0f) - fabsf(err - 1.0f))) / 4.0f;
     }
 
-    // Update frequency and phase
-    freq_ += beta_ * terr;
-    phase_ += alpha_ * terr + freq_;
+    update(terr);
+  }
+}
 
-    // Clamp frequency
-    freq_ = (0.5f * (fabsf(freq_ + maxDeviation_) -
-                     fabsf(freq_ - maxDeviation_)));
+void Costas::workNCOScalar(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo,
+    AGC* agc) {
+  float re[4];
+  float im[4];
+  for (size_t i = 0; i < nsamples; i += 4) {
+    phasors(re, im);
+
+    // Complex multiplication (see NEON implementation)
+    const float g = groupGain(agc, &fi[i]);
+    for (size_t j = 0; j < 4; j++) {
+      const auto a = fi[i + j].real() * g;
+      const auto b = fi[i + j].imag() * g;
+      fo[i + j] = std::complex<float>(a * re[j] - b * im[j], a * im[j] + b * re[j]);
+    }
 
-    // Wrap phase if needed
-    if (phase_ > M_2PI || phase_ < -M_2PI) {
-      float frac = phase_ * (1.0 / M_2PI);
-      phase_ = (frac - (float)((int)frac)) * M_2PI;
+    // Phase detector is executed for all samples,
+    // Clip resulting value to [-1.0f, 1.0f].
+    // Total error is average of 4 errors.
+    float terr = 0.0f;
+    for (size_t j = 0; j < 4; j++) {
+      float err = fo[i + j].real() * fo[i + j].imag();
+      terr += (0.5f * (fabsf(err + 1.0f) - fabsf(err - 1.0f))) / 4.0f;
     }
+
+    advance(update(terr));
+  }
+}
+
+#ifdef SIMD_X86
+
+TARGET_SSE41
+void Costas::workSSE41(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo,
+    AGC* agc) {
+  const __m128 pos1 = _mm_set1_ps(+1.0f);
+  const __m128 neg1 = _mm_set1_ps(-1.0f);
+  const __m128 steps = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+  for (size_t i = 0; i < nsamples; i += 4) {
+    __m128 phase = _mm_sub_ps(
+      _mm_setzero_ps(),
+      _mm_add_ps(
+        _mm_set1_ps(phase_),
+        _mm_mul_ps(steps, _mm_set1_ps(freq_))));
+
+    // Compute sin/cos for phase offset
+    __m128 sin;
+    __m128 cos;
+    sincos_ps(phase, &sin, &cos);
+
+    // Load 4 samples and deinterleave into in-phase and quadrature
+    __m128 lo = _mm_loadu_ps((const float*) &fi[i + 0]);
+    __m128 hi = _mm_loadu_ps((const float*) &fi[i + 2]);
+    __m128 re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+
+    // Apply the gain, if any
+    const __m128 gain = _mm_set1_ps(groupGain(agc, &fi[i]));
+    re = _mm_mul_ps(re, gain);
+    im = _mm_mul_ps(im, gain);
+
+    // Complex multiplication (see NEON implementation)
+    __m128 ac = _mm_mul_ps(re, cos);
+    __m128 bd = _mm_mul_ps(im, sin);
+    __m128 ad = _mm_mul_ps(re, sin);
+    __m128 bc = _mm_mul_ps(im, cos);
+    re = _mm_sub_ps(ac, bd);
+    im = _mm_add_ps(ad, bc);
+
+    // Interleave and write 4 samples back to memory
+    _mm_storeu_ps((float*) &fo[i + 0], _mm_unpacklo_ps(re, im));
+    _mm_storeu_ps((float*) &fo[i + 2], _mm_unpackhi_ps(re, im));
+
+    // Phase detector is executed for all samples,
+    // Clip resulting value to [-1.0f, 1.0f].
+    // Total error is average of 4 errors.
+    __m128 err = _mm_mul_ps(re, im);
+    err = _mm_min_ps(_mm_max_ps(err, neg1), pos1);
+    err = _mm_add_ps(err, _mm_movehl_ps(err, err));
+    err = _mm_add_ss(err, _mm_shuffle_ps(err, err, _MM_SHUFFLE(1, 1, 1, 1)));
+    update(_mm_cvtss_f32(err) / 4.0f);
+  }
+}
+
+TARGET_AVX2
+void Costas::workAVX2(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo,
+    AGC* agc) {
+  const __m256 pos1 = _mm256_set1_ps(+1.0f);
+  const __m256 neg1 = _mm256_set1_ps(-1.0f);
+  const __m128 steps = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  const __m256i dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+
+  // Samples are kept interleaved; every 256 bit register holds
+  // 4 complex samples and the sin/cos values are duplicated
+  // to line up with both the real and imaginary parts.
+  for (size_t i = 0; i < nsamples; i += 4) {
+    __m128 phase = _mm_sub_ps(
+      _mm_setzero_ps(),
+      _mm_fmadd_ps(steps, _mm_set1_ps(freq_), _mm_set1_ps(phase_)));
+
+    // Compute sin/cos for phase offset
+    __m128 sin;
+    __m128 cos;
+    sincos_ps(phase, &sin, &cos);
+    __m256 sin2 = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(sin), dup);
+    __m256 cos2 = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(cos), dup);
+
+    // Complex multiplication
+    // Real: (ac - bd), imaginary: (bc + ad)
+    __m256 f = _mm256_mul_ps(
+      _mm256_loadu_ps((const float*) &fi[i]),
+      _mm256_set1_ps(groupGain(agc, &fi[i])));
+    __m256 fs = _mm256_permute_ps(f, _MM_SHUFFLE(2, 3, 0, 1));
+    f = _mm256_fmaddsub_ps(f, cos2, _mm256_mul_ps(fs, sin2));
+    _mm256_storeu_ps((float*) &fo[i], f);
+
+    // Phase detector is executed for all samples,
+    // Clip resulting value to [-1.0f, 1.0f].
+    // Every error is present twice, so total error is sum over 8.
+    __m256 err = _mm256_mul_ps(f, _mm256_permute_ps(f, _MM_SHUFFLE(2, 3, 0, 1)));
+    err = _mm256_min_ps(_mm256_max_ps(err, neg1), pos1);
+    __m128 acc = _mm_add_ps(
+      _mm256_castps256_ps128(err),
+      _mm256_extractf128_ps(err, 1));
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+    update(_mm_cvtss_f32(acc) / 8.0f);
+  }
+}
+
+TARGET_SSE41
+void Costas::workNCOSSE41(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo,
+    AGC* agc) {
+  const __m128 pos1 = _mm_set1_ps(+1.0f);
+  const __m128 neg1 = _mm_set1_ps(-1.0f);
+  alignas(16) float pr[4];
+  alignas(16) float pi[4];
+
+  for (size_t i = 0; i < nsamples; i += 4) {
+    phasors(pr, pi);
+    __m128 cos = _mm_load_ps(pr);
+    __m128 sin = _mm_load_ps(pi);
+
+    // Load 4 samples and deinterleave into in-phase and quadrature
+    __m128 lo = _mm_loadu_ps((const float*) &fi[i + 0]);
+    __m128 hi = _mm_loadu_ps((const float*) &fi[i + 2]);
+    __m128 re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+
+    // Apply the gain, if any
+    const __m128 gain = _mm_set1_ps(groupGain(agc, &fi[i]));
+    re = _mm_mul_ps(re, gain);
+    im = _mm_mul_ps(im, gain);
+
+    // Complex multiplication (see NEON implementation)
+    __m128 ac = _mm_mul_ps(re, cos);
+    __m128 bd = _mm_mul_ps(im, sin);
+    __m128 ad = _mm_mul_ps(re, sin);
+    __m128 bc = _mm_mul_ps(im, cos);
+    re = _mm_sub_ps(ac, bd);
+    im = _mm_add_ps(ad, bc);
+
+    // Interleave and write 4 samples back to memory
+    _mm_storeu_ps((float*) &fo[i + 0], _mm_unpacklo_ps(re, im));
+    _mm_storeu_ps((float*) &fo[i + 2], _mm_unpackhi_ps(re, im));
+
+    // Phase detector (see workSSE41)
+    __m128 err = _mm_mul_ps(re, im);
+    err = _mm_min_ps(_mm_max_ps(err, neg1), pos1);
+    err = _mm_add_ps(err, _mm_movehl_ps(err, err));
+    err = _mm_add_ss(err, _mm_shuffle_ps(err, err, _MM_SHUFFLE(1, 1, 1, 1)));
+    advance(update(_mm_cvtss_f32(err) / 4.0f));
   }
 }
 
 #endif
 
-void Costas::work(
+void Costas::setAcquisition(uint32_t sampleRate) {
+  // The loop advances its phase by freq_ once per 4 samples, so it
+  // tracks carriers up to a quarter of its frequency limit.
+  acquisition_ = std::make_unique<Acquisition>(sampleRate, maxDeviation_ / 4);
+}
+
+void Costas::acquire(size_t nsamples, const std::complex<float>* fi) {
+  float freq;
+  if (acquisition_->work(nsamples, fi, &freq)) {
+    freq_ = 4 * freq;
+  }
+
+  // Only recompute the coefficients when the state changes
+  const bool acquiring = acquisition_->isAcquiring();
+  if (acquiring != acquiring_) {
+    acquiring_ = acquiring;
+    setCoefficients(acquiring ? acquisitionGain * bandwidth_ : bandwidth_);
+  }
+}
+
+void Costas::process(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo,
+    AGC* agc) {
+  ASSERT((nsamples % 4) == 0);
+  if (acquisition_) {
+    // Acquisition needs the samples after the gain, so the AGC can't
+    // be fused; its output is derotated in place
+    if (agc) {
+      agc->process(nsamples, fi, fo);
+      fi = fo;
+      agc = nullptr;
+    }
+    acquire(nsamples, fi);
+  }
+  work(nsamples, fi, fo, agc);
+  if (agc) {
+    agc->report();
+  }
+  reportedFreq_.store(freq_, std::memory_order_relaxed);
+}
+
+size_t Costas::work(
     const std::shared_ptr<Queue<Samples> >& qin,
     const std::shared_ptr<Queue<Samples> >& qout) {
   auto input = qin->popForRead();
   if (!input) {
     qout->close();
-    return;
+    return 0;
   }
 
   auto output = qout->popForWrite();
@@ -162,7 +534,11 @@ void Costas::work(
   // Do actual work
   std::complex<float>* fi = input->data();
   std::complex<float>* fo = output->data();
-  work(nsamples, fi, fo);
+  if (acquisition_) {
+    acquire(nsamples, fi);
+  }
+  work(nsamples, fi, fo, nullptr);
+  reportedFreq_.store(freq_, std::memory_order_relaxed);
 
   // Return input buffer
   qin->pushRead(std::move(input));
@@ -174,4 +550,5 @@ void Costas::work(
 
   // Return output buffer
   qout->pushWrite(std::move(output));
+  return nsamples;
 }
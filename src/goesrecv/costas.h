@@ -1,43 +1,188 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 
+#include "acquisition.h"
+#include "agc.h"
 #include "sample_publisher.h"
+#include "simd.h"
 #include "types.h"
 
 class Costas {
 public:
+  // The oscillator produces the phasor that derotates every sample.
+  //
+  // SINCOS evaluates sin/cos of the loop phase for every sample.
+  //
+  // NCO keeps the phasor itself and advances it by recurrence.
+  // Per 4 samples it computes the sin/cos of two small angles (the
+  // frequency and the phase increment) with a polynomial, multiplies
+  // the phasor by them, and renormalizes it to unit magnitude.
+  //
+  // Phase error bounds of the NCO, relative to SINCOS:
+  //
+  //   - The polynomials are accurate to 2e-9 for angles up to 1 rad
+  //     per sample (0.16 times the sample rate), and to 4e-10 up to
+  //     0.25 rad. Larger angles fall back to sinf/cosf.
+  //   - Every update adds at most a few float roundings (~2e-7 rad)
+  //     of phase error, and the renormalization keeps the magnitude
+  //     within 1e-7 of 1.
+  //   - The phase error accumulates as a random walk. The loop sees it
+  //     as a frequency offset of less than 1e-7 rad per sample, which
+  //     it tracks with zero steady state phase error.
+  //
+  enum class Oscillator {
+    SINCOS,
+    NCO,
+  };
+
   explicit Costas();
 
+  // Set loop bandwidth in radians per sample (defaults to 0.005).
+  void setLoopBandwidth(float bw);
+
   // Set maximum frequency deviation in radians per sample.
   void setMaxDeviation(float maxDeviation) {
     maxDeviation_ = maxDeviation;
   }
 
+  void setOscillator(Oscillator oscillator) {
+    oscillator_ = oscillator;
+  }
+
+  Oscillator getOscillator() const {
+    return oscillator_;
+  }
+
+  // Select kernel implementation (defaults to best supported).
+  void setSIMD(SIMD simd);
+
+  SIMD getSIMD() const {
+    return simd_;
+  }
+
+  // Seed the loop frequency with coarse estimates while it hasn't
+  // locked (see Acquisition). Until it has, the loop bandwidth is
+  // widened by acquisitionGain. Set the maximum deviation first.
+  void setAcquisition(uint32_t sampleRate);
+
+  Acquisition* getAcquisition() const {
+    return acquisition_.get();
+  }
+
   void setSamplePublisher(std::unique_ptr<SamplePublisher> samplePublisher) {
     samplePublisher_ = std::move(samplePublisher);
   }
 
   // Returns frequency in radians per sample.
+  // Safe to call from any thread; updated once per block.
   float getFrequency() const {
-    return freq_;
+    return reportedFreq_.load(std::memory_order_relaxed);
   }
 
-  void work(
+  // Processes a single block of samples.
+  // Returns the number of samples consumed (0 if the input has closed).
+  size_t work(
       const std::shared_ptr<Queue<Samples> >& qin,
       const std::shared_ptr<Queue<Samples> >& qout);
 
+  // Processes samples that are not passed through a queue (see Fused).
+  // If an AGC is specified, its gain is applied to every group of 4
+  // samples as they are derotated, instead of in a pass of its own.
+  // The sample publisher is not called.
+  void process(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo,
+      AGC* agc = nullptr);
+
 protected:
+  // Factor the loop bandwidth is widened by while acquiring
+  static constexpr float acquisitionGain = 4.0f;
+
+  // Runs acquisition (if any) on a block of samples before the loop
+  // processes them.
+  void acquire(size_t nsamples, const std::complex<float>* fi);
+
+  // Computes the loop coefficients for a bandwidth.
+  void setCoefficients(float bw);
+
   void work(
       size_t nsamples,
       std::complex<float>* fi,
-      std::complex<float>* fo);
+      std::complex<float>* fo,
+      AGC* agc);
+
+  void workScalar(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo,
+      AGC* agc);
+
+#ifdef __ARM_NEON
+  void workNEON(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo,
+      AGC* agc);
+#endif
+
+#ifdef SIMD_X86
+  TARGET_SSE41 void workSSE41(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo,
+      AGC* agc);
+
+  TARGET_AVX2 void workAVX2(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo,
+      AGC* agc);
+#endif
+
+  void workNCOScalar(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo,
+      AGC* agc);
+
+#ifdef SIMD_X86
+  TARGET_SSE41 void workNCOSSE41(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo,
+      AGC* agc);
+#endif
+
+  // Update loop state with the average phase error of 4 samples.
+  // Returns the phase increment.
+  float update(float terr);
+
+  // Computes the derotating phasors for the next 4 samples.
+  void phasors(float* re, float* im);
+
+  // Advances the phasor by the phase increment (see update).
+  void advance(float delta);
+
+  SIMD simd_;
+  Oscillator oscillator_;
 
   float phase_;
   float freq_;
+
+  // Equal to exp(-i * phase_) when using the NCO
+  float phasorRe_;
+  float phasorIm_;
   float alpha_;
   float beta_;
+  float bandwidth_;
   float maxDeviation_;
+  std::atomic<float> reportedFreq_;
+
+  std::unique_ptr<Acquisition> acquisition_;
+  bool acquiring_;
 
   std::unique_ptr<SamplePublisher> samplePublisher_;
 };
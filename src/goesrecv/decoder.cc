@@ -6,6 +6,8 @@
 
 #include <util/time.h>
 
+#include "scheduling.h"
+
 using namespace util;
 
 namespace {
@@ -75,14 +77,24 @@ Decoder::Decoder(std::shared_ptr<Queue<std::vector<int8_t> > > queue) {
 
 void Decoder::initialize(Config& config) {
   packetPublisher_ = std::move(config.decoder.packetPublisher);
-  statsPublisher_ = StatsPublisher::create(config.decoder.statsPublisher.bind);
-  if (config.demodulator.statsPublisher.sendBuffer > 0) {
-    statsPublisher_->setSendBuffer(config.decoder.statsPublisher.sendBuffer);
+  if (!config.decoder.statsPublisher.bind.empty()) {
+    statsPublisher_ = StatsPublisher::create(config.decoder.statsPublisher.bind);
+    if (config.decoder.statsPublisher.sendBuffer > 0) {
+      statsPublisher_->setSendBuffer(config.decoder.statsPublisher.sendBuffer);
+    }
   }
 }
 
 void Decoder::publishStats(decoder::Packetizer::Details details) {
-  if (!statsPublisher_) {
+  stats_.packets.push({
+      details.skippedSymbols,
+      details.viterbiBits,
+      details.reedSolomonBytes,
+      details.ok,
+    });
+
+  // JSON is only written for subscribers
+  if (!statsPublisher_ || !statsPublisher_->hasSubscribers()) {
     return;
   }
 
@@ -99,16 +111,28 @@ void Decoder::publishStats(decoder::Packetizer::Details details) {
   statsPublisher_->publish(ss.str());
 }
 
+void Decoder::run(std::function<void(const std::array<uint8_t, 892>&)> fn) {
+  std::array<uint8_t, 892> buf;
+  decoder::Packetizer::Details details;
+  while (packetizer_->nextPacket(buf, &details)) {
+    if (details.ok) {
+      if (packetCallback_) {
+        packetCallback_();
+      }
+      fn(buf);
+    }
+    publishStats(details);
+  }
+}
+
 void Decoder::start() {
   thread_ = std::thread([&] {
-      std::array<uint8_t, 892> buf;
-      decoder::Packetizer::Details details;
-      while (packetizer_->nextPacket(buf, &details)) {
-        if (details.ok && packetPublisher_) {
-          packetPublisher_->publish(buf);
-        }
-        publishStats(details);
-      }
+      Scheduling::apply("decoder");
+      run([this] (const std::array<uint8_t, 892>& buf) {
+          if (packetPublisher_) {
+            packetPublisher_->publish(buf);
+          }
+        });
     });
 #ifdef __APPLE__
   pthread_setname_np("decoder");
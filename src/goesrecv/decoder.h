@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <functional>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -9,6 +11,7 @@
 #include "config.h"
 #include "packet_publisher.h"
 #include "queue.h"
+#include "stats.h"
 #include "stats_publisher.h"
 
 class Decoder {
@@ -20,11 +23,29 @@ public:
   void start();
   void stop();
 
+  // Decodes packets on the calling thread until the soft bits queue
+  // closes. Every packet that is decoded successfully is passed to
+  // the callback.
+  void run(std::function<void(const std::array<uint8_t, 892>&)> fn);
+
+  // Called for every packet that is decoded successfully, on the
+  // decoder thread (e.g. to tell the demodulator it has locked).
+  void setPacketCallback(std::function<void()> fn) {
+    packetCallback_ = std::move(fn);
+  }
+
+  // Stats for the in-process monitor
+  DecoderStats& getStats() {
+    return stats_;
+  }
+
 protected:
   void publishStats(decoder::Packetizer::Details details);
 
   std::unique_ptr<decoder::Packetizer> packetizer_;
   std::unique_ptr<PacketPublisher> packetPublisher_;
   std::unique_ptr<StatsPublisher> statsPublisher_;
+  DecoderStats stats_;
+  std::function<void()> packetCallback_;
   std::thread thread_;
 };
@@ -1,13 +1,130 @@
 #include "demodulator.h"
 
 #include <pthread.h>
+#include <time.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
 
 #include <util/error.h>
 #include <util/time.h>
 
+#include "autotune.h"
+#include "file_source.h"
+#include "polyphase_clock_recovery.h"
+#include "scheduling.h"
+#include "spectrum.h"
+#include "spsc_queue.h"
+
 using namespace util;
 
-Demodulator::Demodulator(Demodulator::Type t) {
+namespace {
+
+// Returns CPU time consumed by the calling thread in nanoseconds.
+// Time spent blocking on a queue does not count towards this.
+uint64_t threadTime() {
+  struct timespec ts;
+  auto rv = clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  ASSERT(rv == 0);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Every queue in the demodulator has a single producer thread (the
+// source or a pipeline thread) and a single consumer thread (the next
+// pipeline thread), so any of them can be the lock-free queue. The
+// locking queue remains the default: it allocates buffers only as they
+// are needed, and its threads sleep instead of polling an empty ring,
+// which costs CPU time on hosts where the threads share cores.
+template <class T>
+std::shared_ptr<Queue<T> > createQueue(const std::string& type, size_t capacity) {
+  if (type == "spsc") {
+    return std::make_shared<SPSCQueue<T> >(capacity);
+  }
+  return std::make_shared<LockingQueue<T> >(capacity);
+}
+
+// Returns the sample rate the configured source will run at,
+// without opening the device. See Source::build.
+uint32_t configuredSampleRate(const Config& config) {
+  const auto& type = config.demodulator.source;
+  if (type == "airspy") {
+    return config.airspy.sampleRate != 0 ? config.airspy.sampleRate : 2500000;
+  }
+  if (type == "rtlsdr") {
+    return config.rtlsdr.sampleRate != 0 ? config.rtlsdr.sampleRate : 2400000;
+  }
+  if (type == "rtltcp") {
+    return config.rtltcp.sampleRate != 0 ? config.rtltcp.sampleRate : 2400000;
+  }
+  if (type == "nanomsg") {
+    return config.nanomsg.sampleRate;
+  }
+  if (type == "file") {
+    return FileSource::open(config.file)->getSampleRate();
+  }
+  throw std::runtime_error("Invalid source: " + type);
+}
+
+// Returns the format of the samples the configured source converts,
+// for autotune to benchmark the same conversion. See Source::build.
+BenchmarkSource::Format configuredFormat(const Config& config) {
+  const auto& type = config.demodulator.source;
+  if (type == "airspy") {
+    return config.airspy.sampleType == "int16_real"
+      ? BenchmarkSource::Format::S16_REAL
+      : BenchmarkSource::Format::CF32;
+  }
+  if (type == "nanomsg") {
+    return BenchmarkSource::Format::CS8;
+  }
+  if (type == "file") {
+    switch (FileSource::open(config.file)->getFormat()) {
+    case FileSource::Format::CU8:
+      return BenchmarkSource::Format::CU8;
+    case FileSource::Format::CS8:
+      return BenchmarkSource::Format::CS8;
+    case FileSource::Format::CS16:
+      return BenchmarkSource::Format::CS16;
+    case FileSource::Format::CF32:
+      return BenchmarkSource::Format::CF32;
+    }
+  }
+  return BenchmarkSource::Format::CU8;
+}
+
+// Picks the instruction set for a kernel. Explicit configuration
+// takes precedence over the autotune result, which in turn takes
+// precedence over the best instruction set this CPU supports.
+SIMD selectKernel(
+    const std::string& name,
+    const Config& config,
+    const Tuning& tuning) {
+  auto it = config.demodulator.kernels.find(name);
+  if (it != config.demodulator.kernels.end()) {
+    if (!simdSupported(it->second)) {
+      std::stringstream ss;
+      ss << "You configured the \"" << name << "\" kernel to use "
+         << "instruction set \"" << simdName(it->second) << "\", "
+         << "but it is not supported by this CPU";
+      throw std::invalid_argument(ss.str());
+    }
+    return it->second;
+  }
+
+  // The autotune result may have been generated on another machine
+  it = tuning.kernels.find(name);
+  if (it != tuning.kernels.end() && simdSupported(it->second)) {
+    return it->second;
+  }
+
+  return simdBest();
+}
+
+} // namespace
+
+Demodulator::Demodulator(Demodulator::Type t) : type_(t) {
   switch (t) {
   case LRIT:
     symbolRate_ = 293883;
@@ -21,29 +138,96 @@ Demodulator::Demodulator(Demodulator::Type t) {
 
   // Sample rate depends on source
   sampleRate_ = 0;
+  trackingRate_ = 0;
+}
 
+void Demodulator::initialize(Config& config, std::unique_ptr<Source> source) {
   // Initialize queues
-  // It is possible to attach publishers before starting the demodulator
-  sourceQueue_ = std::make_shared<Queue<Samples> >(4);
-  agcQueue_ = std::make_shared<Queue<Samples> >(2);
-  costasQueue_ = std::make_shared<Queue<Samples> >(2);
-  rrcQueue_ = std::make_shared<Queue<Samples> >(2);
-  clockRecoveryQueue_ = std::make_shared<Queue<Samples> >(2);
-  softBitsQueue_ = std::make_shared<Queue<std::vector<int8_t> > >(2);
-}
+  const auto& type = config.demodulator.queue;
+  const auto& depth = config.demodulator.queueDepth;
+  sourceQueue_ = createQueue<Samples>(type, depth.source);
+  frontEndQueue_ = createQueue<Samples>(type, depth.frontend);
+  agcQueue_ = createQueue<Samples>(type, depth.agc);
+  costasQueue_ = createQueue<Samples>(type, depth.costas);
+  rrcQueue_ = createQueue<Samples>(type, depth.rrc);
+  clockRecoveryQueue_ = createQueue<Samples>(type, depth.clockRecovery);
+  softBitsQueue_ = createQueue<std::vector<int8_t> >(type, depth.quantization);
 
-void Demodulator::initialize(Config& config) {
-  source_ = Source::build(config.demodulator.source, config);
+  // Block size must be known before the source is opened. The target
+  // latency takes precedence over the autotune result.
+  Tuning tuning;
+  const auto& path = config.demodulator.autotuneFile;
+  if (!path.empty() && std::ifstream(path).good()) {
+    tuning = loadTuning(path);
+    if (config.rtlsdr.blockSize == 0 && config.demodulator.latency <= 0) {
+      config.rtlsdr.blockSize = tuning.blockSize;
+    }
+  }
+
+  if (source) {
+    source_ = std::move(source);
+  } else {
+    source_ = Source::build(config.demodulator.source, config);
+  }
   sampleRate_ = source_->getSampleRate();
 
-  statsPublisher_ = StatsPublisher::create(config.demodulator.statsPublisher.bind);
-  if (config.demodulator.statsPublisher.sendBuffer > 0) {
-    statsPublisher_->setSendBuffer(config.demodulator.statsPublisher.sendBuffer);
+  if (!config.demodulator.statsPublisher.bind.empty()) {
+    statsPublisher_ = StatsPublisher::create(config.demodulator.statsPublisher.bind);
+    if (config.demodulator.statsPublisher.sendBuffer > 0) {
+      statsPublisher_->setSendBuffer(config.demodulator.statsPublisher.sendBuffer);
+    }
+    statsPublishInterval_ =
+      std::chrono::milliseconds(config.demodulator.statsPublisher.interval);
+  }
+
+  const auto bandwidth = getBandwidth(config);
+
+  // The front end takes over decimation from the RRC filter
+  auto dc = config.demodulator.decimation;
+  trackingRate_ = sampleRate_;
+  if (config.demodulator.frontend) {
+    auto decimation = config.frontend.decimation;
+    if (decimation == 0) {
+      decimation = FrontEnd::decimation(sampleRate_, symbolRate_, bandwidth);
+    }
+    frontEnd_ = std::make_unique<FrontEnd>(
+      sampleRate_,
+      decimation,
+      config.frontend.frequencyOffset,
+      bandwidth);
+    frontEnd_->setSamplePublisher(std::move(config.frontend.samplePublisher));
+    trackingRate_ = sampleRate_ / decimation;
+    dc = 1;
   }
 
-  const auto dc = config.demodulator.decimation;
-  const auto sr1 = sampleRate_;
-  const auto sr2 = sampleRate_ / dc;
+  const auto sr1 = trackingRate_;
+  const auto sr2 = trackingRate_ / dc;
+
+  // Polyphase clock recovery does its own matched filtering
+  // at the full sample rate; there is no RRC stage.
+  polyphase_ = config.demodulator.timingRecovery == "polyphase";
+
+  // Computing the spectrum of the AGC output takes a sample publisher
+  const bool agcPublisher = !!config.agc.samplePublisher;
+  Spectrum::attach(config.agc.samplePublisher, config.spectrum, "agc", sr1);
+  const bool agcSpectrum = !agcPublisher && config.agc.samplePublisher;
+
+  // The fused stage doesn't produce the intermediate samples
+  // that the sample publishers of the separate stages publish.
+  const bool fused =
+    config.demodulator.fused &&
+    !polyphase_ &&
+    !config.agc.samplePublisher &&
+    !config.costas.samplePublisher &&
+    !config.rrc.samplePublisher;
+  if (config.demodulator.fused && !polyphase_ && agcSpectrum &&
+      !config.costas.samplePublisher &&
+      !config.rrc.samplePublisher) {
+    std::cerr
+      << "Not using the fused stage: "
+      << "the spectrum of the AGC output needs the separate AGC stage"
+      << std::endl;
+  }
 
   agc_ = std::make_unique<AGC>();
   agc_->setMin(config.agc.min);
@@ -52,70 +236,633 @@ void Demodulator::initialize(Config& config) {
 
   // Maximum frequency deviation in radians per sample (given in Hz)
   const auto maxDeviation =
-    (config.costas.maxDeviation * 2 * M_PI) / sampleRate_;
+    (config.costas.maxDeviation * 2 * M_PI) / trackingRate_;
   costas_ = std::make_unique<Costas>();
   costas_->setMaxDeviation(maxDeviation);
+  if (frontEnd_) {
+    // Keep the loop bandwidth in Hz, and therefore its pull-in time,
+    // the same as without decimation
+    costas_->setLoopBandwidth(0.005f * frontEnd_->getDecimation());
+  }
+  if (config.costas.oscillator == "nco") {
+    costas_->setOscillator(Costas::Oscillator::NCO);
+  }
+  if (config.costas.acquisition) {
+    costas_->setAcquisition(trackingRate_);
+  }
   costas_->setSamplePublisher(std::move(config.costas.samplePublisher));
 
   rrc_ = std::make_unique<RRC>(dc, sr1, symbolRate_);
   rrc_->setSamplePublisher(std::move(config.rrc.samplePublisher));
 
-  clockRecovery_ = std::make_unique<ClockRecovery>(sr2, symbolRate_);
+  if (polyphase_) {
+    clockRecovery_ = std::make_unique<PolyphaseClockRecovery>(sr1, symbolRate_);
+  } else {
+    clockRecovery_ = std::make_unique<ClockRecovery>(sr2, symbolRate_);
+  }
   clockRecovery_->setSamplePublisher(std::move(config.clockRecovery.samplePublisher));
 
   quantization_ = std::make_unique<Quantize>();
   quantization_->setSoftBitPublisher(std::move(config.quantization.softBitPublisher));
+
+  source_->setSIMD(selectKernel("source", config, tuning));
+  if (frontEnd_) {
+    frontEnd_->setSIMD(selectKernel("frontend", config, tuning));
+  }
+  agc_->setSIMD(selectKernel("agc", config, tuning));
+  costas_->setSIMD(selectKernel("costas", config, tuning));
+  rrc_->setSIMD(selectKernel("rrc", config, tuning));
+  clockRecovery_->setSIMD(selectKernel("clock_recovery", config, tuning));
+  quantization_->setSIMD(selectKernel("quantization", config, tuning));
+
+  if (fused) {
+    fused_ = std::make_unique<Fused>(*agc_, *costas_, *rrc_, dc);
+  }
+
+  initializePipeline(config.demodulator.pipeline);
 }
 
-void Demodulator::publishStats() {
-  if (!statsPublisher_) {
-    return;
+double Demodulator::getBandwidth(const Config& config) const {
+  // RRC roll-off is 0.5
+  return 0.75 * symbolRate_ + config.costas.maxDeviation;
+}
+
+void Demodulator::autotune(const Config& config, std::ostream& log) {
+  const auto& path = config.demodulator.autotuneFile;
+  if (path.empty()) {
+    throw std::invalid_argument(
+      "You must configure 'autotune_file' in the [demodulator] section "
+      "to store the autotune result");
+  }
+
+  const auto sampleRate = configuredSampleRate(config);
+  if (sampleRate == 0) {
+    throw std::invalid_argument(
+      "You must configure the sample rate of the source to autotune");
+  }
+
+  // The chain is a demodulator of its own, configured like this one,
+  // that runs all its stages on the calling thread. Config holds the
+  // publishers and can't be copied, so only the settings that affect
+  // the chain are copied; without publishers, nothing is published.
+  const auto format = configuredFormat(config);
+  auto chain = [&] (const std::map<std::string, SIMD>& kernels, uint32_t blockSize) {
+    Config chainConfig;
+    chainConfig.demodulator = config.demodulator;
+    chainConfig.demodulator.statsPublisher = Config::StatsPublisher();
+    chainConfig.demodulator.autotuneFile.clear();
+    chainConfig.demodulator.kernels = kernels;
+    chainConfig.frontend.frequencyOffset = config.frontend.frequencyOffset;
+    chainConfig.frontend.decimation = config.frontend.decimation;
+    chainConfig.agc.min = config.agc.min;
+    chainConfig.agc.max = config.agc.max;
+    chainConfig.costas.maxDeviation = config.costas.maxDeviation;
+    chainConfig.costas.oscillator = config.costas.oscillator;
+    chainConfig.costas.acquisition = config.costas.acquisition;
+
+    // Sample publishers of these stages disable the fused stage
+    if (config.agc.samplePublisher ||
+        config.costas.samplePublisher ||
+        config.rrc.samplePublisher) {
+      chainConfig.demodulator.fused = false;
+    }
+
+    auto source = std::make_unique<BenchmarkSource>(
+      format, sampleRate, symbolRate_, blockSize);
+    auto* benchmarkSource = source.get();
+    auto demod = std::make_shared<Demodulator>(type_);
+    demod->initialize(chainConfig, std::move(source));
+    return std::function<void()>([demod, benchmarkSource] {
+        benchmarkSource->produce(*demod->sourceQueue_);
+        for (auto& stage : demod->stages_) {
+          stage->work();
+        }
+        auto out = demod->softBitsQueue_->popForRead();
+        demod->softBitsQueue_->pushRead(std::move(out));
+      });
+  };
+
+  auto tuning = ::autotune(
+    sampleRate,
+    symbolRate_,
+    config.demodulator.decimation,
+    chain,
+    log);
+  saveTuning(path, tuning);
+  log << "Wrote autotune result to " << path << std::endl;
+}
+
+void Demodulator::initializePipeline(
+    const std::vector<std::vector<std::string> >& pipeline) {
+  // Input of the stage after the front end
+  auto* input = frontEnd_ ? frontEndQueue_.get() : sourceQueue_.get();
+
+  if (frontEnd_) {
+    stages_.push_back(std::make_unique<Stage>(
+      "frontend",
+      [this] { return frontEnd_->work(sourceQueue_, frontEndQueue_); },
+      [this] { return frontEndQueue_->closed(); },
+      sourceQueue_.get(),
+      frontEndQueue_.get()));
+  }
+  if (fused_) {
+    stages_.push_back(std::make_unique<Stage>(
+      "agc_costas_rrc",
+      [this] {
+        const auto& qin = frontEnd_ ? frontEndQueue_ : sourceQueue_;
+        return fused_->work(qin, rrcQueue_);
+      },
+      [this] { return rrcQueue_->closed(); },
+      input,
+      rrcQueue_.get()));
+  } else if (polyphase_) {
+    stages_.push_back(std::make_unique<Stage>(
+      "agc",
+      [this] {
+        const auto& qin = frontEnd_ ? frontEndQueue_ : sourceQueue_;
+        return agc_->work(qin, agcQueue_);
+      },
+      [this] { return agcQueue_->closed(); },
+      input,
+      agcQueue_.get()));
+    stages_.push_back(std::make_unique<Stage>(
+      "costas",
+      [this] { return costas_->work(agcQueue_, costasQueue_); },
+      [this] { return costasQueue_->closed(); },
+      agcQueue_.get(),
+      costasQueue_.get()));
+  } else {
+    stages_.push_back(std::make_unique<Stage>(
+      "agc",
+      [this] {
+        const auto& qin = frontEnd_ ? frontEndQueue_ : sourceQueue_;
+        return agc_->work(qin, agcQueue_);
+      },
+      [this] { return agcQueue_->closed(); },
+      input,
+      agcQueue_.get()));
+    stages_.push_back(std::make_unique<Stage>(
+      "costas",
+      [this] { return costas_->work(agcQueue_, costasQueue_); },
+      [this] { return costasQueue_->closed(); },
+      agcQueue_.get(),
+      costasQueue_.get()));
+    stages_.push_back(std::make_unique<Stage>(
+      "rrc",
+      [this] { return rrc_->work(costasQueue_, rrcQueue_); },
+      [this] { return rrcQueue_->closed(); },
+      costasQueue_.get(),
+      rrcQueue_.get()));
+  }
+  stages_.push_back(std::make_unique<Stage>(
+    "clock_recovery",
+    [this] {
+      const auto& qin = polyphase_ ? costasQueue_ : rrcQueue_;
+      return clockRecovery_->work(qin, clockRecoveryQueue_);
+    },
+    [this] { return clockRecoveryQueue_->closed(); },
+    polyphase_ ? costasQueue_.get() : rrcQueue_.get(),
+    clockRecoveryQueue_.get()));
+  stages_.push_back(std::make_unique<Stage>(
+    "quantization",
+    [this] { return quantization_->work(clockRecoveryQueue_, softBitsQueue_); },
+    [this] { return softBitsQueue_->closed(); },
+    clockRecoveryQueue_.get(),
+    softBitsQueue_.get()));
+
+  // Run everything on a single thread by default
+  if (pipeline.empty()) {
+    groups_.emplace_back();
+    for (auto& stage : stages_) {
+      groups_.back().push_back(stage.get());
+    }
+  } else {
+    // The fused stage takes the place of the stages it runs, which
+    // must therefore be listed consecutively in the same group.
+    auto groups = pipeline;
+    if (fused_) {
+      const std::vector<std::string> names = {"agc", "costas", "rrc"};
+      for (auto& group : groups) {
+        auto it = std::search(group.begin(), group.end(), names.begin(), names.end());
+        if (it != group.end()) {
+          it = group.erase(it, it + names.size());
+          group.insert(it, "agc_costas_rrc");
+        }
+      }
+    }
+
+    // The front end runs on the thread of the first stage after it,
+    // unless it is listed explicitly
+    if (frontEnd_) {
+      bool listed = false;
+      for (const auto& group : groups) {
+        listed |= std::find(group.begin(), group.end(), "frontend") != group.end();
+      }
+      if (!listed && !groups.empty()) {
+        groups.front().insert(groups.front().begin(), "frontend");
+      }
+    }
+
+    // Skip the RRC stage if the clock recovery does the filtering
+    if (polyphase_) {
+      for (auto& group : groups) {
+        group.erase(std::remove(group.begin(), group.end(), "rrc"), group.end());
+      }
+      groups.erase(
+        std::remove_if(
+          groups.begin(),
+          groups.end(),
+          [] (const std::vector<std::string>& group) { return group.empty(); }),
+        groups.end());
+    }
+
+    // Every stage must be listed exactly once and in pipeline order,
+    // such that every thread only exchanges samples with its neighbors.
+    size_t next = 0;
+    for (const auto& group : groups) {
+      groups_.emplace_back();
+      for (const auto& name : group) {
+        if (next == stages_.size() || stages_[next]->name != name) {
+          std::stringstream ss;
+          ss << "Invalid demodulator pipeline: expected ";
+          if (next < stages_.size()) {
+            ss << "stage \"" << stages_[next]->name << "\"";
+          } else {
+            ss << "no more stages";
+          }
+          ss << " but got \"" << name << "\" "
+             << "(stages must be listed once, in order: "
+             << "frontend, agc, costas, rrc, clock_recovery, quantization";
+          if (fused_) {
+            ss << "; with fused enabled, agc, costas, and rrc "
+               << "must share a thread";
+          }
+          ss << ")";
+          throw std::invalid_argument(ss.str());
+        }
+        stages_[next]->thread = groups_.size() - 1;
+        groups_.back().push_back(stages_[next].get());
+        next++;
+      }
+    }
+    if (next != stages_.size()) {
+      std::stringstream ss;
+      ss << "Invalid demodulator pipeline: missing stage \""
+         << stages_[next]->name << "\"";
+      throw std::invalid_argument(ss.str());
+    }
+  }
+
+  stageSnapshots_.resize(stages_.size());
+}
+
+void Demodulator::sampleQueueDepth() {
+  for (size_t i = 0; i < stages_.size(); i++) {
+    auto& snapshot = stageSnapshots_[i];
+    const uint64_t depth = stages_[i]->input->depth();
+    snapshot.depthSum += depth;
+    snapshot.depthMax = std::max(snapshot.depthMax, depth);
+    snapshot.depthCount++;
+  }
+}
+
+DemodulatorStats::Report Demodulator::report() {
+  const auto now = std::chrono::steady_clock::now();
+  const auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    now - stageSnapshotTime_).count();
+  stageSnapshotTime_ = now;
+
+  DemodulatorStats::Report out;
+  for (size_t i = 0; i < stages_.size(); i++) {
+    const auto& stage = stages_[i];
+    auto& snapshot = stageSnapshots_[i];
+    const auto samples = stage->samples.load();
+    const auto nanos = stage->nanos.load();
+    const auto readWait = stage->input->readWait();
+    const auto writeWait = stage->output->writeWait();
+    const auto blockTime = stage->blockTime.snapshot();
+    const auto dsamples = samples - snapshot.samples;
+    const auto dnanos = nanos - snapshot.nanos;
+    const auto dreadWait = readWait - snapshot.readWait;
+    const auto dwriteWait = writeWait - snapshot.writeWait;
+    const auto dblockTime = Histogram::subtract(blockTime, snapshot.blockTime);
+
+    DemodulatorStats::Stage r;
+    r.name = stage->name;
+    r.thread = stage->thread;
+
+    // Throughput is the number of samples this stage can process
+    // per second of CPU time. Load is the fraction of wall clock time
+    // it spent processing. The thread whose stages add up to a load
+    // close to 1.0 is the bottleneck.
+    r.throughput = (dnanos > 0) ? (1e9 * dsamples) / dnanos : 0.0;
+    r.load = (wall > 0) ? (double) dnanos / wall : 0.0;
+
+    // Rate is the number of samples processed per second of wall
+    // clock time. The wait times are the fractions of wall clock time
+    // spent waiting for input (upstream is too slow) and for room in
+    // the output queue (downstream is too slow).
+    r.rate = (wall > 0) ? (1e9 * dsamples) / wall : 0.0;
+    r.inputWait = (wall > 0) ? (double) dreadWait / wall : 0.0;
+    r.outputWait = (wall > 0) ? (double) dwriteWait / wall : 0.0;
+
+    // Larger blocks spread the overhead per block over more samples,
+    // which shows as a higher throughput
+    const auto blocks = Histogram::total(dblockTime);
+    r.blockSize = (blocks > 0) ? (double) dsamples / blocks : 0.0;
+
+    r.blockTimeP50 = 1e-9 * Histogram::percentile(dblockTime, 0.50);
+    r.blockTimeP90 = 1e-9 * Histogram::percentile(dblockTime, 0.90);
+    r.blockTimeP99 = 1e-9 * Histogram::percentile(dblockTime, 0.99);
+    r.blockTimeMax = 1e-9 * Histogram::percentile(dblockTime, 1.00);
+
+    r.depthMean = (snapshot.depthCount > 0)
+      ? (double) snapshot.depthSum / snapshot.depthCount
+      : 0.0;
+    r.depthMax = snapshot.depthMax;
+    r.depthSize = stage->input->size();
+    out.stages.push_back(std::move(r));
+
+    snapshot.samples = samples;
+    snapshot.nanos = nanos;
+    snapshot.readWait = readWait;
+    snapshot.writeWait = writeWait;
+    snapshot.blockTime = blockTime;
+    snapshot.depthSum = 0;
+    snapshot.depthMax = 0;
+    snapshot.depthCount = 0;
+  }
+
+  // Dropped since the last report (see Source::Overflow)
+  const auto droppedSamples = source_->getDroppedSamples();
+  const auto droppedBlocks = source_->getDroppedBlocks();
+  out.droppedSamples = droppedSamples - droppedSamples_;
+  out.droppedBlocks = droppedBlocks - droppedBlocks_;
+  droppedSamples_ = droppedSamples;
+  droppedBlocks_ = droppedBlocks;
+
+  // Stalled since the last report (see RTLTCP)
+  const auto stalls = source_->getStalls();
+  const auto stallTime = source_->getStallTime();
+  out.stalls = stalls - stalls_;
+  out.stallTime = (stallTime - stallTime_) / 1e6;
+  stalls_ = stalls;
+  stallTime_ = stallTime;
+
+  const auto disconnects = source_->getDisconnects();
+  out.disconnects = disconnects - disconnects_;
+  disconnects_ = disconnects;
+
+  // A sample waits for the rest of its block to arrive. Then every
+  // stage processes the block after the blocks queued ahead of it,
+  // and those take the time of every stage on the same thread.
+  out.blockDuration = out.stages.front().blockSize / sampleRate_;
+  out.latency = out.blockDuration;
+  for (const auto& stage : out.stages) {
+    double thread = 0.0;
+    for (const auto& other : out.stages) {
+      if (other.thread == stage.thread) {
+        thread += other.blockTimeP50;
+      }
+    }
+    out.latency += stage.depthMean * thread + stage.blockTimeP50;
+  }
+
+  // This runs on the thread that runs the quantization stage
+  out.quality = quantization_->getQuality().report();
+
+  return out;
+}
+
+void Demodulator::writeStageStats(
+    std::stringstream& ss,
+    const DemodulatorStats::Report& report) {
+  ss << "\"stages\": {";
+  for (size_t i = 0; i < report.stages.size(); i++) {
+    const auto& stage = report.stages[i];
+    if (i > 0) {
+      ss << ",";
+    }
+    ss << "\"" << stage.name << "\": {";
+    ss << "\"thread\": " << stage.thread << ",";
+    ss << "\"throughput\": " << stage.throughput << ",";
+    ss << "\"load\": " << stage.load << ",";
+    ss << "\"rate\": " << stage.rate << ",";
+    ss << "\"input_wait\": " << stage.inputWait << ",";
+    ss << "\"output_wait\": " << stage.outputWait << ",";
+    ss << "\"block_size\": " << stage.blockSize << ",";
+
+    // Percentiles of CPU time per block (seconds)
+    ss << "\"block_time\": {";
+    ss << "\"p50\": " << stage.blockTimeP50 << ",";
+    ss << "\"p90\": " << stage.blockTimeP90 << ",";
+    ss << "\"p99\": " << stage.blockTimeP99 << ",";
+    ss << "\"max\": " << stage.blockTimeMax;
+    ss << "},";
+
+    // Number of full buffers waiting in the input queue
+    ss << "\"queue_depth\": {";
+    ss << "\"mean\": " << stage.depthMean << ",";
+    ss << "\"max\": " << stage.depthMax << ",";
+    ss << "\"size\": " << stage.depthSize;
+    ss << "}";
+    ss << "}";
   }
+  ss << "}";
+}
+
+void Demodulator::writeSourceStats(
+    std::stringstream& ss,
+    const DemodulatorStats::Report& report) {
+  ss << "\"source\": {";
+  ss << "\"dropped_samples\": " << report.droppedSamples << ",";
+  ss << "\"dropped_blocks\": " << report.droppedBlocks << ",";
+  ss << "\"stalls\": " << report.stalls << ",";
+  ss << "\"stall_time\": " << report.stallTime << ",";
+  ss << "\"disconnects\": " << report.disconnects << ",";
+  ss << "\"block_duration\": " << report.blockDuration;
+  ss << "}";
+}
+
+void Demodulator::writeQualityStats(
+    std::stringstream& ss,
+    const DemodulatorStats::Report& report) {
+  const auto& quality = report.quality;
+  ss << "\"quality\": {";
+  ss << "\"symbols\": " << quality.symbols << ",";
+  ss << "\"amplitude\": " << quality.amplitude << ",";
+  ss << "\"snr\": " << quality.snr << ",";
+  ss << "\"evm\": " << quality.evm << ",";
+  ss << "\"evm_peak\": " << quality.evmPeak << ",";
 
-  const auto timestamp = stringTime();
+  // Histogram of every 16th symbol (see Quality)
+  ss << "\"constellation\": {";
+  ss << "\"bins\": " << Quality::bins << ",";
+  ss << "\"range\": " << 2 * quality.amplitude << ",";
+  ss << "\"counts\": [";
+  for (size_t i = 0; i < quality.constellation.size(); i++) {
+    if (i > 0) {
+      ss << ",";
+    }
+    ss << quality.constellation[i];
+  }
+  ss << "]";
+  ss << "}";
+  ss << "}";
+}
+
+void Demodulator::writeKernelStats(std::stringstream& ss) {
+  ss << "\"kernels\": {";
+  ss << "\"source\": \"" << simdName(source_->getSIMD()) << "\",";
+  if (frontEnd_) {
+    ss << "\"frontend\": \"" << simdName(frontEnd_->getSIMD()) << "\",";
+  }
+  ss << "\"agc\": \"" << simdName(agc_->getSIMD()) << "\",";
+  ss << "\"costas\": \"" << simdName(costas_->getSIMD()) << "\",";
+  ss << "\"rrc\": \"" << simdName(rrc_->getSIMD()) << "\",";
+  ss << "\"clock_recovery\": \"" << simdName(clockRecovery_->getSIMD()) << "\",";
+  ss << "\"quantization\": \"" << simdName(quantization_->getSIMD()) << "\"";
+  ss << "}";
+}
+
+void Demodulator::writeThreadStats(std::stringstream& ss) {
+  ss << "\"threads\": [";
+  const auto threads = Scheduling::getThreads();
+  for (size_t i = 0; i < threads.size(); i++) {
+    const auto& thread = threads[i];
+    if (i > 0) {
+      ss << ",";
+    }
+    ss << "{";
+    ss << "\"role\": \"" << thread.role << "\",";
+    ss << "\"tid\": " << thread.tid << ",";
+    ss << "\"cpus\": [";
+    for (size_t j = 0; j < thread.cpus.size(); j++) {
+      if (j > 0) {
+        ss << ",";
+      }
+      ss << thread.cpus[j];
+    }
+    ss << "],";
+    ss << "\"policy\": \"" << thread.policy << "\",";
+    ss << "\"priority\": " << thread.priority << ",";
+    ss << "\"nice\": " << thread.nice;
+    ss << "}";
+  }
+  ss << "]";
+}
+
+void Demodulator::publishStats() {
   const auto gain = agc_->getGain();
-  const auto frequency = (sampleRate_ * costas_->getFrequency()) / (2 * M_PI);
+  auto frequency = (trackingRate_ * costas_->getFrequency()) / (2 * M_PI);
+  if (frontEnd_) {
+    frequency += frontEnd_->getFrequency();
+  }
   const auto omega = clockRecovery_->getOmega();
+  stats_.samples.push({gain, (float) frequency, omega});
 
-  std::stringstream ss;
-  ss.precision(10);
-  ss << std::scientific;
-  ss << "{";
-  ss << "\"timestamp\": \"" << timestamp << "\",";
-  ss << "\"gain\": " << gain << ",";
-  ss << "\"frequency\": " << frequency << ",";
-  ss << "\"omega\": " << omega;
-  ss << "}\n";
-  statsPublisher_->publish(ss.str());
+  // Stage stats are aggregated over (at least) a second
+  sampleQueueDepth();
+  const auto now = std::chrono::steady_clock::now();
+  const bool reporting = (now - stageSnapshotTime_) >= std::chrono::seconds(1);
+  DemodulatorStats::Report r;
+  if (reporting) {
+    r = report();
+  }
+
+  // JSON is only written for subscribers, at most once per interval
+  // (and whenever there is a report)
+  if (statsPublisher_ &&
+      (reporting || now - statsPublishTime_ >= statsPublishInterval_) &&
+      statsPublisher_->hasSubscribers()) {
+    statsPublishTime_ = now;
+
+    std::stringstream ss;
+    ss.precision(10);
+    ss << std::scientific;
+    ss << "{";
+    ss << "\"timestamp\": \"" << stringTime() << "\",";
+    ss << "\"gain\": " << gain << ",";
+    ss << "\"frequency\": " << frequency << ",";
+    ss << "\"omega\": " << omega;
+    if (reporting) {
+      ss << ",";
+      ss << "\"latency\": " << r.latency << ",";
+      writeStageStats(ss, r);
+      ss << ",";
+      writeSourceStats(ss, r);
+      ss << ",";
+      writeQualityStats(ss, r);
+      ss << ",";
+      writeKernelStats(ss);
+      ss << ",";
+      writeThreadStats(ss);
+    }
+    ss << "}\n";
+    statsPublisher_->publish(ss.str());
+  }
+
+  if (reporting) {
+    stats_.pushReport(std::move(r));
+  }
+}
+
+void Demodulator::loop(const std::vector<Stage*>& stages, bool publish) {
+  if (groups_.size() > 1) {
+    Scheduling::apply("demodulator." + stages.front()->name);
+  } else {
+    Scheduling::apply("demodulator");
+  }
+
+  for (;;) {
+    for (auto stage : stages) {
+      auto start = threadTime();
+      auto nsamples = stage->work();
+      auto nanos = threadTime() - start;
+      stage->nanos += nanos;
+      stage->samples += nsamples;
+      stage->blockTime.record(nanos);
+    }
+
+    // Every stage closes its output queue when its input queue has
+    // closed and has been drained. Once the first stage in this group
+    // has done so, the remaining stages in the group have followed
+    // suit, and the thread running the next group will do the same.
+    if (stages.front()->closed()) {
+      break;
+    }
+
+    if (publish) {
+      publishStats();
+    }
+  }
 }
 
 void Demodulator::start() {
-  thread_ = std::thread([&] {
-      while (!sourceQueue_->closed()) {
-        agc_->work(sourceQueue_, agcQueue_);
-        costas_->work(agcQueue_, costasQueue_);
-        rrc_->work(costasQueue_, rrcQueue_);
-        clockRecovery_->work(rrcQueue_, clockRecoveryQueue_);
-        quantization_->work(clockRecoveryQueue_, softBitsQueue_);
-        publishStats();
-      }
+  stageSnapshotTime_ = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < groups_.size(); i++) {
+    // The thread running the last group publishes stats
+    const bool publish = (i + 1) == groups_.size();
+    threads_.emplace_back(&Demodulator::loop, this, groups_[i], publish);
 
-      // Close queues to signal downstream consumers of termination
-      agcQueue_->close();
-      costasQueue_->close();
-      rrcQueue_->close();
-      clockRecoveryQueue_->close();
-      softBitsQueue_->close();
-    });
+    // Thread names are limited to 16 characters (incl. terminator)
+    std::string name = "demodulator";
+    if (groups_.size() > 1) {
+      name = ("demod/" + groups_[i].front()->name).substr(0, 15);
+    }
 #ifdef __APPLE__
-  pthread_setname_np("demodulator");
+    pthread_setname_np(name.c_str());
 #else
-  pthread_setname_np(thread_.native_handle(), "demodulator");
+    pthread_setname_np(threads_.back().native_handle(), name.c_str());
 #endif
+  }
   source_->start(sourceQueue_);
 }
 
 void Demodulator::stop() {
   source_->stop();
-  thread_.join();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
 }
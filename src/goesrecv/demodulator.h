@@ -1,15 +1,25 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "agc.h"
 #include "clock_recovery.h"
 #include "config.h"
 #include "costas.h"
+#include "frontend.h"
+#include "fused.h"
+#include "histogram.h"
 #include "publisher.h"
 #include "quantize.h"
 #include "rrc.h"
 #include "source.h"
+#include "stats.h"
 #include "stats_publisher.h"
 #include "types.h"
 
@@ -22,34 +32,156 @@ public:
 
   explicit Demodulator(Type t);
 
-  void initialize(Config& config);
+  // Samples are read from the configured source, unless a source is
+  // specified.
+  void initialize(Config& config, std::unique_ptr<Source> source = nullptr);
+
+  // Returns the one-sided bandwidth of the signal in Hz, including
+  // the frequency deviation the Costas loop may have to track.
+  double getBandwidth(const Config& config) const;
+
+  // Benchmarks the DSP kernels for the configured source and writes
+  // the fastest configuration to the configured autotune file.
+  void autotune(const Config& config, std::ostream& log);
 
   std::shared_ptr<Queue<std::vector<int8_t> > > getSoftBitsQueue() {
     return softBitsQueue_;
   }
 
+  // Stats for the in-process monitor
+  DemodulatorStats& getStats() {
+    return stats_;
+  }
+
+  // Reports a packet decoded from the soft bits, which tells coarse
+  // frequency acquisition (if enabled) that the signal is locked.
+  // Safe to call from any thread.
+  void notifyPacket() {
+    if (auto acquisition = costas_->getAcquisition()) {
+      acquisition->notify();
+    }
+  }
+
   void start();
   void stop();
 
 protected:
+  // A stage wraps a single DSP block and tracks how much time it
+  // spends processing samples. The counters are written by the
+  // thread that runs the stage and read by the thread publishing
+  // stats, so they are atomic.
+  struct Stage {
+    explicit Stage(
+        std::string name,
+        std::function<size_t()> work,
+        std::function<bool()> closed,
+        QueueStats* input,
+        QueueStats* output)
+        : name(std::move(name)),
+          work(std::move(work)),
+          closed(std::move(closed)),
+          input(input),
+          output(output),
+          samples(0),
+          nanos(0) {
+    }
+
+    const std::string name;
+
+    // Processes a single block
+    const std::function<size_t()> work;
+
+    // Returns true when this stage has closed its output queue
+    const std::function<bool()> closed;
+
+    // Queues this stage reads from and writes to (for their stats)
+    QueueStats* const input;
+    QueueStats* const output;
+
+    // Index of thread running this stage
+    int thread = 0;
+
+    // Total number of input samples processed
+    std::atomic<uint64_t> samples;
+
+    // Total CPU time spent processing samples
+    std::atomic<uint64_t> nanos;
+
+    // CPU time spent processing every block
+    Histogram blockTime;
+  };
+
+  void initializeKernels(Config& config);
+  void initializePipeline(const std::vector<std::vector<std::string> >& pipeline);
+  void loop(const std::vector<Stage*>& stages, bool publish);
   void publishStats();
+  void sampleQueueDepth();
+  DemodulatorStats::Report report();
+  void writeStageStats(std::stringstream& ss, const DemodulatorStats::Report& report);
+  void writeSourceStats(std::stringstream& ss, const DemodulatorStats::Report& report);
+  void writeQualityStats(std::stringstream& ss, const DemodulatorStats::Report& report);
+  void writeKernelStats(std::stringstream& ss);
+  void writeThreadStats(std::stringstream& ss);
 
+  Type type_;
   uint32_t symbolRate_;
   uint32_t sampleRate_;
 
+  // Sample rate at the AGC and Costas loop (after the front end)
+  uint32_t trackingRate_;
+
   std::unique_ptr<Source> source_;
   std::unique_ptr<StatsPublisher> statsPublisher_;
-  std::thread thread_;
+  std::chrono::milliseconds statsPublishInterval_{0};
+  std::chrono::steady_clock::time_point statsPublishTime_;
+  DemodulatorStats stats_;
+
+  // Stages in pipeline order, grouped by the thread they run on
+  std::vector<std::unique_ptr<Stage> > stages_;
+  std::vector<std::vector<Stage*> > groups_;
+  std::vector<std::thread> threads_;
+
+  // Counter snapshot of every stage at the last stage stats report
+  struct StageSnapshot {
+    uint64_t samples = 0;
+    uint64_t nanos = 0;
+    uint64_t readWait = 0;
+    uint64_t writeWait = 0;
+    Histogram::Counts blockTime = {};
+
+    // Depth of the input queue, sampled every time stats are published
+    uint64_t depthSum = 0;
+    uint64_t depthMax = 0;
+    uint64_t depthCount = 0;
+  };
+
+  std::vector<StageSnapshot> stageSnapshots_;
+  std::chrono::steady_clock::time_point stageSnapshotTime_;
+
+  // Source counters at the last stage stats report
+  uint64_t droppedSamples_ = 0;
+  uint64_t droppedBlocks_ = 0;
+  uint64_t stalls_ = 0;
+  uint64_t stallTime_ = 0;
+  uint64_t disconnects_ = 0;
 
   // DSP blocks
+  std::unique_ptr<FrontEnd> frontEnd_;
   std::unique_ptr<AGC> agc_;
   std::unique_ptr<Costas> costas_;
   std::unique_ptr<RRC> rrc_;
   std::unique_ptr<ClockRecovery> clockRecovery_;
   std::unique_ptr<Quantize> quantization_;
 
+  // Clock recovery includes the matched filter (if enabled)
+  bool polyphase_ = false;
+
+  // Runs AGC, Costas, and RRC in a single pass (if enabled)
+  std::unique_ptr<Fused> fused_;
+
   // Queues
   std::shared_ptr<Queue<Samples> > sourceQueue_;
+  std::shared_ptr<Queue<Samples> > frontEndQueue_;
   std::shared_ptr<Queue<Samples> > agcQueue_;
   std::shared_ptr<Queue<Samples> > costasQueue_;
   std::shared_ptr<Queue<Samples> > rrcQueue_;
@@ -0,0 +1,247 @@
+#include "downconvert.h"
+
+#include <util/error.h>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+#include "frontend.h"
+
+namespace {
+
+// Transition band of the half-band filter, relative to the rate of
+// the real samples. Everything within 80% of the bandwidth of the
+// complex samples is passed.
+constexpr double transition = 0.1;
+
+// Converts to [-1.0, 1.0), and doubles the amplitude to make up for
+// the half of the power that the filter removes (the mirror image).
+constexpr float scale = 2.0f / 32768.0f;
+
+} // namespace
+
+RealDownconverter::RealDownconverter()
+    : taps_(FrontEnd::halfBandTaps(transition)),
+      even_(2 * taps_.size() - 1, 0.0f),
+      odd_(taps_.size(), 0.0f),
+      negate_(false) {
+}
+
+void RealDownconverter::work(
+    SIMD simd,
+    size_t nsamples,
+    const int16_t* in,
+    std::complex<float>* out) {
+  ASSERT((nsamples % 2) == 0);
+  const size_t nout = nsamples / 2;
+  split(simd, nsamples, in);
+  filter(simd, nout, out);
+
+  // Keep the final samples for the next block
+  even_.erase(even_.begin(), even_.begin() + nout);
+  odd_.erase(odd_.begin(), odd_.begin() + nout);
+}
+
+void RealDownconverter::split(SIMD simd, size_t nsamples, const int16_t* in) {
+  const size_t n = even_.size();
+  even_.resize(n + nsamples / 2);
+  odd_.resize(odd_.size() + nsamples / 2);
+  float* even = &even_[n];
+  float* odd = &odd_[odd_.size() - nsamples / 2];
+
+  switch (simd) {
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+    splitSSE41(nsamples, in, even, odd);
+    break;
+  case SIMD::AVX2:
+    splitAVX2(nsamples, in, even, odd);
+    break;
+#endif
+  default:
+    // There is no NEON specific implementation.
+    splitScalar(nsamples, in, even, odd);
+    break;
+  }
+
+  // The sign alternates with every pair of samples
+  if ((nsamples / 2) % 2) {
+    negate_ = !negate_;
+  }
+}
+
+void RealDownconverter::splitScalar(
+    size_t nsamples,
+    const int16_t* in,
+    float* even,
+    float* odd) {
+  float sign = negate_ ? -scale : scale;
+  for (size_t k = 0; k < nsamples / 2; k++) {
+    even[k] = sign * in[2*k+0];
+    odd[k] = sign * in[2*k+1];
+    sign = -sign;
+  }
+}
+
+void RealDownconverter::filter(SIMD simd, size_t nout, std::complex<float>* out) {
+  switch (simd) {
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+    filterSSE41(even_.data(), odd_.data(), nout, out);
+    break;
+  case SIMD::AVX2:
+    filterAVX2(even_.data(), odd_.data(), nout, out);
+    break;
+#endif
+  default:
+    filterScalar(even_.data(), odd_.data(), nout, out);
+    break;
+  }
+}
+
+void RealDownconverter::filterScalar(
+    const float* even,
+    const float* odd,
+    size_t nout,
+    std::complex<float>* out) {
+  const size_t m = taps_.size();
+  float* f = (float*) out;
+  for (size_t j = 0; j < nout; j++) {
+    // Symmetric taps share a multiplication
+    float re = 0.0f;
+    for (size_t i = 0; i < m; i++) {
+      re += taps_[i] * (even[j+i] + even[j+2*m-1-i]);
+    }
+
+    f[2*j+0] = re;
+
+    // Center tap
+    f[2*j+1] = 0.5f * odd[j];
+  }
+}
+
+#ifdef SIMD_X86
+
+// The pairs of samples in a vector alternate in sign, and every
+// iteration covers an even number of pairs, so the sign pattern is
+// the same for every iteration.
+
+TARGET_SSE41
+void RealDownconverter::splitSSE41(
+    size_t nsamples,
+    const int16_t* in,
+    float* even,
+    float* odd) {
+  const float s = negate_ ? -scale : scale;
+  const __m128 sign = _mm_setr_ps(s, s, -s, -s);
+
+  // Process 8 samples at a time
+  size_t i = 0;
+  for (; i + 8 <= nsamples; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &in[i]);
+    __m128 lo = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(v));
+    __m128 hi = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(v, 8)));
+    lo = _mm_mul_ps(lo, sign);
+    hi = _mm_mul_ps(hi, sign);
+    _mm_storeu_ps(&even[i/2], _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(&odd[i/2], _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+
+  // Remainder
+  splitScalar(nsamples - i, &in[i], &even[i/2], &odd[i/2]);
+}
+
+TARGET_AVX2
+void RealDownconverter::splitAVX2(
+    size_t nsamples,
+    const int16_t* in,
+    float* even,
+    float* odd) {
+  const float s = negate_ ? -scale : scale;
+  const __m256 sign = _mm256_setr_ps(s, s, -s, -s, s, s, -s, -s);
+
+  // Process 16 samples at a time
+  size_t i = 0;
+  for (; i + 16 <= nsamples; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) &in[i]);
+    __m256 a = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+    __m256 b = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+    a = _mm256_mul_ps(a, sign);
+    b = _mm256_mul_ps(b, sign);
+
+    // The shuffles work within 128 bit lanes, which leaves the
+    // 64 bit halves of every lane in the order a, b, a, b
+    __m256 e = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    __m256 o = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    e = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(e), _MM_SHUFFLE(3, 1, 2, 0)));
+    o = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(o), _MM_SHUFFLE(3, 1, 2, 0)));
+    _mm256_storeu_ps(&even[i/2], e);
+    _mm256_storeu_ps(&odd[i/2], o);
+  }
+
+  // Remainder
+  splitScalar(nsamples - i, &in[i], &even[i/2], &odd[i/2]);
+}
+
+TARGET_SSE41
+void RealDownconverter::filterSSE41(
+    const float* even,
+    const float* odd,
+    size_t nout,
+    std::complex<float>* out) {
+  const size_t m = taps_.size();
+  float* f = (float*) out;
+  const __m128 half = _mm_set1_ps(0.5f);
+
+  // Process 4 outputs at a time
+  size_t j = 0;
+  for (; j + 4 <= nout; j += 4) {
+    __m128 re = _mm_setzero_ps();
+    for (size_t i = 0; i < m; i++) {
+      __m128 a = _mm_loadu_ps(&even[j+i]);
+      __m128 b = _mm_loadu_ps(&even[j+2*m-1-i]);
+      re = _mm_add_ps(re, _mm_mul_ps(_mm_set1_ps(taps_[i]), _mm_add_ps(a, b)));
+    }
+    __m128 im = _mm_mul_ps(half, _mm_loadu_ps(&odd[j]));
+    _mm_storeu_ps(&f[2*j+0], _mm_unpacklo_ps(re, im));
+    _mm_storeu_ps(&f[2*j+4], _mm_unpackhi_ps(re, im));
+  }
+
+  // Remainder
+  filterScalar(&even[j], &odd[j], nout - j, &out[j]);
+}
+
+TARGET_AVX2
+void RealDownconverter::filterAVX2(
+    const float* even,
+    const float* odd,
+    size_t nout,
+    std::complex<float>* out) {
+  const size_t m = taps_.size();
+  float* f = (float*) out;
+  const __m256 half = _mm256_set1_ps(0.5f);
+
+  // Process 8 outputs at a time
+  size_t j = 0;
+  for (; j + 8 <= nout; j += 8) {
+    __m256 re = _mm256_setzero_ps();
+    for (size_t i = 0; i < m; i++) {
+      __m256 a = _mm256_loadu_ps(&even[j+i]);
+      __m256 b = _mm256_loadu_ps(&even[j+2*m-1-i]);
+      re = _mm256_fmadd_ps(_mm256_set1_ps(taps_[i]), _mm256_add_ps(a, b), re);
+    }
+    __m256 im = _mm256_mul_ps(half, _mm256_loadu_ps(&odd[j]));
+
+    // Interleave within lanes, then put the lanes in order
+    __m256 lo = _mm256_unpacklo_ps(re, im);
+    __m256 hi = _mm256_unpackhi_ps(re, im);
+    _mm256_storeu_ps(&f[2*j+0], _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(&f[2*j+8], _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+
+  // Remainder
+  filterScalar(&even[j], &odd[j], nout - j, &out[j]);
+}
+
+#endif
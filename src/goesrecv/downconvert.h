@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <complex>
+#include <vector>
+
+#include "simd.h"
+
+// RealDownconverter turns real samples of a signal centered at a
+// quarter of their sample rate (the raw output of the Airspy ADC) into
+// complex samples at half that rate, centered at zero.
+//
+// Mixing with a quarter of the sample rate only multiplies the samples
+// by 1, i, -1, and -i in turn, so the even samples end up real and
+// the odd samples imaginary. The half-band filter that follows (see
+// FrontEnd::HalfBand) then splits in two: its nonzero taps left and
+// right of the center only ever see the even samples, and its center
+// tap only ever sees the odd samples. The real part of the output is
+// a filter of half the length over the even samples, and the
+// imaginary part is the odd samples, delayed.
+//
+// The image that is kept (a real signal at a quarter of the sample
+// rate plus f ends up at -f) is the same as the one libairspy keeps
+// when it produces complex samples, so the spectrum is the same.
+//
+// Samples are signed 16 bit (native byte order). The output is scaled
+// such that a full scale real sinusoid has amplitude 1.
+//
+class RealDownconverter {
+public:
+  explicit RealDownconverter();
+
+  // Converts nsamples real samples (an even number) to nsamples / 2
+  // complex samples.
+  void work(
+      SIMD simd,
+      size_t nsamples,
+      const int16_t* in,
+      std::complex<float>* out);
+
+protected:
+  // Converts and mixes nsamples real samples, and appends them to the
+  // even and odd samples.
+  void split(SIMD simd, size_t nsamples, const int16_t* in);
+
+  void splitScalar(size_t nsamples, const int16_t* in, float* even, float* odd);
+
+  // Computes nout outputs, where output j is computed from even
+  // samples j up to and including j + 2 * taps_.size() - 1, and odd
+  // sample j.
+  void filter(SIMD simd, size_t nout, std::complex<float>* out);
+
+  void filterScalar(
+      const float* even,
+      const float* odd,
+      size_t nout,
+      std::complex<float>* out);
+
+#ifdef SIMD_X86
+  TARGET_SSE41 void splitSSE41(
+      size_t nsamples,
+      const int16_t* in,
+      float* even,
+      float* odd);
+
+  TARGET_AVX2 void splitAVX2(
+      size_t nsamples,
+      const int16_t* in,
+      float* even,
+      float* odd);
+
+  TARGET_SSE41 void filterSSE41(
+      const float* even,
+      const float* odd,
+      size_t nout,
+      std::complex<float>* out);
+
+  TARGET_AVX2 void filterAVX2(
+      const float* even,
+      const float* odd,
+      size_t nout,
+      std::complex<float>* out);
+#endif
+
+  // Nonzero taps left of the center
+  std::vector<float> taps_;
+
+  // Even and odd samples after mixing, preceded by the final samples
+  // of the previous block (zeroes initially)
+  std::vector<float> even_;
+  std::vector<float> odd_;
+
+  // Set if the next pair of samples is multiplied by -1 and -i,
+  // instead of 1 and i
+  bool negate_;
+};
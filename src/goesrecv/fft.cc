@@ -0,0 +1,60 @@
+#include "fft.h"
+
+#include <cmath>
+
+#include <util/error.h>
+
+FFT::FFT(size_t n, bool inverse) : n_(n) {
+  ASSERT(n > 0 && (n & (n - 1)) == 0);
+
+  size_t bits = 0;
+  while (((size_t) 1 << bits) < n) {
+    bits++;
+  }
+
+  reverse_.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    size_t r = 0;
+    for (size_t b = 0; b < bits; b++) {
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    reverse_[i] = r;
+  }
+
+  const double sign = inverse ? 1.0 : -1.0;
+  twiddles_.resize(n / 2);
+  for (size_t i = 0; i < n / 2; i++) {
+    twiddles_[i] = std::polar(1.0, sign * 2 * M_PI * i / n);
+  }
+}
+
+void FFT::run(std::complex<float>* data) const {
+  for (size_t i = 0; i < n_; i++) {
+    const auto j = reverse_[i];
+    if (i < j) {
+      std::swap(data[i], data[j]);
+    }
+  }
+
+  // Written out on interleaved floats, to avoid the NaN handling of
+  // std::complex and to keep the twiddle factors in registers
+  float* d = reinterpret_cast<float*>(data);
+  for (size_t size = 2; size <= n_; size *= 2) {
+    const size_t half = size / 2;
+    const size_t stride = n_ / size;
+    for (size_t j = 0; j < half; j++) {
+      const float wr = twiddles_[j * stride].real();
+      const float wi = twiddles_[j * stride].imag();
+      for (size_t i = j; i < n_; i += size) {
+        float* a = &d[2 * i];
+        float* b = &d[2 * (i + half)];
+        const float tr = wr * b[0] - wi * b[1];
+        const float ti = wr * b[1] + wi * b[0];
+        b[0] = a[0] - tr;
+        b[1] = a[1] - ti;
+        a[0] += tr;
+        a[1] += ti;
+      }
+    }
+  }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+// FFT computes the discrete Fourier transform of a block of samples in
+// place. It is a plain iterative radix-2 transform, so the size must
+// be a power of 2. The inverse transform is not scaled.
+//
+class FFT {
+public:
+  explicit FFT(size_t n, bool inverse = false);
+
+  size_t size() const {
+    return n_;
+  }
+
+  void run(std::complex<float>* data) const;
+
+protected:
+  const size_t n_;
+
+  // Index of every sample after bit reversal
+  std::vector<size_t> reverse_;
+
+  // Twiddle factors for the final (largest) butterfly stage; the
+  // earlier stages use every (n / size)th factor.
+  std::vector<std::complex<float> > twiddles_;
+};
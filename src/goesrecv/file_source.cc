@@ -0,0 +1,288 @@
+#include "file_source.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <nlohmann/json.hpp>
+
+#include <util/error.h>
+
+#include "convert.h"
+#include "scheduling.h"
+
+namespace {
+
+// Number of samples per block unless configured otherwise
+constexpr uint32_t defaultBlockSize = 64 * 1024;
+
+FileSource::Format formatFromName(const std::string& name) {
+  if (name == "cu8") {
+    return FileSource::Format::CU8;
+  }
+  if (name == "cs8") {
+    return FileSource::Format::CS8;
+  }
+  if (name == "cs16") {
+    return FileSource::Format::CS16;
+  }
+  if (name == "cf32") {
+    return FileSource::Format::CF32;
+  }
+  throw std::invalid_argument("Invalid sample format: " + name);
+}
+
+// Maps SigMF datatype to sample format name (see formatFromName).
+// Multi-byte samples are expected to be in native (little endian)
+// byte order.
+std::string formatFromDatatype(const std::string& datatype) {
+  if (datatype == "cu8") {
+    return "cu8";
+  }
+  if (datatype == "ci8") {
+    return "cs8";
+  }
+  if (datatype == "ci16_le") {
+    return "cs16";
+  }
+  if (datatype == "cf32_le") {
+    return "cf32";
+  }
+  throw std::runtime_error("Unsupported SigMF datatype: " + datatype);
+}
+
+// Returns path of SigMF metadata file for the specified recording.
+std::string metadataPath(const std::string& path) {
+  const std::string ext = ".sigmf-data";
+  if (path.size() > ext.size() &&
+      path.compare(path.size() - ext.size(), ext.size(), ext) == 0) {
+    return path.substr(0, path.size() - ext.size()) + ".sigmf-meta";
+  }
+  return path + ".sigmf-meta";
+}
+
+} // namespace
+
+std::unique_ptr<FileSource> FileSource::open(const Config::File& config) {
+  auto format = config.format;
+  auto sampleRate = config.sampleRate;
+
+  // Fill in the blanks from the metadata file, if there is one
+  const auto meta = metadataPath(config.path);
+  std::ifstream ifs(meta);
+  if (ifs && (format.empty() || sampleRate == 0)) {
+    try {
+      const auto global = nlohmann::json::parse(ifs).at("global");
+      if (format.empty() && global.count("core:datatype")) {
+        format = formatFromDatatype(global["core:datatype"].get<std::string>());
+      }
+      if (sampleRate == 0 && global.count("core:sample_rate")) {
+        sampleRate = (uint32_t) global["core:sample_rate"].get<double>();
+      }
+    } catch (const nlohmann::json::exception& e) {
+      std::stringstream ss;
+      ss << "Unable to read SigMF metadata from " << meta << ": " << e.what();
+      throw std::runtime_error(ss.str());
+    }
+  }
+
+  if (format.empty()) {
+    std::stringstream ss;
+    ss <<
+      "You configured the file source without a sample format, " <<
+      "and there is no SigMF metadata file that specifies it " <<
+      "(looked for " << meta << ")";
+    throw std::runtime_error(ss.str());
+  }
+
+  if (sampleRate == 0) {
+    std::stringstream ss;
+    ss <<
+      "You configured the file source without a sample rate, " <<
+      "and there is no SigMF metadata file that specifies it " <<
+      "(looked for " << meta << ")";
+    throw std::runtime_error(ss.str());
+  }
+
+  auto file = std::make_unique<FileSource>(config.path, formatFromName(format));
+  file->setSampleRate(sampleRate);
+  file->setThrottle(config.throttle);
+  if (config.blockSize != 0) {
+    file->setBlockSize(config.blockSize);
+  }
+  return file;
+}
+
+FileSource::FileSource(const std::string& path, Format format)
+    : path_(path),
+      format_(format),
+      sampleRate_(0),
+      blockSize_(defaultBlockSize),
+      throttle_(false),
+      exitAtEnd_(true),
+      offset_(0),
+      count_(0),
+      stop_(false) {
+  switch (format_) {
+  case Format::CU8:
+  case Format::CS8:
+    sampleSize_ = 2;
+    break;
+  case Format::CS16:
+    sampleSize_ = 4;
+    break;
+  case Format::CF32:
+    sampleSize_ = 8;
+    break;
+  }
+
+  fd_ = ::open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    std::stringstream ss;
+    ss << "open: " << strerror(errno) << " (" << path << ")";
+    throw std::runtime_error(ss.str());
+  }
+
+  struct stat st;
+  auto rv = fstat(fd_, &st);
+  if (rv < 0 || st.st_size == 0) {
+    ::close(fd_);
+    std::stringstream ss;
+    ss << "Unable to read recording (" << path << ")";
+    throw std::runtime_error(ss.str());
+  }
+
+  size_ = st.st_size;
+  auto data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (data == MAP_FAILED) {
+    ::close(fd_);
+    std::stringstream ss;
+    ss << "mmap: " << strerror(errno) << " (" << path << ")";
+    throw std::runtime_error(ss.str());
+  }
+
+  // The recording is read front to back (once)
+  madvise(data, size_, MADV_SEQUENTIAL);
+  data_ = (const uint8_t*) data;
+  count_ = getSamples();
+}
+
+FileSource::~FileSource() {
+  munmap((void*) data_, size_);
+  ::close(fd_);
+}
+
+void FileSource::setSampleRate(uint32_t sampleRate) {
+  sampleRate_ = sampleRate;
+}
+
+uint32_t FileSource::getSampleRate() const {
+  return sampleRate_;
+}
+
+void FileSource::setBlockSize(uint32_t blockSize) {
+  ASSERT(blockSize > 0 && (blockSize % 4) == 0);
+  blockSize_ = blockSize;
+}
+
+void FileSource::setRange(uint64_t offset, uint64_t count) {
+  ASSERT(offset <= getSamples());
+  offset_ = offset;
+  count_ = std::min(count, getSamples() - offset);
+}
+
+void FileSource::loop() {
+  Scheduling::apply("source");
+
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+
+  // Trailing samples that don't make a multiple of 4 are dropped
+  const size_t total = count_ & ~((uint64_t) 3);
+  size_t pos = 0;
+  while (pos < total && !stop_) {
+    const size_t nsamples = std::min((size_t) blockSize_, total - pos);
+    const uint8_t* buf = &data_[(offset_ + pos) * sampleSize_];
+
+    // Grab buffer from queue
+    auto out = queue_->popForWrite();
+    out->resize(nsamples);
+
+    // Convert to std::complex<float>
+    switch (format_) {
+    case Format::CU8:
+      convertU8(simd_, nsamples, buf, out->data());
+      break;
+    case Format::CS8:
+      convertS8(simd_, nsamples, (const int8_t*) buf, out->data());
+      break;
+    case Format::CS16:
+      convertS16(simd_, nsamples, (const int16_t*) buf, out->data());
+      break;
+    case Format::CF32:
+      memcpy(out->data(), buf, nsamples * sampleSize_);
+      break;
+    }
+
+    // Publish output if applicable
+    if (samplePublisher_) {
+      samplePublisher_->publish(*out);
+    }
+
+    // Return buffer to queue
+    queue_->pushWrite(std::move(out));
+    pos += nsamples;
+
+    if (throttle_) {
+      const auto seconds = (double) pos / sampleRate_;
+      std::this_thread::sleep_until(
+        start + std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(seconds)));
+    }
+  }
+
+  if (!stop_) {
+    // Signal downstream that there are no more samples
+    queue_->close();
+
+    // Tell the process to stop (see goesrecv.cc)
+    if (exitAtEnd_) {
+      std::cerr << "Reached end of recording (" << path_ << ")" << std::endl;
+      kill(getpid(), SIGTERM);
+    }
+  }
+}
+
+void FileSource::start(const std::shared_ptr<Queue<Samples> >& queue) {
+  queue_ = queue;
+  thread_ = std::thread(&FileSource::loop, this);
+#ifdef __APPLE__
+  pthread_setname_np("file");
+#else
+  pthread_setname_np(thread_.native_handle(), "file");
+#endif
+}
+
+void FileSource::stop() {
+  stop_ = true;
+
+  // Wait for thread to terminate
+  thread_.join();
+
+  // Close queue to signal downstream
+  queue_->close();
+
+  // Clear reference to queue
+  queue_.reset();
+}
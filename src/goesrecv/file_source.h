@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "source.h"
+
+// FileSource replays a recording of raw I/Q samples, e.g. to run the
+// demodulator on a captured pass. The file is memory mapped and every
+// block is converted from the mapping directly into a queue buffer.
+// Blocks are produced as fast as the demodulator consumes them,
+// unless throttled to the sample rate.
+//
+// When the end of the recording is reached, the queue is closed, and
+// SIGTERM is sent to the process such that goesrecv exits once the
+// demodulator and decoder have processed the final samples.
+//
+class FileSource : public Source {
+public:
+  enum class Format {
+    CU8,
+    CS8,
+    CS16,
+    CF32,
+  };
+
+  // Opens the recording. The format and sample rate are taken from
+  // the configuration, or from the SigMF metadata file next to the
+  // recording if they are not configured.
+  static std::unique_ptr<FileSource> open(const Config::File& config);
+
+  explicit FileSource(const std::string& path, Format format);
+  ~FileSource();
+
+  void setSampleRate(uint32_t rate);
+
+  virtual uint32_t getSampleRate() const override;
+
+  Format getFormat() const {
+    return format_;
+  }
+
+  void setThrottle(bool throttle) {
+    throttle_ = throttle;
+  }
+
+  // Number of samples per block (a multiple of 4).
+  void setBlockSize(uint32_t blockSize);
+
+  // Number of samples in the recording.
+  uint64_t getSamples() const {
+    return size_ / sampleSize_;
+  }
+
+  // Replays only count samples starting at sample offset.
+  void setRange(uint64_t offset, uint64_t count);
+
+  // Send SIGTERM to the process at the end of the recording (default).
+  void setExitAtEnd(bool exitAtEnd) {
+    exitAtEnd_ = exitAtEnd;
+  }
+
+  void setSamplePublisher(std::unique_ptr<SamplePublisher> samplePublisher) {
+    samplePublisher_ = std::move(samplePublisher);
+  }
+
+  virtual void start(const std::shared_ptr<Queue<Samples> >& queue) override;
+
+  virtual void stop() override;
+
+protected:
+  void loop();
+
+  const std::string path_;
+  const Format format_;
+
+  // Bytes per sample (I and Q)
+  size_t sampleSize_;
+
+  // Memory mapped recording
+  int fd_;
+  const uint8_t* data_;
+  size_t size_;
+
+  uint32_t sampleRate_;
+  uint32_t blockSize_;
+  bool throttle_;
+  bool exitAtEnd_;
+
+  // Range of samples to replay
+  uint64_t offset_;
+  uint64_t count_;
+
+  std::atomic<bool> stop_;
+  std::thread thread_;
+
+  // Set on start; cleared on stop
+  std::shared_ptr<Queue<Samples> > queue_;
+
+  // Optional publisher for samples
+  std::unique_ptr<SamplePublisher> samplePublisher_;
+};
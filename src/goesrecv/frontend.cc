@@ -0,0 +1,444 @@
+#include "frontend.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+#include <util/error.h>
+
+namespace {
+
+// Attenuation of everything that aliases onto the signal (dB)
+constexpr double attenuation = 60.0;
+
+// Transition band of the final filter, relative to its sample rate
+constexpr double minTransition = 0.05;
+
+// Zeroth order modified Bessel function of the first kind.
+double bessel(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+// Returns the nonzero taps left of the center of a Kaiser windowed
+// half-band filter with the specified transition band (relative to
+// the sample rate). See the comment on FrontEnd::HalfBand.
+std::vector<float> halfBand(double transition) {
+  const double beta = 0.1102 * (attenuation - 8.7);
+  const double order = (attenuation - 8) / (2.285 * 2 * M_PI * transition);
+  const int m = std::max(2, std::min(32, (int) std::ceil((order + 2) / 4)));
+  const int center = 2 * m - 1;
+
+  // Tap i of the result is tap 2i of the complete filter
+  std::vector<float> taps(m);
+  double sum = 0.0;
+  for (int i = 0; i < m; i++) {
+    const int t = 2 * i - center;
+    const double x = (double) t / center;
+    const double w = bessel(beta * sqrt(1 - x * x)) / bessel(beta);
+    const double h = w * sin(M_PI * t / 2) / (M_PI * t);
+    taps[i] = h;
+    sum += h;
+  }
+
+  // Normalize to unit gain; the center tap contributes half of it
+  for (int i = 0; i < m; i++) {
+    taps[i] *= 0.25 / sum;
+  }
+
+  return taps;
+}
+
+} // namespace
+
+std::vector<float> FrontEnd::halfBandTaps(double transition) {
+  return halfBand(transition);
+}
+
+int FrontEnd::decimation(
+    uint32_t sampleRate,
+    uint32_t symbolRate,
+    double bandwidth) {
+  int decimation = 1;
+  for (;;) {
+    const double rate = (double) sampleRate / (2 * decimation);
+    if (rate < 2.0 * symbolRate) {
+      break;
+    }
+    if (2 * bandwidth > (1 - 2 * minTransition) * rate) {
+      break;
+    }
+    decimation *= 2;
+  }
+  return decimation;
+}
+
+FrontEnd::HalfBand::HalfBand(std::vector<float> taps)
+  : taps(std::move(taps)),
+    history(size() - 1) {
+}
+
+FrontEnd::FrontEnd(
+    uint32_t sampleRate,
+    int decimation,
+    double frequency,
+    double bandwidth)
+  : decimation_(decimation),
+    frequency_(frequency),
+    simd_(simdBest()),
+    phase_(0.0) {
+  ASSERT(decimation > 0 && (decimation & (decimation - 1)) == 0);
+
+  const double w = (2 * M_PI * frequency) / sampleRate;
+  rotation_.resize(CHUNK);
+  phasors_.resize(CHUNK);
+  for (size_t i = 0; i < CHUNK; i++) {
+    rotation_[i] = std::polar(1.0, -w * i);
+  }
+  phaseStep_ = fmod(w * CHUNK, 2 * M_PI);
+
+  // The signal only has to survive the final stage, so the transition
+  // band of every stage runs from the signal bandwidth up to where the
+  // aliases of the signal start, just below half the sample rate.
+  double rate = sampleRate;
+  for (int i = 1; i < decimation; i *= 2) {
+    const double transition = 0.5 - (2 * bandwidth) / rate;
+    stages_.emplace_back(halfBand(std::max(transition, minTransition)));
+    rate /= 2;
+  }
+}
+
+void FrontEnd::setSIMD(SIMD simd) {
+  ASSERT(simdSupported(simd));
+  simd_ = simd;
+}
+
+void FrontEnd::multiply(
+    size_t nsamples,
+    const std::complex<float>* a,
+    const std::complex<float>* b,
+    std::complex<float>* fo) {
+  switch (simd_) {
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+    multiplySSE41(nsamples, a, b, fo);
+    break;
+  case SIMD::AVX2:
+    multiplyAVX2(nsamples, a, b, fo);
+    break;
+#endif
+  default:
+    multiplyScalar(nsamples, a, b, fo);
+    break;
+  }
+}
+
+void FrontEnd::filter(
+    const std::vector<float>& taps,
+    const std::complex<float>* fi,
+    size_t nout,
+    std::complex<float>* fo) {
+  switch (simd_) {
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+    filterSSE41(taps, fi, nout, fo);
+    break;
+  case SIMD::AVX2:
+    filterAVX2(taps, fi, nout, fo);
+    break;
+#endif
+  default:
+    filterScalar(taps, fi, nout, fo);
+    break;
+  }
+}
+
+void FrontEnd::multiplyScalar(
+    size_t nsamples,
+    const std::complex<float>* a,
+    const std::complex<float>* b,
+    std::complex<float>* fo) {
+  // Spelled out; multiplying std::complex checks for NaN and infinity
+  const float* fa = (const float*) a;
+  const float* fb = (const float*) b;
+  float* f = (float*) fo;
+  for (size_t i = 0; i < nsamples; i++) {
+    const float ar = fa[2*i+0];
+    const float ai = fa[2*i+1];
+    const float br = fb[2*i+0];
+    const float bi = fb[2*i+1];
+    f[2*i+0] = ar * br - ai * bi;
+    f[2*i+1] = ai * br + ar * bi;
+  }
+}
+
+void FrontEnd::filterScalar(
+    const std::vector<float>& taps,
+    const std::complex<float>* fi,
+    size_t nout,
+    std::complex<float>* fo) {
+  const size_t m = taps.size();
+  const float* x = (const float*) fi;
+  float* f = (float*) fo;
+  for (size_t j = 0; j < nout; j++) {
+    const float* p = &x[4*j];
+    float re = 0.0f;
+    float im = 0.0f;
+
+    // Symmetric taps share a multiplication
+    for (size_t i = 0; i < m; i++) {
+      const float* a = &p[4*i];
+      const float* b = &p[4*(2*m-1-i)];
+      re += taps[i] * (a[0] + b[0]);
+      im += taps[i] * (a[1] + b[1]);
+    }
+
+    // Center tap
+    const float* c = &p[2*(2*m-1)];
+    re += 0.5f * c[0];
+    im += 0.5f * c[1];
+
+    f[2*j+0] = re;
+    f[2*j+1] = im;
+  }
+}
+
+#ifdef SIMD_X86
+
+TARGET_SSE41
+void FrontEnd::multiplySSE41(
+    size_t nsamples,
+    const std::complex<float>* a,
+    const std::complex<float>* b,
+    std::complex<float>* fo) {
+  const float* fa = (const float*) a;
+  const float* fb = (const float*) b;
+  float* f = (float*) fo;
+
+  // Process 2 samples at a time.
+  size_t i = 0;
+  for (; i + 2 <= nsamples; i += 2) {
+    __m128 va = _mm_loadu_ps(&fa[2*i]);
+    __m128 vb = _mm_loadu_ps(&fb[2*i]);
+    __m128 br = _mm_moveldup_ps(vb);
+    __m128 bi = _mm_movehdup_ps(vb);
+    __m128 sa = _mm_shuffle_ps(va, va, _MM_SHUFFLE(2, 3, 0, 1));
+    _mm_storeu_ps(&f[2*i], _mm_addsub_ps(_mm_mul_ps(va, br), _mm_mul_ps(sa, bi)));
+  }
+
+  // Remainder
+  multiplyScalar(nsamples - i, &a[i], &b[i], &fo[i]);
+}
+
+TARGET_AVX2
+void FrontEnd::multiplyAVX2(
+    size_t nsamples,
+    const std::complex<float>* a,
+    const std::complex<float>* b,
+    std::complex<float>* fo) {
+  const float* fa = (const float*) a;
+  const float* fb = (const float*) b;
+  float* f = (float*) fo;
+
+  // Process 4 samples at a time.
+  size_t i = 0;
+  for (; i + 4 <= nsamples; i += 4) {
+    __m256 va = _mm256_loadu_ps(&fa[2*i]);
+    __m256 vb = _mm256_loadu_ps(&fb[2*i]);
+    __m256 br = _mm256_moveldup_ps(vb);
+    __m256 bi = _mm256_movehdup_ps(vb);
+    __m256 sa = _mm256_permute_ps(va, _MM_SHUFFLE(2, 3, 0, 1));
+    _mm256_storeu_ps(&f[2*i], _mm256_addsub_ps(_mm256_mul_ps(va, br), _mm256_mul_ps(sa, bi)));
+  }
+
+  // Remainder
+  multiplyScalar(nsamples - i, &a[i], &b[i], &fo[i]);
+}
+
+// The filter only reads every other input sample, except for the
+// center tap. A register holding consecutive samples 2j and 2j + 1
+// is combined with the one holding samples 2j + 2 and 2j + 3, such
+// that it holds the input for consecutive outputs j and j + 1.
+
+TARGET_SSE41
+void FrontEnd::filterSSE41(
+    const std::vector<float>& taps,
+    const std::complex<float>* fi,
+    size_t nout,
+    std::complex<float>* fo) {
+  const size_t m = taps.size();
+  const float* x = (const float*) fi;
+  float* f = (float*) fo;
+  const __m128 half = _mm_set1_ps(0.5f);
+
+  // Process 2 outputs at a time. The final load reads one sample
+  // beyond the input for the final output, hence the extra output.
+  size_t j = 0;
+  for (; j + 3 <= nout; j += 2) {
+    const float* p = &x[4*j];
+    __m128 acc = _mm_setzero_ps();
+    for (size_t i = 0; i < m; i++) {
+      const size_t k = 2*m-1-i;
+      __m128 a = _mm_movelh_ps(
+        _mm_loadu_ps(&p[4*i]), _mm_loadu_ps(&p[4*i+4]));
+      __m128 b = _mm_movelh_ps(
+        _mm_loadu_ps(&p[4*k]), _mm_loadu_ps(&p[4*k+4]));
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(taps[i]), _mm_add_ps(a, b)));
+    }
+
+    // Center tap
+    __m128 c = _mm_movehl_ps(
+      _mm_loadu_ps(&p[4*m]), _mm_loadu_ps(&p[4*(m-1)]));
+    acc = _mm_add_ps(acc, _mm_mul_ps(half, c));
+    _mm_storeu_ps(&f[2*j], acc);
+  }
+
+  // Remainder
+  filterScalar(taps, &fi[2*j], nout - j, &fo[j]);
+}
+
+TARGET_AVX2
+void FrontEnd::filterAVX2(
+    const std::vector<float>& taps,
+    const std::complex<float>* fi,
+    size_t nout,
+    std::complex<float>* fo) {
+  const size_t m = taps.size();
+  const float* x = (const float*) fi;
+  float* f = (float*) fo;
+  const __m256 half = _mm256_set1_ps(0.5f);
+
+  // Process 4 outputs at a time. Outputs are accumulated in the order
+  // j, j + 2, j + 1, j + 3, which only takes a single unpack per load,
+  // and are put in order before they are stored. The final load reads
+  // one sample beyond the input for the final output.
+  size_t j = 0;
+  for (; j + 5 <= nout; j += 4) {
+    const float* p = &x[4*j];
+    __m256 acc = _mm256_setzero_ps();
+    for (size_t i = 0; i < m; i++) {
+      const size_t k = 2*m-1-i;
+      __m256 a = _mm256_castpd_ps(
+        _mm256_unpacklo_pd(
+          _mm256_castps_pd(_mm256_loadu_ps(&p[4*i])),
+          _mm256_castps_pd(_mm256_loadu_ps(&p[4*i+8]))));
+      __m256 b = _mm256_castpd_ps(
+        _mm256_unpacklo_pd(
+          _mm256_castps_pd(_mm256_loadu_ps(&p[4*k])),
+          _mm256_castps_pd(_mm256_loadu_ps(&p[4*k+8]))));
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(taps[i]), _mm256_add_ps(a, b)));
+    }
+
+    // Center tap
+    __m256 c = _mm256_castpd_ps(
+      _mm256_unpackhi_pd(
+        _mm256_castps_pd(_mm256_loadu_ps(&p[4*(m-1)])),
+        _mm256_castps_pd(_mm256_loadu_ps(&p[4*(m+1)]))));
+    acc = _mm256_add_ps(acc, _mm256_mul_ps(half, c));
+    acc = _mm256_castpd_ps(
+      _mm256_permute4x64_pd(_mm256_castps_pd(acc), _MM_SHUFFLE(3, 1, 2, 0)));
+    _mm256_storeu_ps(&f[2*j], acc);
+  }
+
+  // Remainder
+  filterScalar(taps, &fi[2*j], nout - j, &fo[j]);
+}
+
+#endif
+
+void FrontEnd::mix(size_t nsamples, std::complex<float>* fi) {
+  for (size_t i = 0; i < nsamples; i += CHUNK) {
+    const auto n = std::min(CHUNK, nsamples - i);
+    std::fill(phasors_.begin(), phasors_.begin() + n, std::polar(1.0, -phase_));
+    multiply(n, rotation_.data(), phasors_.data(), phasors_.data());
+    multiply(n, &fi[i], phasors_.data(), &fi[i]);
+    phase_ = fmod(phase_ + phaseStep_, 2 * M_PI);
+  }
+}
+
+size_t FrontEnd::decimate(
+    HalfBand& stage,
+    const std::complex<float>* fi,
+    size_t nsamples,
+    std::complex<float>* fo,
+    size_t multiple) {
+  const size_t ntaps = stage.size();
+  const size_t h = stage.history.size();
+
+  // Output j is computed from samples 2j up to 2j + ntaps - 1 of the
+  // history followed by the block.
+  size_t nout = 0;
+  if (h + nsamples >= ntaps) {
+    nout = (h + nsamples - ntaps) / 2 + 1;
+    nout -= nout % multiple;
+  }
+
+  // Outputs that depend on the history are computed from a joined
+  // copy, and the remaining outputs directly from the block.
+  const size_t nhead = std::min(nout, (h + 1) / 2);
+  if (nhead > 0) {
+    auto joined = stage.history.join(fi, std::min(nsamples, ntaps));
+    filter(stage.taps, joined, nhead, fo);
+  }
+  if (nout > nhead) {
+    filter(stage.taps, &fi[2 * nhead - h], nout - nhead, &fo[nhead]);
+  }
+
+  stage.history.keep(fi, nsamples, 2 * nout);
+  return nout;
+}
+
+size_t FrontEnd::work(
+    const std::shared_ptr<Queue<Samples> >& qin,
+    const std::shared_ptr<Queue<Samples> >& qout) {
+  auto input = qin->popForRead();
+  if (!input) {
+    qout->close();
+    return 0;
+  }
+
+  auto output = qout->popForWrite();
+  const auto nsamples = input->size();
+
+  // Shift in place; the input buffer is returned to the source
+  if (frequency_ != 0.0) {
+    mix(nsamples, input->data());
+  }
+
+  if (stages_.empty()) {
+    output->assign(input->begin(), input->end());
+  }
+
+  // Every stage filters the output of the previous stage
+  const std::complex<float>* fi = input->data();
+  size_t n = nsamples;
+  for (size_t i = 0; i < stages_.size(); i++) {
+    auto& stage = stages_[i];
+    const bool last = (i + 1) == stages_.size();
+    Samples& out = last ? *output : stage.output;
+    out.resize((stage.history.size() + n) / 2 + 1);
+    n = decimate(stage, fi, n, out.data(), last ? 4 : 1);
+    out.resize(n);
+    fi = out.data();
+  }
+
+  // Return input buffer
+  qin->pushRead(std::move(input));
+
+  // Publish output if applicable
+  if (samplePublisher_) {
+    samplePublisher_->publish(*output);
+  }
+
+  // Return output buffer
+  qout->pushWrite(std::move(output));
+  return nsamples;
+}
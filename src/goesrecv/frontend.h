@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "history.h"
+#include "sample_publisher.h"
+#include "simd.h"
+#include "types.h"
+
+// FrontEnd shifts the signal to the center frequency and decimates it
+// ahead of the AGC, such that the AGC, the Costas loop, and everything
+// after them only process 2 to 4 samples per symbol, regardless of the
+// sample rate of the source.
+//
+// The frequency shift is fixed. It is meant for a signal that is not
+// at the tuned frequency (e.g. to keep it away from the DC spike of
+// the SDR); the Costas loop tracks whatever offset remains.
+//
+// Decimation is done by a cascade of half-band filters that each
+// decimate by 2. The length of every filter is chosen such that the
+// signal bandwidth is passed, and everything that aliases onto it is
+// attenuated by ~60 dB. The first filters in the cascade have a wide
+// transition band and only need a few taps.
+//
+class FrontEnd {
+public:
+  // Returns the largest power of 2 decimation factor that leaves at
+  // least 2 samples per symbol, as well as a transition band for the
+  // final filter. The bandwidth is the one-sided bandwidth in Hz.
+  static int decimation(
+      uint32_t sampleRate,
+      uint32_t symbolRate,
+      double bandwidth);
+
+  // Returns the nonzero taps left of the center of a half-band filter
+  // (see HalfBand) with the specified transition band, relative to
+  // its input sample rate.
+  static std::vector<float> halfBandTaps(double transition);
+
+  // The frequency is the offset of the signal from the tuned frequency
+  // in Hz. The decimation factor must be a power of 2.
+  explicit FrontEnd(
+      uint32_t sampleRate,
+      int decimation,
+      double frequency,
+      double bandwidth);
+
+  int getDecimation() const {
+    return decimation_;
+  }
+
+  double getFrequency() const {
+    return frequency_;
+  }
+
+  // Select kernel implementation (defaults to best supported).
+  void setSIMD(SIMD simd);
+
+  SIMD getSIMD() const {
+    return simd_;
+  }
+
+  void setSamplePublisher(std::unique_ptr<SamplePublisher> samplePublisher) {
+    samplePublisher_ = std::move(samplePublisher);
+  }
+
+  // Processes a single block of samples. The number of output samples
+  // is always a multiple of 4 (see AGC); the remainder is carried
+  // over to the next block.
+  // Returns the number of samples consumed (0 if the input has closed).
+  size_t work(
+      const std::shared_ptr<Queue<Samples> >& qin,
+      const std::shared_ptr<Queue<Samples> >& qout);
+
+protected:
+  // Number of samples that a single oscillator phase is used for
+  static constexpr size_t CHUNK = 1024;
+
+  // Single decimate by 2 stage. Half of the taps of a half-band filter
+  // are zero, and the center tap is 0.5, so only the nonzero taps left
+  // of the center are stored (the filter is symmetric).
+  struct HalfBand {
+    explicit HalfBand(std::vector<float> taps);
+
+    // Number of taps of the complete filter
+    size_t size() const {
+      return 4 * taps.size() - 1;
+    }
+
+    std::vector<float> taps;
+
+    // Final samples of the previous block (zeroes initially)
+    History history;
+
+    // Output of this stage (unless it is the final stage)
+    Samples output;
+  };
+
+  // Shifts samples in place.
+  void mix(size_t nsamples, std::complex<float>* fi);
+
+  // Runs a single stage and returns the number of output samples,
+  // rounded down to a multiple of the specified number.
+  size_t decimate(
+      HalfBand& stage,
+      const std::complex<float>* fi,
+      size_t nsamples,
+      std::complex<float>* fo,
+      size_t multiple);
+
+  // Element wise complex multiplication.
+  void multiply(
+      size_t nsamples,
+      const std::complex<float>* a,
+      const std::complex<float>* b,
+      std::complex<float>* fo);
+
+  void multiplyScalar(
+      size_t nsamples,
+      const std::complex<float>* a,
+      const std::complex<float>* b,
+      std::complex<float>* fo);
+
+  // Computes nout filter outputs, where output j is computed from input
+  // samples 2j up to and including 2j + 4 * taps.size() - 2.
+  void filter(
+      const std::vector<float>& taps,
+      const std::complex<float>* fi,
+      size_t nout,
+      std::complex<float>* fo);
+
+  void filterScalar(
+      const std::vector<float>& taps,
+      const std::complex<float>* fi,
+      size_t nout,
+      std::complex<float>* fo);
+
+#ifdef SIMD_X86
+  TARGET_SSE41 void multiplySSE41(
+      size_t nsamples,
+      const std::complex<float>* a,
+      const std::complex<float>* b,
+      std::complex<float>* fo);
+
+  TARGET_AVX2 void multiplyAVX2(
+      size_t nsamples,
+      const std::complex<float>* a,
+      const std::complex<float>* b,
+      std::complex<float>* fo);
+
+  TARGET_SSE41 void filterSSE41(
+      const std::vector<float>& taps,
+      const std::complex<float>* fi,
+      size_t nout,
+      std::complex<float>* fo);
+
+  TARGET_AVX2 void filterAVX2(
+      const std::vector<float>& taps,
+      const std::complex<float>* fi,
+      size_t nout,
+      std::complex<float>* fo);
+#endif
+
+  const int decimation_;
+  const double frequency_;
+
+  SIMD simd_;
+
+  // The oscillator is evaluated for every chunk of samples, as the
+  // phase at the start of the chunk times the rotation of every
+  // sample within the chunk. Only the phase at the start of a chunk
+  // accumulates, in double precision.
+  std::vector<std::complex<float> > rotation_;
+  std::vector<std::complex<float> > phasors_;
+  double phase_;
+  double phaseStep_;
+
+  std::vector<HalfBand> stages_;
+
+  std::unique_ptr<SamplePublisher> samplePublisher_;
+};
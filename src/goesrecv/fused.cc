@@ -0,0 +1,57 @@
+#include "fused.h"
+
+#include <algorithm>
+
+#include <util/error.h>
+
+namespace {
+
+// Number of input samples per tile. Every tile buffer is 16KB, such
+// that the buffers and the filter history fit in the L1 data cache
+// of most CPUs, and comfortably in L2 on the rest.
+constexpr size_t tileSize = 2048;
+
+} // namespace
+
+Fused::Fused(AGC& agc, Costas& costas, RRC& rrc, int decimation)
+  : agc_(agc),
+    costas_(costas),
+    rrc_(rrc),
+    decimation_(decimation) {
+  // Every tile must be a multiple of 4 samples for the Costas loop
+  // and a multiple of the decimation factor for the RRC filter.
+  tileSize_ = std::max(tileSize - (tileSize % (4 * decimation)), 4 * (size_t) decimation);
+  costasTile_.resize(tileSize_);
+}
+
+size_t Fused::work(
+    const std::shared_ptr<Queue<Samples> >& qin,
+    const std::shared_ptr<Queue<Samples> >& qout) {
+  auto input = qin->popForRead();
+  if (!input) {
+    qout->close();
+    return 0;
+  }
+
+  auto output = qout->popForWrite();
+  auto nsamples = input->size();
+  ASSERT((nsamples % 4) == 0);
+  ASSERT((nsamples % decimation_) == 0);
+  output->resize(nsamples / decimation_);
+
+  // Do actual work
+  std::complex<float>* fi = input->data();
+  std::complex<float>* fo = output->data();
+  for (size_t i = 0; i < nsamples; i += tileSize_) {
+    const auto n = std::min(tileSize_, nsamples - i);
+    costas_.process(n, &fi[i], costasTile_.data(), &agc_);
+    rrc_.process(n, costasTile_.data(), &fo[i / decimation_]);
+  }
+
+  // Return input buffer
+  qin->pushRead(std::move(input));
+
+  // Return output buffer
+  qout->pushWrite(std::move(output));
+  return nsamples;
+}
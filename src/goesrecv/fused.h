@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+
+#include "agc.h"
+#include "costas.h"
+#include "rrc.h"
+#include "types.h"
+
+// Fused runs the AGC, Costas loop, and RRC filter in a single pass.
+//
+// Instead of every stage reading and writing a complete block, the
+// input block is processed in small tiles that are passed through all
+// three stages before moving on to the next tile. The intermediate
+// samples stay in cache, and only the input block and the (decimated)
+// output block are touched in memory.
+//
+// The AGC doesn't make a pass of its own: the Costas loop applies its
+// gain to every group of 4 samples as it derotates them (see
+// Costas::process). The gain updates don't depend on the loop, so
+// they run alongside its updates instead of after each other. With
+// acquisition enabled, the AGC runs separately (acquisition needs its
+// output).
+//
+// The stages keep their state, so this produces the same output as
+// running them one after the other, up to the rounding of the gain
+// update (the compiler may contract it into fused multiply-adds in
+// one kernel and not the other). Their sample publishers are not
+// called; use the separate stages if they are configured.
+//
+class Fused {
+public:
+  explicit Fused(AGC& agc, Costas& costas, RRC& rrc, int decimation);
+
+  // Processes a single block of samples.
+  // Returns the number of samples consumed (0 if the input has closed).
+  size_t work(
+      const std::shared_ptr<Queue<Samples> >& qin,
+      const std::shared_ptr<Queue<Samples> >& qout);
+
+protected:
+  AGC& agc_;
+  Costas& costas_;
+  RRC& rrc_;
+  int decimation_;
+  size_t tileSize_;
+
+  // Output of the Costas loop for a single tile
+  Samples costasTile_;
+};
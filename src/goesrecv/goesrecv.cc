@@ -1,13 +1,17 @@
+#include <pthread.h>
 #include <signal.h>
 
+#include <fstream>
 #include <iostream>
 
+#include "batch.h"
 #include "config.h"
-#include "decoder.h"
 #include "demodulator.h"
 #include "monitor.h"
 #include "options.h"
 #include "publisher.h"
+#include "receiver.h"
+#include "scheduling.h"
 
 static bool sigint = false;
 
@@ -34,14 +38,33 @@ int main(int argc, char** argv) {
     exit(1);
   }
 
-  Demodulator demod(downlinkType);
-  demod.initialize(config);
+  if (opts.autotune) {
+    Demodulator demod(downlinkType);
+    demod.autotune(config, std::cerr);
+    return 0;
+  }
+
+  if (!opts.batch.empty()) {
+    std::ofstream of(opts.batch, std::ofstream::binary);
+    if (!of.good()) {
+      std::cerr << "Unable to open " << opts.batch << std::endl;
+      exit(1);
+    }
+    Batch batch(downlinkType, config);
+    batch.run(opts.jobs, of, std::cerr);
+    return 0;
+  }
 
-  Decoder decode(demod.getSoftBitsQueue());
-  decode.initialize(config);
+  // Fails if the [threads] settings can't be applied
+  Scheduling::initialize(config.threads);
+
+  Receiver receiver(downlinkType, config);
 
   Monitor monitor(opts.verbose, opts.interval);
-  monitor.initialize(config);
+  monitor.initialize(
+    config,
+    receiver.getDemodulatorStats(),
+    receiver.getDecoderStats());
 
   // Install signal handler
   struct sigaction sa;
@@ -51,16 +74,25 @@ int main(int argc, char** argv) {
   sigaction(SIGINT, &sa, NULL);
   sigaction(SIGTERM, &sa, NULL);
 
-  demod.start();
-  decode.start();
+  // Signals are handled by the main thread only, such that pause()
+  // returns when one is caught. Threads inherit the signal mask of the
+  // thread that creates them, so block them while starting threads.
+  sigset_t mask, prev;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, &prev);
+
+  receiver.start();
   monitor.start();
 
+  pthread_sigmask(SIG_SETMASK, &prev, NULL);
+
   while (!sigint) {
     pause();
   }
 
-  demod.stop();
-  decode.stop();
+  receiver.stop();
   monitor.stop();
 
   return 0;
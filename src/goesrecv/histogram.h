@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+
+// Histogram counts values (for example nanoseconds) in buckets that
+// grow exponentially: every power of 2 is split into 4 buckets, so
+// that a percentile is accurate to within ~19%, and the full range of
+// uint64_t fits in 256 buckets.
+//
+// It has a single writer (the thread running a stage) and any number
+// of readers. Recording a value is a relaxed increment of a single
+// counter, cheap enough to do for every block. Readers take a
+// snapshot of the counters, and compute percentiles from the
+// difference between two snapshots.
+//
+class Histogram {
+public:
+  static constexpr size_t buckets = 256;
+
+  using Counts = std::array<uint64_t, buckets>;
+
+  Histogram() {
+    for (auto& count : counts_) {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void record(uint64_t value) {
+    auto& count = counts_[bucket(value)];
+    count.store(
+      count.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
+  }
+
+  Counts snapshot() const {
+    Counts out;
+    for (size_t i = 0; i < buckets; i++) {
+      out[i] = counts_[i].load(std::memory_order_relaxed);
+    }
+    return out;
+  }
+
+  // Returns the number of values counted in delta.
+  static uint64_t total(const Counts& delta) {
+    uint64_t out = 0;
+    for (const auto& count : delta) {
+      out += count;
+    }
+    return out;
+  }
+
+  // Returns the upper bound of the bucket holding the p-th fraction
+  // of the values counted in delta (0 if there are none).
+  static uint64_t percentile(const Counts& delta, double p) {
+    const uint64_t total = Histogram::total(delta);
+    if (total == 0) {
+      return 0;
+    }
+
+    const uint64_t rank = p * (total - 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets; i++) {
+      seen += delta[i];
+      if (seen > rank) {
+        return upper(i);
+      }
+    }
+    return upper(buckets - 1);
+  }
+
+  // Returns the counts of a minus the counts of b.
+  static Counts subtract(const Counts& a, const Counts& b) {
+    Counts out;
+    for (size_t i = 0; i < buckets; i++) {
+      out[i] = a[i] - b[i];
+    }
+    return out;
+  }
+
+protected:
+  // Values below 4 have a bucket of their own. Above that, the bucket
+  // is determined by the position of the most significant bit and the
+  // 2 bits that follow it.
+  static size_t bucket(uint64_t value) {
+    if (value < 4) {
+      return value;
+    }
+    const int msb = 63 - __builtin_clzll(value);
+    return (msb - 1) * 4 + ((value >> (msb - 2)) & 3);
+  }
+
+  static uint64_t upper(size_t bucket) {
+    if (bucket < 4) {
+      return bucket;
+    }
+    const int msb = bucket / 4 + 1;
+    const uint64_t base = (uint64_t) 1 << msb;
+    const uint64_t step = base / 4;
+    return base + ((bucket & 3) + 1) * step - 1;
+  }
+
+  std::array<std::atomic<uint64_t>, buckets> counts_;
+};
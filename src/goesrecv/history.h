@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <complex>
+#include <vector>
+
+// History carries the final samples of one block over to the next,
+// for stages whose output depends on samples of the previous block
+// (filters and interpolators).
+//
+// Copying every block behind the history, and moving the unused tail
+// to the front afterwards, moves every sample through memory twice
+// more. Instead, a stage only processes the samples near the start
+// of a block from a small joined copy (the history followed by the
+// first samples of the block), and the rest directly from the block.
+// Afterwards, only the tail is kept for the next block.
+//
+// The buffer grows to the size of the history plus the largest
+// joined head, after which it no longer allocates.
+//
+class History {
+public:
+  // Starts out with n zeroes as history.
+  explicit History(size_t n = 0) : size_(n), buf_(n) {
+  }
+
+  // Number of samples carried over from the previous block(s).
+  size_t size() const {
+    return size_;
+  }
+
+  // Returns the history followed by the first n samples of the block.
+  // This stays valid until the next call to join or keep.
+  std::complex<float>* join(const std::complex<float>* block, size_t n) {
+    buf_.resize(size_);
+    buf_.insert(buf_.end(), block, block + n);
+    return buf_.data();
+  }
+
+  // Keeps everything from position pos as history for the next block.
+  // The position is relative to the history followed by the complete
+  // block, as if they had been joined.
+  void keep(const std::complex<float>* block, size_t n, size_t pos) {
+    if (pos >= size_) {
+      buf_.assign(block + (pos - size_), block + n);
+    } else {
+      // Part of the current history is kept (block was short)
+      buf_.resize(size_);
+      buf_.erase(buf_.begin(), buf_.begin() + pos);
+      buf_.insert(buf_.end(), block, block + n);
+    }
+    size_ = buf_.size();
+  }
+
+protected:
+  size_t size_;
+  std::vector<std::complex<float> > buf_;
+};
@@ -1,5 +1,6 @@
 #include "monitor.h"
 
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <iostream>
@@ -7,44 +8,12 @@
 #include <sstream>
 #include <stdexcept>
 
-#include <nanomsg/nn.h>
-#include <nanomsg/pubsub.h>
-#include <nlohmann/json.hpp>
 #include <pthread.h>
 
-using namespace nlohmann;
+#include "scheduling.h"
 
 namespace {
 
-int connect(const std::string& endpoint) {
-  auto fd = nn_socket(AF_SP, NN_SUB);
-  if (fd < 0) {
-    std::stringstream ss;
-    ss << "nn_socket: " << nn_strerror(nn_errno());
-    throw std::runtime_error(ss.str());
-  }
-
-  auto rv = nn_connect(fd, endpoint.c_str());
-  if (rv < 0) {
-    nn_close(fd);
-    std::stringstream ss;
-    ss << "nn_connect: " << nn_strerror(nn_errno());
-    ss << " (" << endpoint << ")";
-    throw std::runtime_error(ss.str());
-  }
-
-  rv = nn_setsockopt(fd, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
-  if (rv < 0) {
-    nn_close(fd);
-    std::stringstream ss;
-    ss << "nn_setsockopt: " << nn_strerror(nn_errno());
-    ss << " (" << endpoint << ")";
-    throw std::runtime_error(ss.str());
-  }
-
-  return fd;
-}
-
 template <typename T>
 T sum(const std::vector<T>& vs) {
   T r = 0;
@@ -67,40 +36,20 @@ T avg(const std::vector<T>& vs) {
 Monitor::Monitor(bool verbose, std::chrono::milliseconds interval)
     : verbose_(verbose),
       interval_(interval),
+      demodulatorStats_(nullptr),
+      decoderStats_(nullptr),
       stop_(false) {
 }
 
 Monitor::~Monitor() {
 }
 
-void Monitor::initialize(Config& config) {
-  const std::string inprocPrefix = "inproc://";
-
-  // Connect to demodulator stats publisher
-  std::string demodulatorEndpoint;
-  for (const auto& endpoint : config.demodulator.statsPublisher.bind) {
-    if (endpoint.compare(0, inprocPrefix.size(), inprocPrefix) == 0) {
-      demodulatorEndpoint = endpoint;
-      break;
-    }
-  }
-  if (demodulatorEndpoint.size() == 0) {
-    throw std::runtime_error("no demodulator stats endpoint");
-  }
-  demodulatorFd_ = connect(demodulatorEndpoint);
-
-  // Connect to decoder stats publisher
-  std::string decoderEndpoint;
-  for (const auto& endpoint : config.decoder.statsPublisher.bind) {
-    if (endpoint.compare(0, inprocPrefix.size(), inprocPrefix) == 0) {
-      decoderEndpoint = endpoint;
-      break;
-    }
-  }
-  if (decoderEndpoint.size() == 0) {
-    throw std::runtime_error("no decoder stats endpoint");
-  }
-  decoderFd_ = connect(decoderEndpoint);
+void Monitor::initialize(
+    Config& config,
+    DemodulatorStats& demodulatorStats,
+    DecoderStats& decoderStats) {
+  demodulatorStats_ = &demodulatorStats;
+  decoderStats_ = &decoderStats;
 
   // Create statsd socket if one is configured
   const auto& statsdAddress = config.monitor.statsdAddress;
@@ -110,14 +59,17 @@ void Monitor::initialize(Config& config) {
 }
 
 void Monitor::loop() {
-  struct nn_pollfd pfd[2];
-  pfd[0].fd = demodulatorFd_;
-  pfd[0].events = NN_POLLIN;
-  pfd[1].fd = decoderFd_;
-  pfd[1].events = NN_POLLIN;
+  Scheduling::apply("monitor");
+
+  // The demodulator and decoder keep their stats in fixed size rings,
+  // which are drained this often
+  const auto tick = std::min(interval_, std::chrono::milliseconds(100));
 
   auto start = std::chrono::steady_clock::now();
   while (!stop_) {
+    std::this_thread::sleep_for(tick);
+    process();
+
     auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(
       std::chrono::steady_clock::now() - start);
     if (delta >= interval_) {
@@ -127,103 +79,130 @@ void Monitor::loop() {
         print(tmp);
       }
       start += interval_;
-      continue;
-    }
-
-    const auto timeout = (interval_ - delta).count() + 1;
-    auto rv = nn_poll(pfd, 2, timeout);
-    if (rv == 0) {
-      continue;
     }
+  }
+}
 
-    for (auto i = 0; i < 2; i++) {
-      if (!(pfd[i].revents & NN_POLLIN)) {
-        continue;
-      }
+void Monitor::process() {
+  DemodulatorStats::Sample sample;
+  while (demodulatorStats_->samples.pop(sample)) {
+    process(sample);
+  }
 
-      char* buf = nullptr;
-      rv = nn_recv(pfd[i].fd, &buf, NN_MSG, 0);
-      if (rv < 0) {
-        // Either fd is closed; terminate
-        return;
-      }
+  for (const auto& report : demodulatorStats_->popReports()) {
+    process(report);
+  }
 
-      process(std::string(buf, rv));
+  DecoderStats::Packet packet;
+  while (decoderStats_->packets.pop(packet)) {
+    process(packet);
+  }
 
-      // Processed message; free nanomsg buffer
-      nn_freemsg(buf);
-    }
+  if (statsd_ && statsdPayload_.tellp() > 0) {
+    statsd_->send(statsdPayload_.str());
   }
+  statsdPayload_.str("");
 }
 
-void Monitor::process(const std::string& json) {
-  std::string error;
-  auto data = json::parse(json);
-  if (!error.empty()) {
-    throw new std::runtime_error(error);
-  }
+void Monitor::process(const DemodulatorStats::Sample& sample) {
+  auto& statsd = statsdPayload_;
+  stats_.gain.push_back(sample.gain);
+  statsd << "gain:" << sample.gain << "|g" << std::endl;
 
-  // Accumulate statsd compatible payload
-  std::stringstream statsd;
+  stats_.frequency.push_back(sample.frequency);
+  // First set to 0 to support negative values.
+  // See: https://github.com/etsy/statsd/blob/master/docs/metric_types.md#gauges
+  statsd << "frequency:0|g" << std::endl;
+  statsd << "frequency:" << sample.frequency << "|g" << std::endl;
 
-  for (json::iterator it = data.begin(); it != data.end(); ++it) {
-    const auto& key = it.key();
-    const auto& value = it.value();
+  stats_.omega.push_back(sample.omega);
+  statsd << "omega:" << sample.omega << "|g" << std::endl;
+  flush();
+}
 
-    if (key == "gain") {
-      stats_.gain.push_back(value.get<double>());
-      statsd << key << ":" << value.get<double>() << "|g" << std::endl;
-      continue;
-    }
+void Monitor::process(const DemodulatorStats::Report& report) {
+  auto& statsd = statsdPayload_;
+  for (const auto& stage : report.stages) {
+    const auto prefix = "stage." + stage.name + ".";
+    statsd << prefix << "throughput:" << stage.throughput << "|g" << std::endl;
+    statsd << prefix << "load:" << stage.load << "|g" << std::endl;
+    statsd << prefix << "rate:" << stage.rate << "|g" << std::endl;
+    statsd << prefix << "input_wait:" << stage.inputWait << "|g" << std::endl;
+    statsd << prefix << "output_wait:" << stage.outputWait << "|g" << std::endl;
+    statsd << prefix << "block_size:" << stage.blockSize << "|g" << std::endl;
+
+    // Block time in milliseconds, like statsd timers
+    statsd << prefix << "block_time.p50:" << 1e3 * stage.blockTimeP50 << "|g" << std::endl;
+    statsd << prefix << "block_time.p90:" << 1e3 * stage.blockTimeP90 << "|g" << std::endl;
+    statsd << prefix << "block_time.p99:" << 1e3 * stage.blockTimeP99 << "|g" << std::endl;
+    statsd << prefix << "block_time.max:" << 1e3 * stage.blockTimeMax << "|g" << std::endl;
+    statsd << prefix << "queue_depth.mean:" << stage.depthMean << "|g" << std::endl;
+    statsd << prefix << "queue_depth.max:" << stage.depthMax << "|g" << std::endl;
+    flush();
+  }
 
-    if (key == "frequency") {
-      stats_.frequency.push_back(value.get<double>());
-      // First set to 0 to support negative values.
-      // See: https://github.com/etsy/statsd/blob/master/docs/metric_types.md#gauges
-      statsd << key << ":0|g" << std::endl;
-      statsd << key << ":" << value.get<double>() << "|g" << std::endl;
-      continue;
-    }
+  // Latency in milliseconds, like the block time
+  statsd << "source.block_duration:" << 1e3 * report.blockDuration << "|g" << std::endl;
+  statsd << "latency:" << 1e3 * report.latency << "|g" << std::endl;
+
+  // Signal quality (see Quality)
+  const auto& quality = report.quality;
+  if (quality.symbols > 0) {
+    stats_.snr.push_back(quality.snr);
+    statsd << "quality.snr:0|g" << std::endl;
+    statsd << "quality.snr:" << quality.snr << "|g" << std::endl;
+    statsd << "quality.evm:" << quality.evm << "|g" << std::endl;
+    statsd << "quality.evm_peak:" << quality.evmPeak << "|g" << std::endl;
+  }
 
-    if (key == "omega") {
-      stats_.omega.push_back(value.get<double>());
-      statsd << key << ":" << value.get<double>() << "|g" << std::endl;
-      continue;
-    }
+  stats_.overflowSamples += report.droppedSamples;
+  stats_.overflowBlocks += report.droppedBlocks;
+  statsd << "source.dropped_samples:" << report.droppedSamples << "|c" << std::endl;
+  statsd << "source.dropped_blocks:" << report.droppedBlocks << "|c" << std::endl;
 
-    if (key == "viterbi_errors") {
-      stats_.viterbiErrors.push_back(value.get<int>());
-      statsd << key << ":" << value.get<int>() << "|h" << std::endl;
-      continue;
-    }
+  stats_.stalls += report.stalls;
+  stats_.stallTime += report.stallTime;
+  statsd << "source.stalls:" << report.stalls << "|c" << std::endl;
+  if (report.stalls > 0) {
+    statsd << "source.stall_time:" << (report.stallTime * 1000.0) << "|ms" << std::endl;
+  }
 
-    if (key == "reed_solomon_errors") {
-      const auto& v = value.get<int>();
-      if (v >= 0) {
-        stats_.reedSolomonErrors.push_back(v);
-        statsd << key << ":" << v << "|h" << std::endl;
-      }
-      continue;
-    }
+  stats_.disconnects += report.disconnects;
+  statsd << "source.disconnects:" << report.disconnects << "|c" << std::endl;
+  flush();
+}
 
-    if (key == "ok") {
-      const auto& ok = value.get<int>();
-      if (ok != 0) {
-        stats_.totalOK++;
-        statsd << "packets_ok:1|c" << std::endl;
-        statsd << "packets_dropped:0|c" << std::endl;
-      } else {
-        stats_.totalDropped++;
-        statsd << "packets_ok:0|c" << std::endl;
-        statsd << "packets_dropped:1|c" << std::endl;
-      }
-      continue;
-    }
+void Monitor::process(const DecoderStats::Packet& packet) {
+  auto& statsd = statsdPayload_;
+  stats_.viterbiErrors.push_back(packet.viterbiErrors);
+  statsd << "viterbi_errors:" << packet.viterbiErrors << "|h" << std::endl;
+
+  if (packet.reedSolomonErrors >= 0) {
+    stats_.reedSolomonErrors.push_back(packet.reedSolomonErrors);
+    statsd << "reed_solomon_errors:" << packet.reedSolomonErrors << "|h" << std::endl;
+  }
+
+  if (packet.ok) {
+    stats_.totalOK++;
+    statsd << "packets_ok:1|c" << std::endl;
+    statsd << "packets_dropped:0|c" << std::endl;
+  } else {
+    stats_.totalDropped++;
+    statsd << "packets_ok:0|c" << std::endl;
+    statsd << "packets_dropped:1|c" << std::endl;
   }
+  flush();
+}
 
+void Monitor::flush() {
+  // Keep datagrams below a typical MTU
+  if (statsdPayload_.tellp() < 1024) {
+    return;
+  }
   if (statsd_) {
-    statsd_->send(statsd.str());
+    statsd_->send(statsdPayload_.str());
   }
+  statsdPayload_.str("");
 }
 
 void Monitor::print(const Stats& stats) {
@@ -262,6 +241,32 @@ void Monitor::print(const Stats& stats) {
   ss << "drops: "
      << std::setw(packetWidth)
      << stats.totalDropped;
+
+  // Estimated once per second (see Quality)
+  if (!stats.snr.empty()) {
+    ss << ", snr: "
+       << std::setprecision(1) << std::setw(4)
+       << avg(stats.snr);
+  }
+
+  // Only shown if the source dropped samples (see source_overflow)
+  if (stats.overflowBlocks > 0) {
+    ss << ", overflow: "
+       << stats.overflowBlocks << " blocks ("
+       << stats.overflowSamples << " samples)";
+  }
+
+  // Only shown if a network source stalled (see RTLTCP)
+  if (stats.stalls > 0) {
+    ss << ", stalls: "
+       << stats.stalls << " ("
+       << std::setprecision(2) << stats.stallTime << "s)";
+  }
+
+  // Only shown if a network source lost its connection (see RTLTCP)
+  if (stats.disconnects > 0) {
+    ss << ", disconnects: " << stats.disconnects;
+  }
   std::cout << ss.str() << std::endl;
 }
 
@@ -275,8 +280,6 @@ void Monitor::start() {
 }
 
 void Monitor::stop() {
-  nn_close(demodulatorFd_);
-  nn_close(decoderFd_);
   stop_ = true;
 
   // Wait for thread to terminate
@@ -3,17 +3,23 @@
 #include <atomic>
 #include <chrono>
 #include <memory>
+#include <sstream>
 #include <thread>
 
 #include "config.h"
 #include "datagram_socket.h"
+#include "stats.h"
 
 class Monitor {
 public:
   explicit Monitor(bool verbose, std::chrono::milliseconds interval);
   ~Monitor();
 
-  void initialize(Config& config);
+  // The monitor reads the stats of a single demodulator and decoder.
+  void initialize(
+      Config& config,
+      DemodulatorStats& demodulatorStats,
+      DecoderStats& decoderStats);
 
   void start();
   void stop();
@@ -24,27 +30,42 @@ protected:
     std::vector<float> gain;
     std::vector<float> frequency;
     std::vector<float> omega;
+    std::vector<float> snr;
 
     // Decoder stats
     std::vector<int> viterbiErrors;
     std::vector<int> reedSolomonErrors;
     int totalOK = 0;
     int totalDropped = 0;
+
+    // Source stats
+    uint64_t overflowSamples = 0;
+    uint64_t overflowBlocks = 0;
+    uint64_t stalls = 0;
+    double stallTime = 0.0;
+    uint64_t disconnects = 0;
   };
 
   Stats stats_;
 
   void loop();
-  void process(const std::string& json);
+  void process();
+  void process(const DemodulatorStats::Sample& sample);
+  void process(const DemodulatorStats::Report& report);
+  void process(const DecoderStats::Packet& packet);
+  void flush();
   void print(const Stats& stats);
 
   const bool verbose_;
   const std::chrono::milliseconds interval_;
 
-  int demodulatorFd_;
-  int decoderFd_;
+  DemodulatorStats* demodulatorStats_;
+  DecoderStats* decoderStats_;
   std::unique_ptr<DatagramSocket> statsd_;
 
+  // Accumulates statsd compatible payload
+  std::stringstream statsdPayload_;
+
   std::atomic<bool> stop_;
   std::thread thread_;
 };
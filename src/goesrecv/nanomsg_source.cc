@@ -7,6 +7,9 @@
 #include <nanomsg/nn.h>
 #include <nanomsg/pubsub.h>
 
+#include "convert.h"
+#include "scheduling.h"
+
 std::unique_ptr<Nanomsg> Nanomsg::open(const Config& config) {
   int rv;
 
@@ -65,6 +68,8 @@ uint32_t Nanomsg::getSampleRate() const {
 }
 
 void Nanomsg::loop() {
+  Scheduling::apply("source");
+
   void* buf = nullptr;
   int nbytes;
   for (;;) {
@@ -79,16 +84,16 @@ void Nanomsg::loop() {
     // Expect multiple of 4
     ASSERT((nsamples & 0x3) == 0);
 
-    // Grab buffer from queue
-    auto out = queue_->popForWrite();
+    // Grab buffer from queue (or drop the samples on overflow)
+    auto out = popForWrite(*queue_, nsamples);
+    if (!out) {
+      nn_freemsg(buf);
+      continue;
+    }
     out->resize(nsamples);
 
     // Convert to std::complex<float>
-    auto fo = out->data();
-    for (uint32_t i = 0; i < nsamples; i++) {
-      fo[i].real((float) fi[i*2+0] / 127.0f);
-      fo[i].imag((float) fi[i*2+1] / 127.0f);
-    }
+    convertS8(simd_, nsamples, fi, out->data());
 
     // Processed samples; free nanomsg buffer
     nn_freemsg(buf);
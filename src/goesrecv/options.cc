@@ -17,6 +17,13 @@ void usage(int argc, char** argv) {
   fprintf(stderr, "  -c, --config PATH          Path to configuration file\n");
   fprintf(stderr, "  -v, --verbose              Periodically show statistics\n");
   fprintf(stderr, "  -i, --interval SEC         Interval for --verbose\n");
+  fprintf(stderr, "      --autotune             Benchmark DSP kernels, write result to\n");
+  fprintf(stderr, "                             the configured autotune_file, and exit\n");
+  fprintf(stderr, "      --batch PATH           Demodulate and decode the recording of\n");
+  fprintf(stderr, "                             the file source in parallel chunks,\n");
+  fprintf(stderr, "                             write packets to PATH, and exit\n");
+  fprintf(stderr, "  -j, --jobs N               Number of threads for --batch\n");
+  fprintf(stderr, "                             (default: number of cores)\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Other:\n");
   fprintf(stderr, "      --help     Display this help and exit\n");
@@ -33,12 +40,15 @@ Options parseOptions(int argc, char** argv) {
       {"config",   required_argument, nullptr, 'c'},
       {"verbose",  no_argument,       nullptr, 'v'},
       {"interval", required_argument, nullptr, 'i'},
+      {"autotune", no_argument,       nullptr, 0x1001},
+      {"batch",    required_argument, nullptr, 0x1002},
+      {"jobs",     required_argument, nullptr, 'j'},
       {"help",     no_argument,       nullptr, 0x1337},
       {"version",  no_argument,       nullptr, 0x1338},
       {nullptr,    0,                 nullptr, 0},
     };
 
-    auto c = getopt_long(argc, argv, "c:vi:", longOpts, nullptr);
+    auto c = getopt_long(argc, argv, "c:vi:j:", longOpts, nullptr);
     if (c == -1) {
       break;
     }
@@ -55,6 +65,15 @@ Options parseOptions(int argc, char** argv) {
     case 'i':
       opts.interval = std::chrono::milliseconds((int) (1000 * atof(optarg)));
       break;
+    case 0x1001:
+      opts.autotune = true;
+      break;
+    case 0x1002:
+      opts.batch = optarg;
+      break;
+    case 'j':
+      opts.jobs = atoi(optarg);
+      break;
     case 0x1337:
       usage(argc, argv);
       break;
@@ -7,6 +7,11 @@ struct Options {
   std::string config;
   bool verbose;
   std::chrono::milliseconds interval;
+  bool autotune = false;
+
+  // Batch mode: path to write packets to, and number of threads
+  std::string batch;
+  int jobs = 0;
 };
 
 Options parseOptions(int argc, char** argv);
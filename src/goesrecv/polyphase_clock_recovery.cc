@@ -0,0 +1,104 @@
+#include "polyphase_clock_recovery.h"
+
+#include "rrc.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+PolyphaseClockRecovery::PolyphaseClockRecovery(
+    uint32_t sampleRate,
+    uint32_t symbolRate)
+  : ClockRecovery(sampleRate, symbolRate, NTAPS, NFILTS) {
+  const double sps = (double) sampleRate / (double) symbolRate;
+  auto prototype = RRC::design(NFILTS * sps, NFILTS * NTAPS);
+
+  // The prototype is normalized to unit gain, so every one of the
+  // sub-filters has a gain of 1/NFILTS. Tap j of sub-filter k is
+  // multiplied with sample i+j to compute the output at i+k/NFILTS
+  // (plus a constant delay), so it is found at index k, counting
+  // backwards from the end of the prototype in steps of NFILTS.
+  taps_.resize((NFILTS + 1) * NTAPS * 2);
+  for (int k = 0; k <= NFILTS; k++) {
+    for (int j = 0; j < NTAPS; j++) {
+      const int n = NFILTS * (NTAPS - 1 - j) + k;
+      const float tap = (n < NFILTS * NTAPS) ? NFILTS * prototype[n] : 0.0f;
+      taps_[(k * NTAPS + j) * 2 + 0] = tap;
+      taps_[(k * NTAPS + j) * 2 + 1] = tap;
+    }
+  }
+}
+
+size_t PolyphaseClockRecovery::work(
+    const std::complex<float>* fi,
+    size_t i,
+    size_t nsamples,
+    Samples& output) {
+  switch (simd_) {
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+  case SIMD::AVX2:
+    // Sums must be identical to the scalar implementation; wider
+    // registers would make the compiler contract them into FMAs.
+    return filterSSE41(fi, i, nsamples, output);
+#endif
+  default:
+    return filterScalar(fi, i, nsamples, output);
+  }
+}
+
+// The products of taps and samples are summed in 4 partial sums, in
+// the same order as the vectorized implementation, such that both
+// produce identical output (see ClockRecovery).
+size_t PolyphaseClockRecovery::filterScalar(
+    const std::complex<float>* fi,
+    size_t i,
+    size_t nsamples,
+    Samples& output) {
+  int index;
+  while (next(i, nsamples, index)) {
+    const float* taps = &taps_[index * NTAPS * 2];
+    const std::complex<float>* s = &fi[i];
+    std::complex<float> acc[4];
+    for (int j = 0; j < NTAPS; j += 4) {
+      for (int k = 0; k < 4; k++) {
+        acc[k] += taps[(j + k) * 2] * s[j + k];
+      }
+    }
+
+    update((acc[0] + acc[2]) + (acc[1] + acc[3]), output);
+  }
+
+  return i;
+}
+
+#ifdef SIMD_X86
+
+TARGET_SSE41
+size_t PolyphaseClockRecovery::filterSSE41(
+    const std::complex<float>* fi,
+    size_t i,
+    size_t nsamples,
+    Samples& output) {
+  int index;
+  while (next(i, nsamples, index)) {
+    const float* taps = &taps_[index * NTAPS * 2];
+    const float* f = (const float*) &fi[i];
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int j = 0; j < 2 * NTAPS; j += 8) {
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&f[j + 0]), _mm_loadu_ps(&taps[j + 0])));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(&f[j + 4]), _mm_loadu_ps(&taps[j + 4])));
+    }
+
+    __m128 acc = _mm_add_ps(acc0, acc1);
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    std::complex<float> out;
+    _mm_storel_pi((__m64*) &out, acc);
+    update(out, output);
+  }
+
+  return i;
+}
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "clock_recovery.h"
+
+// PolyphaseClockRecovery combines the RRC matched filter with the
+// fractional delay interpolator of the clock recovery.
+//
+// The RRC filter is designed at NFILTS times the sample rate and split
+// into NFILTS sub-filters, each of which is the matched filter for a
+// different fractional delay. The timing loop is the same as that of
+// ClockRecovery, but instead of interpolating between samples that
+// have already been filtered, it runs the sub-filter for the current
+// fractional delay directly on the unfiltered samples. The filter is
+// therefore only evaluated once per symbol instead of once per sample.
+//
+// It takes the place of both the RRC filter and ClockRecovery, and
+// runs at the full sample rate (no decimation).
+//
+class PolyphaseClockRecovery : public ClockRecovery {
+public:
+  // Number of sub-filters (fractional delays)
+  static constexpr int NFILTS = 64;
+
+  // Number of taps per sub-filter; the same span as the RRC filter
+  static constexpr int NTAPS = 32;
+
+  explicit PolyphaseClockRecovery(uint32_t sampleRate, uint32_t symbolRate);
+
+  using ClockRecovery::work;
+
+protected:
+  size_t work(
+      const std::complex<float>* fi,
+      size_t i,
+      size_t nsamples,
+      Samples& output) override;
+
+  size_t filterScalar(
+      const std::complex<float>* fi,
+      size_t i,
+      size_t nsamples,
+      Samples& output);
+
+#ifdef SIMD_X86
+  TARGET_SSE41 size_t filterSSE41(
+      const std::complex<float>* fi,
+      size_t i,
+      size_t nsamples,
+      Samples& output);
+#endif
+
+  // Sub-filter taps, with every tap repeated twice such that they can
+  // be multiplied with interleaved complex samples directly.
+  // There are NFILTS + 1 sub-filters, the last one being the first
+  // one delayed by one sample, such that mu = 1.0 is covered.
+  std::vector<float> taps_;
+};
@@ -50,6 +50,10 @@ void Publisher::setSendBuffer(int size) {
 }
 
 bool Publisher::hasSubscribers() {
+  if (fd_ < 0) {
+    return false;
+  }
+
   uint32_t subs = (uint32_t) nn_get_statistic(fd_, NN_STAT_CURRENT_CONNECTIONS);
   return subs > 0;
 }
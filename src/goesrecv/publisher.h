@@ -4,6 +4,8 @@
 #include <memory>
 #include <vector>
 
+#include "shm_ring.h"
+
 class Publisher {
 public:
   static int bind(const std::vector<std::string>& endpoints);
@@ -15,13 +17,25 @@ public:
 
   static std::unique_ptr<Publisher> create(const std::string& endpoint);
 
+  // The file descriptor is -1 if the publisher only has a ring.
   explicit Publisher(int fd);
   virtual ~Publisher();
 
   void setSendBuffer(int size);
 
+  // Also publish to a shared memory ring for local readers
+  // (only supported by the sample and soft bit publishers).
+  void setRing(std::unique_ptr<ShmRing> ring) {
+    ring_ = std::move(ring);
+  }
+
   bool hasSubscribers();
 
 protected:
+  bool hasRingReaders() const {
+    return ring_ && ring_->hasReaders();
+  }
+
   int fd_;
+  std::unique_ptr<ShmRing> ring_;
 };
@@ -0,0 +1,182 @@
+#include "quality.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <util/error.h>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Symbols counted in the histogram and peak EVM
+constexpr size_t decimation = 16;
+
+// Upper limit of the SNR estimate (dB). The sums are accumulated in
+// single precision per block, so a smaller error is rounding noise.
+// Without any error at all (e.g. a synthetic signal), the SNR is
+// reported as this limit.
+constexpr double maxSNR = 60.0;
+
+} // namespace
+
+Quality::Quality()
+    : symbols_(0),
+      abs_(0.0),
+      re2_(0.0),
+      im2_(0.0),
+      peak_(0.0f),
+      constellation_(),
+      next_(0) {
+  simd_ = simdBest();
+}
+
+void Quality::setSIMD(SIMD simd) {
+  ASSERT(simdSupported(simd));
+  simd_ = simd;
+}
+
+Quality::Sums Quality::sum(size_t nsamples, const std::complex<float>* fi) {
+  switch (simd_) {
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+    return sumSSE41(nsamples, fi);
+  case SIMD::AVX2:
+    return sumAVX2(nsamples, fi);
+#endif
+  default:
+    // There is no NEON specific implementation.
+    return sumScalar(nsamples, fi);
+  }
+}
+
+Quality::Sums Quality::sumScalar(size_t nsamples, const std::complex<float>* fi) {
+  Sums out;
+  for (size_t i = 0; i < nsamples; i++) {
+    const auto re = fi[i].real();
+    const auto im = fi[i].imag();
+    out.abs += fabsf(re);
+    out.re2 += re * re;
+    out.im2 += im * im;
+  }
+  return out;
+}
+
+#ifdef SIMD_X86
+
+// Every vector holds interleaved real and imaginary parts. The absolute
+// value and square of all of them are accumulated, and the lanes are
+// separated at the end (the absolute values of the imaginary parts are
+// not used).
+
+TARGET_SSE41
+Quality::Sums Quality::sumSSE41(size_t nsamples, const std::complex<float>* fi) {
+  const float* f = (const float*) fi;
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 abs = _mm_setzero_ps();
+  __m128 sq = _mm_setzero_ps();
+
+  // Process 2 samples at a time
+  size_t i = 0;
+  for (; i + 2 <= nsamples; i += 2) {
+    __m128 v = _mm_loadu_ps(&f[2 * i]);
+    abs = _mm_add_ps(abs, _mm_andnot_ps(sign, v));
+    sq = _mm_add_ps(sq, _mm_mul_ps(v, v));
+  }
+
+  alignas(16) float a[4];
+  alignas(16) float s[4];
+  _mm_store_ps(a, abs);
+  _mm_store_ps(s, sq);
+
+  // Remainder
+  auto out = sumScalar(nsamples - i, &fi[i]);
+  out.abs += a[0] + a[2];
+  out.re2 += s[0] + s[2];
+  out.im2 += s[1] + s[3];
+  return out;
+}
+
+TARGET_AVX2
+Quality::Sums Quality::sumAVX2(size_t nsamples, const std::complex<float>* fi) {
+  const float* f = (const float*) fi;
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 abs = _mm256_setzero_ps();
+  __m256 sq = _mm256_setzero_ps();
+
+  // Process 4 samples at a time
+  size_t i = 0;
+  for (; i + 4 <= nsamples; i += 4) {
+    __m256 v = _mm256_loadu_ps(&f[2 * i]);
+    abs = _mm256_add_ps(abs, _mm256_andnot_ps(sign, v));
+    sq = _mm256_fmadd_ps(v, v, sq);
+  }
+
+  alignas(32) float a[8];
+  alignas(32) float s[8];
+  _mm256_store_ps(a, abs);
+  _mm256_store_ps(s, sq);
+
+  // Remainder
+  auto out = sumScalar(nsamples - i, &fi[i]);
+  out.abs += (a[0] + a[2]) + (a[4] + a[6]);
+  out.re2 += (s[0] + s[2]) + (s[4] + s[6]);
+  out.im2 += (s[1] + s[3]) + (s[5] + s[7]);
+  return out;
+}
+
+#endif
+
+void Quality::work(size_t nsamples, const std::complex<float>* fi) {
+  const auto sums = sum(nsamples, fi);
+  symbols_ += nsamples;
+  abs_ += sums.abs;
+  re2_ += sums.re2;
+  im2_ += sums.im2;
+  if (symbols_ == 0 || abs_ <= 0.0) {
+    return;
+  }
+
+  // Amplitude so far, to place the decimated symbols
+  const float a = abs_ / symbols_;
+  const float scale = bins / (4.0f * a);
+  for (; next_ < nsamples; next_ += decimation) {
+    const auto s = fi[next_];
+    const auto re = s.real();
+    const auto im = s.imag();
+    const auto e = std::complex<float>(re - copysignf(a, re), im);
+    peak_ = std::max(peak_, std::norm(e));
+
+    auto x = (int) floorf((re + 2.0f * a) * scale);
+    auto y = (int) floorf((im + 2.0f * a) * scale);
+    x = std::min(std::max(x, 0), bins - 1);
+    y = std::min(std::max(y, 0), bins - 1);
+    constellation_[y * bins + x]++;
+  }
+  next_ -= nsamples;
+}
+
+Quality::Report Quality::report() {
+  Report out;
+  out.symbols = symbols_;
+  if (symbols_ > 0 && abs_ > 0.0) {
+    const double n = symbols_;
+    const double a = abs_ / n;
+    const double err = std::max(0.0, re2_ / n - a * a + im2_ / n);
+    out.amplitude = a;
+    out.snr = (err > 0.0) ? std::min(maxSNR, 10.0 * log10((a * a) / err)) : maxSNR;
+    out.evm = sqrt(err) / a;
+    out.evmPeak = sqrt(peak_) / a;
+    out.constellation = constellation_;
+  }
+
+  symbols_ = 0;
+  abs_ = 0.0;
+  re2_ = 0.0;
+  im2_ = 0.0;
+  peak_ = 0.0f;
+  constellation_.fill(0);
+  return out;
+}
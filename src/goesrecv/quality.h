@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <complex>
+
+#include "simd.h"
+
+// Quality estimates the SNR and error vector magnitude (EVM) of the
+// symbols after clock recovery, such that signal quality can be
+// monitored without streaming every symbol to an external tool.
+//
+// The estimate is decision directed. Every BPSK symbol s is compared
+// with the nearest ideal symbol d = sign(Re(s)) * A, where A is the
+// mean of |Re(s)|. The error vector is e = s - d, and:
+//
+//   |e|^2 summed = sum Re(s)^2 - 2A sum |Re(s)| + N A^2 + sum Im(s)^2
+//
+// so the RMS EVM (and SNR) follow from three sums that are computed in
+// a single vectorized pass. Every 16th symbol is also counted in a
+// histogram of the constellation, and contributes to the peak EVM.
+//
+// At low SNR, decisions are occasionally wrong, which underestimates
+// the error (the SNR estimate is biased high below ~3 dB).
+//
+class Quality {
+public:
+  // Bins per dimension of the constellation histogram, which spans
+  // [-2A, 2A] in both dimensions
+  static constexpr int bins = 32;
+
+  struct Report {
+    uint64_t symbols = 0;
+
+    // Mean amplitude of the real part (A)
+    float amplitude = 0.0f;
+
+    // Ratio of A^2 to the mean squared error vector (dB, at most 60)
+    float snr = 0.0f;
+
+    // RMS and peak error vector magnitude, relative to A
+    float evm = 0.0f;
+    float evmPeak = 0.0f;
+
+    // Counts of the decimated symbols, row major (imaginary part
+    // first, from -2A to 2A). Symbols outside the range are clamped.
+    std::array<uint32_t, bins * bins> constellation = {};
+  };
+
+  explicit Quality();
+
+  // Select kernel implementation (defaults to best supported).
+  void setSIMD(SIMD simd);
+
+  SIMD getSIMD() const {
+    return simd_;
+  }
+
+  // Accumulates a block of symbols.
+  void work(size_t nsamples, const std::complex<float>* fi);
+
+  // Returns the estimate for the symbols since the previous report,
+  // and starts over. Must be called from the thread calling work.
+  Report report();
+
+protected:
+  struct Sums {
+    float abs = 0.0f;
+    float re2 = 0.0f;
+    float im2 = 0.0f;
+  };
+
+  Sums sum(size_t nsamples, const std::complex<float>* fi);
+  Sums sumScalar(size_t nsamples, const std::complex<float>* fi);
+
+#ifdef SIMD_X86
+  TARGET_SSE41 Sums sumSSE41(size_t nsamples, const std::complex<float>* fi);
+  TARGET_AVX2 Sums sumAVX2(size_t nsamples, const std::complex<float>* fi);
+#endif
+
+  SIMD simd_;
+
+  // Totals since the previous report
+  uint64_t symbols_;
+  double abs_;
+  double re2_;
+  double im2_;
+  float peak_;
+  std::array<uint32_t, bins * bins> constellation_;
+
+  // Position of the next decimated symbol in the next block
+  size_t next_;
+};
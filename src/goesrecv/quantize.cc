@@ -1,29 +1,142 @@
 #include "quantize.h"
 
+#include <algorithm>
+
+#include <util/error.h>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
 Quantize::Quantize() {
+  simd_ = simdBest();
+}
+
+void Quantize::setSIMD(SIMD simd) {
+  ASSERT(simdSupported(simd));
+  simd_ = simd;
+  quality_.setSIMD(simd);
 }
 
 void Quantize::work(
+    size_t nsamples,
+    const std::complex<float>* fi,
+    int8_t* fo) {
+  switch (simd_) {
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+    workSSE41(nsamples, fi, fo);
+    break;
+  case SIMD::AVX2:
+    workAVX2(nsamples, fi, fo);
+    break;
+#endif
+  default:
+    // There is no NEON specific implementation.
+    workScalar(nsamples, fi, fo);
+    break;
+  }
+}
+
+void Quantize::workScalar(
+    size_t nsamples,
+    const std::complex<float>* fi,
+    int8_t* fo) {
+  for (size_t i = 0; i < nsamples; i++) {
+    // Saturate like the vectorized implementations do
+    float v = fi[i].real() * 127.0f;
+    v = std::max(v, -128.0f);
+    v = std::min(v, 127.0f);
+    fo[i] = (int8_t) v;
+  }
+}
+
+#ifdef SIMD_X86
+
+// Only the real part of every sample is used. It is scaled, truncated
+// to a 32 bit integer, and narrowed to 8 bits with saturation.
+
+TARGET_SSE41
+void Quantize::workSSE41(
+    size_t nsamples,
+    const std::complex<float>* fi,
+    int8_t* fo) {
+  const float* f = (const float*) fi;
+  const __m128 scale = _mm_set1_ps(127.0f);
+
+  // Process 16 samples at a time
+  size_t i = 0;
+  for (; i + 16 <= nsamples; i += 16) {
+    __m128i v[4];
+    for (size_t j = 0; j < 4; j++) {
+      __m128 lo = _mm_loadu_ps(&f[2 * i + 8 * j + 0]);
+      __m128 hi = _mm_loadu_ps(&f[2 * i + 8 * j + 4]);
+      __m128 re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+      v[j] = _mm_cvttps_epi32(_mm_mul_ps(re, scale));
+    }
+    __m128i a = _mm_packs_epi32(v[0], v[1]);
+    __m128i b = _mm_packs_epi32(v[2], v[3]);
+    _mm_storeu_si128((__m128i*) &fo[i], _mm_packs_epi16(a, b));
+  }
+
+  // Remainder
+  workScalar(nsamples - i, &fi[i], &fo[i]);
+}
+
+TARGET_AVX2
+void Quantize::workAVX2(
+    size_t nsamples,
+    const std::complex<float>* fi,
+    int8_t* fo) {
+  const float* f = (const float*) fi;
+  const __m256 scale = _mm256_set1_ps(127.0f);
+
+  // Extracting the real parts within 128 bit lanes leaves them in
+  // order 0, 1, 4, 5, 2, 3, 6, 7. Packing does the same to 32 bit
+  // groups of the result. Both are undone with a permutation.
+  const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+  const __m256i unpack = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  // Process 32 samples at a time
+  size_t i = 0;
+  for (; i + 32 <= nsamples; i += 32) {
+    __m256i v[4];
+    for (size_t j = 0; j < 4; j++) {
+      __m256 lo = _mm256_loadu_ps(&f[2 * i + 16 * j + 0]);
+      __m256 hi = _mm256_loadu_ps(&f[2 * i + 16 * j + 8]);
+      __m256 re = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+      re = _mm256_permutevar8x32_ps(re, order);
+      v[j] = _mm256_cvttps_epi32(_mm256_mul_ps(re, scale));
+    }
+    __m256i a = _mm256_packs_epi32(v[0], v[1]);
+    __m256i b = _mm256_packs_epi32(v[2], v[3]);
+    __m256i c = _mm256_permutevar8x32_epi32(_mm256_packs_epi16(a, b), unpack);
+    _mm256_storeu_si256((__m256i*) &fo[i], c);
+  }
+
+  // Remainder
+  workScalar(nsamples - i, &fi[i], &fo[i]);
+}
+
+#endif
+
+size_t Quantize::work(
     const std::shared_ptr<Queue<std::vector<std::complex<float> > > >& qin,
     const std::shared_ptr<Queue<std::vector<int8_t> > >& qout) {
   auto input = qin->popForRead();
   if (!input) {
     qout->close();
-    return;
+    return 0;
   }
 
-  // Clear output so we can use push_back.
-  // It will retain the associated memory allocation.
+  // Resizing output retains the associated memory allocation.
   auto output = qout->popForWrite();
-  output->clear();
-
-  auto& rinput = *input;
-  auto& routput = *output;
   auto nsamples = input->size();
-  for (size_t i = 0; i < nsamples; i++) {
-    int8_t v = rinput[i].real() * 127.0f;
-    routput.push_back(v);
-  }
+  output->resize(nsamples);
+
+  // Do actual work
+  work(nsamples, input->data(), output->data());
+  quality_.work(nsamples, input->data());
 
   // Return input buffer
   qin->pushRead(std::move(input));
@@ -35,4 +148,5 @@ void Quantize::work(
 
   // Return output buffer
   qout->pushWrite(std::move(output));
+  return nsamples;
 }
@@ -2,6 +2,8 @@
 
 #include <memory>
 
+#include "quality.h"
+#include "simd.h"
 #include "soft_bit_publisher.h"
 #include "types.h"
 
@@ -9,14 +11,54 @@ class Quantize {
 public:
   explicit Quantize();
 
+  // Select kernel implementation (defaults to best supported).
+  void setSIMD(SIMD simd);
+
+  SIMD getSIMD() const {
+    return simd_;
+  }
+
   void setSoftBitPublisher(std::unique_ptr<SoftBitPublisher> softBitPublisher) {
     softBitPublisher_ = std::move(softBitPublisher);
   }
 
-  void work(
+  // Estimates the quality of the symbols this stage quantizes. Only
+  // safe to use from the thread running this stage.
+  Quality& getQuality() {
+    return quality_;
+  }
+
+  // Processes a single block of samples.
+  // Returns the number of samples consumed (0 if the input has closed).
+  size_t work(
       const std::shared_ptr<Queue<std::vector<std::complex<float> > > >& qin,
       const std::shared_ptr<Queue<std::vector<int8_t> > >& qout);
 
 protected:
+  void work(
+      size_t nsamples,
+      const std::complex<float>* fi,
+      int8_t* fo);
+
+  void workScalar(
+      size_t nsamples,
+      const std::complex<float>* fi,
+      int8_t* fo);
+
+#ifdef SIMD_X86
+  TARGET_SSE41 void workSSE41(
+      size_t nsamples,
+      const std::complex<float>* fi,
+      int8_t* fo);
+
+  TARGET_AVX2 void workAVX2(
+      size_t nsamples,
+      const std::complex<float>* fi,
+      int8_t* fo);
+#endif
+
+  SIMD simd_;
+  Quality quality_;
+
   std::unique_ptr<SoftBitPublisher> softBitPublisher_;
 };
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
 #include <deque>
 #include <memory>
 #include <mutex>
@@ -7,33 +11,124 @@
 
 #include <util/error.h>
 
+// QueueStats is the part of a queue that can be inspected without
+// knowing the type of its buffers. It tracks how long the consumer
+// waited for a full buffer, and how long the producer waited for an
+// empty one. Time is only measured when a call actually has to wait,
+// so the fast path is unaffected. Each counter has a single writer.
+//
+class QueueStats {
+public:
+  QueueStats() : readWait_(0), writeWait_(0) {
+  }
+
+  virtual ~QueueStats() {
+  }
+
+  // Returns number of buffers in the pool
+  virtual size_t size() = 0;
+
+  // Returns number of full buffers waiting for the consumer
+  virtual size_t depth() = 0;
+
+  // Total time the consumer waited in popForRead (nanoseconds)
+  uint64_t readWait() const {
+    return readWait_.load(std::memory_order_relaxed);
+  }
+
+  // Total time the producer waited in popForWrite (nanoseconds)
+  uint64_t writeWait() const {
+    return writeWait_.load(std::memory_order_relaxed);
+  }
+
+protected:
+  static uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static void add(std::atomic<uint64_t>& counter, uint64_t start) {
+    counter.store(
+      counter.load(std::memory_order_relaxed) + (now() - start),
+      std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> readWait_;
+  std::atomic<uint64_t> writeWait_;
+};
+
+// Queue is a pool of buffers shared between a producer and a consumer.
+//
+// The producer borrows an empty buffer with popForWrite, fills it, and
+// hands it to the consumer with pushWrite. The consumer borrows a full
+// buffer with popForRead, and returns it to the pool with pushRead.
+// Buffers are recycled, so their memory allocation is retained.
+//
 template <class T>
-class Queue {
+class Queue : public QueueStats {
 public:
-  Queue(size_t capacity) :
+  virtual ~Queue() {
+  }
+
+  virtual bool closed() = 0;
+
+  virtual void close() = 0;
+
+  // popForWrite returns existing item to write to
+  virtual std::unique_ptr<T> popForWrite() = 0;
+
+  // tryPopForWrite is like popForWrite, but returns nullptr instead
+  // of waiting if there is no item to write to
+  virtual std::unique_ptr<T> tryPopForWrite() = 0;
+
+  // reclaimForWrite takes back the oldest written item that has not
+  // been read yet, to write to instead; returns nullptr if there is
+  // none (called by the producer only)
+  virtual std::unique_ptr<T> reclaimForWrite() = 0;
+
+  // pushWrite returns written item to read queue
+  virtual void pushWrite(std::unique_ptr<T> v) = 0;
+
+  // popForRead returns existing item to read from
+  virtual std::unique_ptr<T> popForRead() = 0;
+
+  // pushRead returns read item to write queue
+  virtual void pushRead(std::unique_ptr<T> v) = 0;
+};
+
+// LockingQueue guards its buffers with a mutex and allocates them
+// as needed, up to its capacity. It can be used from any thread.
+template <class T>
+class LockingQueue : public Queue<T> {
+public:
+  explicit LockingQueue(size_t capacity) :
       elements_(0),
       capacity_(capacity),
       closed_(false) {
   }
 
-  size_t size() {
+  size_t size() override {
     std::unique_lock<std::mutex> lock(m_);
     return elements_;
   }
 
-  bool closed() {
+  size_t depth() override {
+    std::unique_lock<std::mutex> lock(m_);
+    return read_.size();
+  }
+
+  bool closed() override {
     std::unique_lock<std::mutex> lock(m_);
     return closed_;
   }
 
-  void close() {
+  void close() override {
     std::unique_lock<std::mutex> lock(m_);
     closed_ = true;
     cv_.notify_one();
   }
 
-  // popForWrite returns existing item to write to
-  std::unique_ptr<T> popForWrite() {
+  std::unique_ptr<T> popForWrite() override {
     std::unique_lock<std::mutex> lock(m_);
     ASSERT(!closed_);
 
@@ -44,9 +139,11 @@ public:
         write_.push_back(std::make_unique<T>());
       } else {
         // Wait until pushRead makes an item available
+        const auto start = this->now();
         while (write_.size() == 0) {
           cv_.wait(lock);
         }
+        this->add(this->writeWait_, start);
       }
     }
 
@@ -55,8 +152,37 @@ public:
     return v;
   }
 
-  // pushWrite returns written item to read queue
-  void pushWrite(std::unique_ptr<T> v) {
+  std::unique_ptr<T> tryPopForWrite() override {
+    std::unique_lock<std::mutex> lock(m_);
+    ASSERT(!closed_);
+
+    if (write_.size() == 0) {
+      if (elements_ == capacity_) {
+        return std::unique_ptr<T>(nullptr);
+      }
+      elements_++;
+      return std::make_unique<T>();
+    }
+
+    auto v = std::move(write_.front());
+    write_.pop_front();
+    return v;
+  }
+
+  std::unique_ptr<T> reclaimForWrite() override {
+    std::unique_lock<std::mutex> lock(m_);
+    ASSERT(!closed_);
+
+    if (read_.size() == 0) {
+      return std::unique_ptr<T>(nullptr);
+    }
+
+    auto v = std::move(read_.front());
+    read_.pop_front();
+    return v;
+  }
+
+  void pushWrite(std::unique_ptr<T> v) override {
     std::unique_lock<std::mutex> lock(m_);
     ASSERT(!closed_);
 
@@ -64,11 +190,14 @@ public:
     cv_.notify_one();
   }
 
-  // popForRead returns existing item to read from
-  std::unique_ptr<T> popForRead() {
+  std::unique_ptr<T> popForRead() override {
     std::unique_lock<std::mutex> lock(m_);
-    while (read_.size() == 0 && !closed_) {
-      cv_.wait(lock);
+    if (read_.size() == 0 && !closed_) {
+      const auto start = this->now();
+      while (read_.size() == 0 && !closed_) {
+        cv_.wait(lock);
+      }
+      this->add(this->readWait_, start);
     }
 
     // Allow read side to drain
@@ -81,8 +210,7 @@ public:
     return v;
   }
 
-  // pushRead returns read item to write queue
-  void pushRead(std::unique_ptr<T> v) {
+  void pushRead(std::unique_ptr<T> v) override {
     std::unique_lock<std::mutex> lock(m_);
     if (!closed_) {
       write_.push_back(std::move(v));
@@ -0,0 +1,172 @@
+#include "receiver.h"
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "spsc_queue.h"
+
+namespace {
+
+// Number of downlinks from which the filter bank is cheaper than a
+// front end per downlink at the full sample rate. Measured with the
+// "channelizer" benchmark (3 HRIT downlinks at 10 Msps run at about
+// 0.58x the throughput of separate front ends).
+constexpr size_t channelizerBreakEven = 5;
+
+} // namespace
+
+Receiver::Receiver(Demodulator::Type type, Config& config) {
+  if (!config.combiner.connect.empty()) {
+    if (!config.downlinks.empty()) {
+      throw std::invalid_argument(
+        "Additional downlinks can't be received with a combiner");
+    }
+    initializeCombiner(config);
+    return;
+  }
+
+  if (!config.downlinks.empty()) {
+    initializeChannelizer(type, config);
+    return;
+  }
+
+  auto demod = std::make_unique<Demodulator>(type);
+  demod->initialize(config);
+  auto decode = std::make_unique<Decoder>(demod->getSoftBitsQueue());
+  decode->initialize(config);
+  decode->setPacketCallback([d = demod.get()] { d->notifyPacket(); });
+  demods_.push_back(std::move(demod));
+  decoders_.push_back(std::move(decode));
+}
+
+void Receiver::initializeChannelizer(Demodulator::Type type, Config& config) {
+  auto source = Source::build(config.demodulator.source, config);
+  const auto depth = config.demodulator.queueDepth.source;
+  if (config.demodulator.queue == "spsc") {
+    sourceQueue_ = std::make_shared<SPSCQueue<Samples> >(depth);
+  } else {
+    sourceQueue_ = std::make_shared<LockingQueue<Samples> >(depth);
+  }
+
+  const auto sampleRate = source->getSampleRate();
+
+  // The downlink configured in the [demodulator] section comes first
+  std::vector<double> frequencies;
+  demods_.push_back(std::make_unique<Demodulator>(type));
+  frequencies.push_back(config.frontend.frequencyOffset);
+  for (const auto& downlink : config.downlinks) {
+    const auto t = (downlink.downlinkType == "hrit")
+      ? Demodulator::HRIT
+      : Demodulator::LRIT;
+    demods_.push_back(std::make_unique<Demodulator>(t));
+    frequencies.push_back(downlink.frequencyOffset);
+  }
+
+  std::vector<std::pair<double, double> > signals;
+  for (size_t i = 0; i < demods_.size(); i++) {
+    signals.emplace_back(frequencies[i], demods_[i]->getBandwidth(config));
+  }
+
+  // Below the break-even point, every downlink gets a copy of the
+  // source samples for its own front end
+  auto channels = config.channelizer.channels;
+  if (channels == 0 && demods_.size() < channelizerBreakEven) {
+    channels = 1;
+  }
+  if (channels == 0) {
+    channels = Channelizer::channels(sampleRate, signals);
+    if (channels == 0) {
+      std::stringstream ss;
+      ss <<
+        "Unable to fit every downlink in a channel of the channelizer " <<
+        "(sample rate " << sampleRate << "); make sure that every " <<
+        "downlink is within the bandwidth of the source";
+      throw std::invalid_argument(ss.str());
+    }
+  }
+
+  // Restored after configuring the additional downlinks
+  const auto demodulatorStatsPublisher = config.demodulator.statsPublisher;
+  const auto decoderStatsPublisher = config.decoder.statsPublisher;
+
+  channelizer_ = std::make_unique<Channelizer>(sampleRate, channels);
+  channelizer_->setSource(std::move(source));
+  for (size_t i = 0; i < demods_.size(); i++) {
+    const auto channel = channelizer_->channel(signals[i].first);
+    // Frequencies wrap around at the sample rate (for the channel at
+    // half the sample rate, either sign applies)
+    const auto offset = std::remainder(
+      signals[i].first - channelizer_->getFrequency(channel),
+      (double) sampleRate);
+    if (std::abs(offset) + signals[i].second > channelizer_->getPassband()) {
+      std::stringstream ss;
+      ss <<
+        "The downlink at offset " << signals[i].first << " Hz " <<
+        "doesn't fit the passband of channel " << channel << " " <<
+        "with " << channels << " channels; configure fewer channels";
+      throw std::invalid_argument(ss.str());
+    }
+
+    // The front end removes the offset from the channel center
+    config.demodulator.frontend = true;
+    config.frontend.frequencyOffset = offset;
+    config.frontend.decimation = 0;
+
+    // Additional downlinks have their own publishers
+    if (i > 0) {
+      auto& downlink = config.downlinks[i - 1];
+      config.demodulator.statsPublisher = downlink.demodulatorStatsPublisher;
+      config.decoder.statsPublisher = downlink.decoderStatsPublisher;
+      config.decoder.packetPublisher = std::move(downlink.packetPublisher);
+    }
+
+    demods_[i]->initialize(config, channelizer_->open(channel));
+    decoders_.push_back(std::make_unique<Decoder>(demods_[i]->getSoftBitsQueue()));
+    decoders_.back()->initialize(config);
+    decoders_.back()->setPacketCallback([d = demods_[i].get()] { d->notifyPacket(); });
+  }
+
+  config.demodulator.statsPublisher = demodulatorStatsPublisher;
+  config.decoder.statsPublisher = decoderStatsPublisher;
+}
+
+void Receiver::initializeCombiner(Config& config) {
+  combiner_ = std::make_unique<Combiner>(config);
+  auto decode = std::make_unique<Decoder>(combiner_->getSoftBitsQueue());
+  decode->initialize(config);
+  decoders_.push_back(std::move(decode));
+}
+
+void Receiver::start() {
+  for (auto& demod : demods_) {
+    demod->start();
+  }
+  for (auto& decode : decoders_) {
+    decode->start();
+  }
+  if (combiner_) {
+    combiner_->start();
+  }
+
+  // Channels are connected when their demodulator starts
+  if (channelizer_) {
+    channelizer_->start(sourceQueue_);
+  }
+}
+
+void Receiver::stop() {
+  // Closes the queue of every channel
+  if (channelizer_) {
+    channelizer_->stop();
+  }
+  for (auto& demod : demods_) {
+    demod->stop();
+  }
+  if (combiner_) {
+    combiner_->stop();
+  }
+  for (auto& decode : decoders_) {
+    decode->stop();
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "channelizer.h"
+#include "combiner.h"
+#include "config.h"
+#include "decoder.h"
+#include "demodulator.h"
+
+// Receiver runs a demodulator and decoder for every configured
+// downlink. Ordinarily there is a single downlink, and the
+// demodulator reads from the source directly.
+//
+// With additional downlinks (see Config::Downlink), the source is
+// shared through the channelizer. Every downlink is then received
+// from the channel nearest to it, and the front end of its
+// demodulator removes the remaining frequency offset. With fewer
+// downlinks than it takes for the filter bank to pay off, the
+// channelizer uses a single channel, and every front end receives
+// the source samples as is.
+//
+// With a combiner (see Config::Combiner), there is no demodulator;
+// the decoder reads the soft bits combined from other receivers.
+//
+class Receiver {
+public:
+  explicit Receiver(Demodulator::Type type, Config& config);
+
+  void start();
+  void stop();
+
+  // Stats of the first downlink (for the monitor). Without a
+  // demodulator, there are none.
+  DemodulatorStats& getDemodulatorStats() {
+    if (demods_.empty()) {
+      return noDemodulatorStats_;
+    }
+    return demods_.front()->getStats();
+  }
+
+  DecoderStats& getDecoderStats() {
+    return decoders_.front()->getStats();
+  }
+
+protected:
+  void initializeChannelizer(Demodulator::Type type, Config& config);
+  void initializeCombiner(Config& config);
+
+  std::vector<std::unique_ptr<Demodulator> > demods_;
+  std::vector<std::unique_ptr<Decoder> > decoders_;
+
+  // Only used with multiple downlinks
+  std::unique_ptr<Channelizer> channelizer_;
+  std::shared_ptr<Queue<Samples> > sourceQueue_;
+
+  // Only used with a combiner
+  std::unique_ptr<Combiner> combiner_;
+  DemodulatorStats noDemodulatorStats_;
+};
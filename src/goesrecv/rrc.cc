@@ -1,20 +1,21 @@
 #include "rrc.h"
 
+#include <algorithm>
 #include <cstring>
 
 #ifdef __ARM_NEON
 #include <arm_neon.h>
 #endif
 
-#include <util/error.h>
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
 
-namespace {
+#include <util/error.h>
 
 // Implementation of RRC filter definition as found on Wikipedia.
 // Manually cross checked results against taps generated by GNU Radio.
-std::vector<float> taps(int sampleRate, int symbolRate) {
-  const double sps = (double) sampleRate / (double) symbolRate;
-  constexpr int ntaps = RRC::NTAPS;
+std::vector<float> RRC::design(double sps, int ntaps) {
   constexpr double beta = 0.5f;
   std::vector<float> taps(ntaps);
   for (int i = 0; i < (int) ntaps; i++) {
@@ -60,27 +61,59 @@ std::vector<float> taps(int sampleRate, int symbolRate) {
   return taps;
 }
 
-} // namespace
-
 RRC::RRC(int decimation, int sampleRate, int symbolRate) :
-    decimation_(decimation) {
-  taps_ = taps(sampleRate, symbolRate);
+    decimation_(decimation),
+    history_(NTAPS) {
+  taps_ = design((double) sampleRate / (double) symbolRate, NTAPS);
 
   // Last tap is zero (so it is a multiple of 4)
   static_assert((NTAPS + 1) % 4 == 0, "NTAPS + 1 not a multiple of 4");
   taps_.resize(NTAPS + 1);
   taps_[NTAPS] = 0.0f;
+  taps2_.resize(2 * (NTAPS + 1));
+  for (size_t i = 0; i < (NTAPS + 1); i++) {
+    taps2_[2 * i + 0] = taps_[i];
+    taps2_[2 * i + 1] = taps_[i];
+  }
 
-  // Seed the delay line with zeroes
-  tmp_.resize(NTAPS);
+  simd_ = simdBest();
 }
 
-#ifdef __ARM_NEON
+void RRC::setSIMD(SIMD simd) {
+  ASSERT(simdSupported(simd));
+  simd_ = simd;
+}
 
 void RRC::work(
     size_t nsamples,
     std::complex<float>* fi,
     std::complex<float>* fo) {
+  switch (simd_) {
+#ifdef __ARM_NEON
+  case SIMD::NEON:
+    workNEON(nsamples, fi, fo);
+    break;
+#endif
+#ifdef SIMD_X86
+  case SIMD::SSE41:
+    workSSE41(nsamples, fi, fo);
+    break;
+  case SIMD::AVX2:
+    workAVX2(nsamples, fi, fo);
+    break;
+#endif
+  default:
+    workScalar(nsamples, fi, fo);
+    break;
+  }
+}
+
+#ifdef __ARM_NEON
+
+void RRC::workNEON(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo) {
   // Load taps
   float32x4_t taps[(NTAPS + 1) / 4];
   for (size_t i = 0; i < (NTAPS + 1); i += 4) {
@@ -113,9 +146,9 @@ void RRC::work(
   }
 }
 
-#else
+#endif
 
-void RRC::work(
+void RRC::workScalar(
     size_t nsamples,
     std::complex<float>* fi,
     std::complex<float>* fo) {
@@ -131,35 +164,125 @@ void RRC::work(
   }
 }
 
+#ifdef SIMD_X86
+
+TARGET_SSE41
+void RRC::workSSE41(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo) {
+  // Load taps
+  __m128 taps[(NTAPS + 1) / 2];
+  for (size_t i = 0; i < (NTAPS + 1); i += 2) {
+    taps[i / 2] = _mm_loadu_ps(&taps2_[2 * i]);
+  }
+
+  for (size_t i = 0; i < (nsamples / decimation_); i++) {
+    const float* f = (const float*) fi;
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+
+    // Every load holds 2 complex samples.
+    // Use 2 accumulators to break the dependency chain.
+    for (size_t j = 0; j < (NTAPS + 1); j += 4) {
+      __m128 v0 = _mm_loadu_ps(&f[2 * j + 0]);
+      __m128 v1 = _mm_loadu_ps(&f[2 * j + 4]);
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(v0, taps[j / 2 + 0]));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(v1, taps[j / 2 + 1]));
+    }
+
+    // Sum accumulators; real and imaginary parts end up
+    // in the lower 2 elements of the register.
+    __m128 acc = _mm_add_ps(acc0, acc1);
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    _mm_storel_pi((__m64*) fo, acc);
+
+    // Advance input/output cursors
+    fi += decimation_;
+    fo += 1;
+  }
+}
+
+TARGET_AVX2
+void RRC::workAVX2(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo) {
+  // Load taps
+  __m256 taps[(NTAPS + 1) / 4];
+  for (size_t i = 0; i < (NTAPS + 1); i += 4) {
+    taps[i / 4] = _mm256_loadu_ps(&taps2_[2 * i]);
+  }
+
+  for (size_t i = 0; i < (nsamples / decimation_); i++) {
+    const float* f = (const float*) fi;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+
+    // Every load holds 4 complex samples.
+    // Use 2 accumulators to break the dependency chain.
+    for (size_t j = 0; j < (NTAPS + 1); j += 8) {
+      __m256 v0 = _mm256_loadu_ps(&f[2 * j + 0]);
+      __m256 v1 = _mm256_loadu_ps(&f[2 * j + 8]);
+      acc0 = _mm256_fmadd_ps(v0, taps[j / 4 + 0], acc0);
+      acc1 = _mm256_fmadd_ps(v1, taps[j / 4 + 1], acc1);
+    }
+
+    // Sum accumulators; real and imaginary parts end up
+    // in the lower 2 elements of the register.
+    __m256 acc256 = _mm256_add_ps(acc0, acc1);
+    __m128 acc = _mm_add_ps(
+      _mm256_castps256_ps128(acc256),
+      _mm256_extractf128_ps(acc256, 1));
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    _mm_storel_pi((__m64*) fo, acc);
+
+    // Advance input/output cursors
+    fi += decimation_;
+    fo += 1;
+  }
+}
+
 #endif
 
-void RRC::work(
+void RRC::process(
+    size_t nsamples,
+    std::complex<float>* fi,
+    std::complex<float>* fo) {
+  ASSERT((nsamples % decimation_) == 0);
+
+  // The window of the first outputs starts in the history. Compute
+  // these from a joined copy; first output after that starts at
+  // sample m - NTAPS of the block.
+  size_t m = NTAPS + decimation_ - 1;
+  m = std::min(m - (m % decimation_), nsamples);
+  work(m, history_.join(fi, m), fo);
+  if (m < nsamples) {
+    work(nsamples - m, &fi[m - NTAPS], &fo[m / decimation_]);
+  }
+
+  // Keep final NTAPS samples around
+  history_.keep(fi, nsamples, nsamples);
+}
+
+size_t RRC::work(
     const std::shared_ptr<Queue<Samples> >& qin,
     const std::shared_ptr<Queue<Samples> >& qout) {
   auto input = qin->popForRead();
   if (!input) {
     qout->close();
-    return;
+    return 0;
   }
 
   auto output = qout->popForWrite();
   auto nsamples = input->size();
-  ASSERT((nsamples % decimation_) == 0);
   output->resize(nsamples / decimation_);
-  tmp_.insert(tmp_.end(), input->begin(), input->end());
-  ASSERT(tmp_.size() == input->size() + NTAPS);
-
-  // Return read buffer (it has been copied into tmp_)
-  qin->pushRead(std::move(input));
 
   // Do actual work
-  std::complex<float>* fi = tmp_.data();
-  std::complex<float>* fo = output->data();
-  work(nsamples, fi, fo);
+  process(nsamples, input->data(), output->data());
 
-  // Keep final NTAPS samples around
-  tmp_.erase(tmp_.begin(), tmp_.end() - NTAPS);
-  ASSERT(tmp_.size() == NTAPS);
+  // Return input buffer
+  qin->pushRead(std::move(input));
 
   // Publish output if applicable
   if (samplePublisher_) {
@@ -168,4 +291,5 @@ void RRC::work(
 
   // Return output buffer
   qout->pushWrite(std::move(output));
+  return nsamples;
 }
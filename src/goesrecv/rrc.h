@@ -3,7 +3,9 @@
 #include <array>
 #include <memory>
 
+#include "history.h"
 #include "sample_publisher.h"
+#include "simd.h"
 #include "types.h"
 
 class RRC {
@@ -12,24 +14,75 @@ public:
 
   explicit RRC(int df, int sampleRate, int symbolRate);
 
+  // Returns taps of RRC filter with roll-off factor 0.5 for the
+  // specified number of samples per symbol, normalized to unit gain.
+  static std::vector<float> design(double sps, int ntaps);
+
+  // Select kernel implementation (defaults to best supported).
+  void setSIMD(SIMD simd);
+
+  SIMD getSIMD() const {
+    return simd_;
+  }
+
   void setSamplePublisher(std::unique_ptr<SamplePublisher> samplePublisher) {
     samplePublisher_ = std::move(samplePublisher);
   }
 
-  void work(
+  // Processes a single block of samples.
+  // Returns the number of samples consumed (0 if the input has closed).
+  size_t work(
       const std::shared_ptr<Queue<Samples> >& qin,
       const std::shared_ptr<Queue<Samples> >& qout);
 
+  // Processes samples that are not passed through a queue (see Fused).
+  // The sample publisher is not called.
+  void process(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo);
+
 protected:
   void work(
       size_t nsamples,
       std::complex<float>* fi,
       std::complex<float>* fo);
 
+  void workScalar(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo);
+
+#ifdef __ARM_NEON
+  void workNEON(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo);
+#endif
+
+#ifdef SIMD_X86
+  TARGET_SSE41 void workSSE41(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo);
+
+  TARGET_AVX2 void workAVX2(
+      size_t nsamples,
+      std::complex<float>* fi,
+      std::complex<float>* fo);
+#endif
+
   int decimation_;
   std::vector<float> taps_;
 
-  Samples tmp_;
+  // Every tap repeated twice, such that it can be multiplied with
+  // interleaved complex samples without shuffling the samples.
+  std::vector<float> taps2_;
+
+  SIMD simd_;
+
+  // Final NTAPS samples of the previous block (zeroes initially)
+  History history_;
 
   std::unique_ptr<SamplePublisher> samplePublisher_;
 };
@@ -41,13 +41,12 @@ public:
 
   void handle(unsigned char* buf, uint32_t len);
 
-protected:
-  void process(
-      size_t nsamples,
-      unsigned char* buf,
-      std::complex<float>* fo);
+  // Number of samples per transfer (0 for the library default).
+  void setBlockSize(uint32_t blockSize);
 
+protected:
   rtlsdr_dev_t* dev_;
+  uint32_t blockSize_;
 
   std::vector<int> tunerGains_;
   std::thread thread_;
@@ -0,0 +1,351 @@
+#include "rtltcp_source.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <util/error.h>
+
+#include "convert.h"
+#include "scheduling.h"
+
+namespace {
+
+// Commands of the rtl_tcp protocol
+constexpr uint8_t setFrequencyCommand = 0x01;
+constexpr uint8_t setSampleRateCommand = 0x02;
+constexpr uint8_t setGainModeCommand = 0x03;
+constexpr uint8_t setGainCommand = 0x04;
+constexpr uint8_t setBiasTeeCommand = 0x0e;
+
+#ifdef MSG_NOSIGNAL
+constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+constexpr int sendFlags = 0;
+#endif
+
+int connectTo(const std::string& addr, size_t receiveBuffer) {
+  std::string host = addr;
+  std::string port;
+  size_t pos;
+
+  pos = host.find("://");
+  if (pos != std::string::npos) {
+    host = host.substr(pos + 3);
+  }
+
+  pos = host.rfind(':');
+  if (pos != std::string::npos) {
+    port = host.substr(pos + 1);
+    host = host.substr(0, pos);
+  }
+
+  if (host.empty()) {
+    host = "localhost";
+  }
+
+  if (port.empty()) {
+    port = "1234";
+  }
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_ADDRCONFIG;
+  struct addrinfo* res = nullptr;
+  auto rv = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+  if (rv != 0) {
+    std::stringstream ss;
+    ss << "rtl_tcp: unable to resolve " << host << ": " << gai_strerror(rv);
+    throw std::runtime_error(ss.str());
+  }
+
+  // Use the first address that accepts the connection
+  int fd = -1;
+  int err = 0;
+  for (auto ai = res; ai != nullptr; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd == -1) {
+      err = errno;
+      continue;
+    }
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      break;
+    }
+    err = errno;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+
+  if (fd == -1) {
+    std::stringstream ss;
+    ss << "rtl_tcp: unable to connect to " << addr << ": " << strerror(err);
+    throw std::runtime_error(ss.str());
+  }
+
+  // Commands are tiny and should take effect right away
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  int size = receiveBuffer;
+  if (size > 0) {
+    auto rv = setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if (rv < 0) {
+      close(fd);
+      std::stringstream ss;
+      ss << "rtl_tcp: setsockopt: " << strerror(errno);
+      throw std::runtime_error(ss.str());
+    }
+  }
+
+  // The header holds the magic, tuner type, and number of gains
+  uint8_t header[12];
+  auto nbytes = recv(fd, header, sizeof(header), MSG_WAITALL);
+  if (nbytes != sizeof(header) || memcmp(header, "RTL0", 4) != 0) {
+    close(fd);
+    std::stringstream ss;
+    ss << "rtl_tcp: " << addr << " is not an rtl_tcp server";
+    throw std::runtime_error(ss.str());
+  }
+
+  return fd;
+}
+
+} // namespace
+
+constexpr std::chrono::milliseconds RTLTCP::stallThreshold;
+constexpr std::chrono::milliseconds RTLTCP::minReconnectDelay;
+constexpr std::chrono::milliseconds RTLTCP::maxReconnectDelay;
+
+std::unique_ptr<RTLTCP> RTLTCP::open(const Config& config) {
+  const auto& addr = config.rtltcp.connect;
+  if (addr.empty()) {
+    throw std::invalid_argument("rtl_tcp: no server to connect to");
+  }
+
+  const auto receiveBuffer = config.rtltcp.receiveBuffer;
+  auto fd = connectTo(addr, receiveBuffer);
+  return std::make_unique<RTLTCP>(fd, addr, receiveBuffer);
+}
+
+RTLTCP::RTLTCP(int fd, const std::string& addr, size_t receiveBuffer)
+    : addr_(addr),
+      receiveBuffer_(receiveBuffer),
+      fd_(fd),
+      sampleRate_(0),
+      blockSize_(16384),
+      stopping_(false) {
+}
+
+RTLTCP::~RTLTCP() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void RTLTCP::command(uint8_t cmd, uint32_t param) {
+  send(cmd, param);
+
+  for (auto& command : commands_) {
+    if (command.first == cmd) {
+      command.second = param;
+      return;
+    }
+  }
+  commands_.emplace_back(cmd, param);
+}
+
+void RTLTCP::send(uint8_t cmd, uint32_t param) {
+  const uint8_t buf[5] = {
+    cmd,
+    (uint8_t) (param >> 24),
+    (uint8_t) (param >> 16),
+    (uint8_t) (param >> 8),
+    (uint8_t) (param >> 0),
+  };
+  auto rv = ::send(fd_, buf, sizeof(buf), sendFlags);
+  if (rv != sizeof(buf)) {
+    std::stringstream ss;
+    ss << "rtl_tcp: unable to send command: " << strerror(errno);
+    throw std::runtime_error(ss.str());
+  }
+}
+
+void RTLTCP::setFrequency(uint32_t freq) {
+  command(setFrequencyCommand, freq);
+}
+
+void RTLTCP::setSampleRate(uint32_t rate) {
+  command(setSampleRateCommand, rate);
+  sampleRate_ = rate;
+}
+
+uint32_t RTLTCP::getSampleRate() const {
+  return sampleRate_;
+}
+
+void RTLTCP::setTunerGain(int db) {
+  // Manual gain, in tenths of a dB
+  command(setGainModeCommand, 1);
+  command(setGainCommand, db * 10);
+}
+
+void RTLTCP::setBiasTee(bool on) {
+  command(setBiasTeeCommand, on ? 1 : 0);
+}
+
+void RTLTCP::setBlockSize(uint32_t blockSize) {
+  ASSERT(blockSize > 0 && (blockSize % 4) == 0);
+  blockSize_ = blockSize;
+}
+
+bool RTLTCP::reconnect() {
+  auto delay = minReconnectDelay;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait_for(lock, delay, [this] { return stopping_.load(); });
+      if (stopping_) {
+        return false;
+      }
+    }
+
+    delay = std::min(2 * delay, maxReconnectDelay);
+
+    int fd;
+    try {
+      fd = connectTo(addr_, receiveBuffer_);
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      continue;
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (stopping_) {
+        close(fd);
+        return false;
+      }
+      close(fd_);
+      fd_ = fd;
+    }
+
+    // Tune the server the same way as before
+    try {
+      for (const auto& command : commands_) {
+        send(command.first, command.second);
+      }
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      continue;
+    }
+
+    std::cerr << "rtl_tcp: connected to " << addr_ << std::endl;
+    return true;
+  }
+}
+
+void RTLTCP::loop() {
+  Scheduling::apply("source");
+
+  const size_t size = 2 * blockSize_;
+  size_t nbytes = 0;
+  buffer_.resize(size);
+  for (;;) {
+    const auto begin = std::chrono::steady_clock::now();
+    auto rv = recv(fd_, &buffer_[nbytes], size - nbytes, 0);
+    if (rv < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rv <= 0) {
+      if (stopping_) {
+        return;
+      }
+
+      std::cerr
+        << "rtl_tcp: connection lost: "
+        << (rv == 0 ? "closed by server" : strerror(errno))
+        << std::endl;
+      disconnect();
+
+      // Samples of the partial block are gone
+      nbytes = 0;
+      if (!reconnect()) {
+        return;
+      }
+      continue;
+    }
+
+    const auto wait = std::chrono::steady_clock::now() - begin;
+    if (wait > stallThreshold) {
+      stall(wait);
+    }
+
+    // Wait for a complete block
+    nbytes += rv;
+    if (nbytes < size) {
+      continue;
+    }
+    nbytes = 0;
+
+    // Grab buffer from queue (or drop the samples on overflow)
+    auto out = popForWrite(*queue_, blockSize_);
+    if (!out) {
+      continue;
+    }
+    out->resize(blockSize_);
+
+    // Convert to std::complex<float>
+    convertU8(simd_, blockSize_, buffer_.data(), out->data());
+
+    // Publish output if applicable
+    if (samplePublisher_) {
+      samplePublisher_->publish(*out);
+    }
+
+    // Return buffer to queue
+    queue_->pushWrite(std::move(out));
+  }
+}
+
+void RTLTCP::start(const std::shared_ptr<Queue<Samples> >& queue) {
+  queue_ = queue;
+  thread_ = std::thread(&RTLTCP::loop, this);
+#ifdef __APPLE__
+  pthread_setname_np("rtltcp");
+#else
+  pthread_setname_np(thread_.native_handle(), "rtltcp");
+#endif
+}
+
+void RTLTCP::stop() {
+  // Unblocks the receive in the loop (or the wait to reconnect)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+    shutdown(fd_, SHUT_RDWR);
+    cv_.notify_one();
+  }
+
+  // Wait for thread to terminate
+  thread_.join();
+
+  // Close queue to signal downstream
+  queue_->close();
+
+  // Clear reference to queue
+  queue_.reset();
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "source.h"
+
+// RTLTCP receives samples from an rtl_tcp server, such that the
+// RTL-SDR can sit on a small computer next to the dish while the
+// demodulator runs elsewhere.
+//
+// The server sends a 12 byte header (magic "RTL0", tuner type, and
+// number of gain settings), followed by unsigned 8 bit I/Q samples
+// until the connection is closed. The client controls the device
+// with 5 byte commands (command byte and big endian parameter).
+//
+// Samples are received straight into a buffer of a single block, and
+// converted from there into the next buffer of the queue.
+//
+// A receive that doesn't return for longer than stallThreshold
+// counts as a stall (see Source::getStalls); the network (or the
+// server) couldn't keep up. Samples that the demodulator can't keep
+// up with are dropped according to the overflow policy.
+//
+// If the connection is lost, the source connects again (waiting
+// longer between attempts, up to maxReconnectDelay), and sends the
+// commands it sent before, such that the server is tuned the same
+// way. Every lost connection counts as a disconnect (see
+// Source::getDisconnects). The block that was being received is
+// discarded.
+//
+class RTLTCP : public Source {
+public:
+  // Receives that wait longer than this count as a stall
+  static constexpr std::chrono::milliseconds stallThreshold{100};
+
+  // Time between attempts to connect again (doubles per attempt)
+  static constexpr std::chrono::milliseconds minReconnectDelay{1000};
+  static constexpr std::chrono::milliseconds maxReconnectDelay{30000};
+
+  // Connects to the configured server and reads its header.
+  static std::unique_ptr<RTLTCP> open(const Config& config);
+
+  RTLTCP(int fd, const std::string& addr, size_t receiveBuffer);
+  ~RTLTCP();
+
+  void setFrequency(uint32_t freq);
+
+  void setSampleRate(uint32_t rate);
+
+  virtual uint32_t getSampleRate() const override;
+
+  // Gain in dB. The server picks the closest valid setting.
+  void setTunerGain(int db);
+
+  void setBiasTee(bool on);
+
+  // Number of samples per block (defaults to 16384).
+  // Must be a multiple of 4.
+  void setBlockSize(uint32_t blockSize);
+
+  void setSamplePublisher(std::unique_ptr<SamplePublisher> samplePublisher) {
+    samplePublisher_ = std::move(samplePublisher);
+  }
+
+  virtual void start(const std::shared_ptr<Queue<Samples> >& queue) override;
+
+  virtual void stop() override;
+
+protected:
+  // Sends a command to the server, and keeps it for reconnect.
+  void command(uint8_t cmd, uint32_t param);
+
+  // Sends a command to the server.
+  void send(uint8_t cmd, uint32_t param);
+
+  // Connects again, until connected or stopping.
+  // Returns false if stopping.
+  bool reconnect();
+
+  void loop();
+
+  std::string addr_;
+  size_t receiveBuffer_;
+
+  // Guards replacing the socket (on reconnect) against stop
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  int fd_;
+
+  // Last command sent per command byte, in the order they were first
+  // sent (e.g. the gain mode before the gain)
+  std::vector<std::pair<uint8_t, uint32_t> > commands_;
+
+  uint32_t sampleRate_;
+  uint32_t blockSize_;
+
+  // Bytes of the block being received
+  std::vector<uint8_t> buffer_;
+
+  // Set by stop, such that the loop doesn't report the connection
+  // it shuts down as lost
+  std::atomic<bool> stopping_;
+
+  std::thread thread_;
+
+  // Set on start; cleared on stop
+  std::shared_ptr<Queue<Samples> > queue_;
+
+  // Optional publisher for samples
+  std::unique_ptr<SamplePublisher> samplePublisher_;
+};
@@ -1,5 +1,6 @@
 #include "sample_publisher.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include <nanomsg/nn.h>
@@ -19,28 +20,62 @@ SamplePublisher::SamplePublisher(int fd)
 SamplePublisher::~SamplePublisher() {
 }
 
-void SamplePublisher::publish(const Samples& samples) {
-  if (!hasSubscribers()) {
-    return;
-  }
+namespace {
 
-  // Scale samples to 8 bit.
-  // Otherwise it is impossible to stream 3M complex samples/second from a RPi.
-  tmp_.resize(samples.size());
-  for (size_t i = 0; i < samples.size(); i++) {
-    auto si = samples[i].real() * 127;
-    auto sq = samples[i].imag() * 127;
+// Scale samples to 8 bit.
+// Otherwise it is impossible to stream 3M complex samples/second from a RPi.
+void scale(const std::complex<float>* in, size_t n, std::complex<int8_t>* out) {
+  for (size_t i = 0; i < n; i++) {
+    auto si = in[i].real() * 127;
+    auto sq = in[i].imag() * 127;
 
     // Clamp
     si = (0.5f * (fabsf(si + 127.0f) - fabsf(si - 127.0f)));
     sq = (0.5f * (fabsf(sq + 127.0f) - fabsf(sq - 127.0f)));
 
     // Convert to int8_t
-    tmp_[i].real((int8_t) si);
-    tmp_[i].imag((int8_t) sq);
+    out[i].real((int8_t) si);
+    out[i].imag((int8_t) sq);
+  }
+}
+
+} // namespace
+
+void SamplePublisher::publish(const Samples& samples) {
+  if (tap_) {
+    tap_(samples);
   }
 
-  auto rv = nn_send(fd_, tmp_.data(), tmp_.size() * sizeof(tmp_[0]), 0);
+  const bool subscribers = hasSubscribers();
+  const bool readers = hasRingReaders();
+  if (!subscribers && !readers) {
+    return;
+  }
+
+  // With ring readers, samples are scaled straight into the ring, and
+  // sent to nanomsg subscribers from there (a block larger than half
+  // the ring is sent in multiple messages)
+  if (readers) {
+    const auto chunk = ring_->maxWrite() / sizeof(std::complex<int8_t>);
+    for (size_t i = 0; i < samples.size(); i += chunk) {
+      const auto n = std::min(chunk, samples.size() - i);
+      auto* p = reinterpret_cast<std::complex<int8_t>*>(ring_->reserve());
+      scale(&samples[i], n, p);
+      ring_->commit(n * sizeof(*p));
+      if (subscribers) {
+        send(p, n);
+      }
+    }
+    return;
+  }
+
+  tmp_.resize(samples.size());
+  scale(samples.data(), samples.size(), tmp_.data());
+  send(tmp_.data(), tmp_.size());
+}
+
+void SamplePublisher::send(const std::complex<int8_t>* samples, size_t n) {
+  auto rv = nn_send(fd_, samples, n * sizeof(samples[0]), 0);
   if (rv < 0) {
     fprintf(stderr, "nn_send: %s\n", nn_strerror(nn_errno()));
     ASSERT(false);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include "publisher.h"
 #include "types.h"
 
@@ -12,6 +14,15 @@ public:
 
   void publish(const Samples& samples);
 
+  // Also passes every block to a consumer in this process (see
+  // Spectrum), whether or not there are subscribers.
+  void setTap(std::function<void(const Samples&)> tap) {
+    tap_ = std::move(tap);
+  }
+
 protected:
+  void send(const std::complex<int8_t>* samples, size_t n);
+
   std::vector<std::complex<int8_t> > tmp_;
+  std::function<void(const Samples&)> tap_;
 };
@@ -0,0 +1,236 @@
+#include "scheduling.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifndef __APPLE__
+#include <sys/syscall.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+std::mutex mutex;
+
+// Batch processing and autotuning don't initialize; their threads are
+// left alone, and not recorded
+bool initialized = false;
+
+// Settings per role (set by initialize)
+std::map<std::string, Config::Thread> settings;
+
+// Threads that called apply
+std::vector<Scheduling::Thread> started;
+
+pid_t currentThreadID() {
+#ifdef __APPLE__
+  uint64_t tid;
+  pthread_threadid_np(nullptr, &tid);
+  return (pid_t) tid;
+#else
+  return (pid_t) syscall(SYS_gettid);
+#endif
+}
+
+int policyFromName(const std::string& name) {
+  if (name == "fifo") {
+    return SCHED_FIFO;
+  }
+  if (name == "rr") {
+    return SCHED_RR;
+  }
+  return SCHED_OTHER;
+}
+
+std::string policyName(int policy) {
+  switch (policy) {
+  case SCHED_OTHER:
+    return "other";
+  case SCHED_FIFO:
+    return "fifo";
+  case SCHED_RR:
+    return "rr";
+#ifdef __linux__
+  case SCHED_IDLE:
+    return "idle";
+  case SCHED_BATCH:
+    return "batch";
+#endif
+  }
+  return std::to_string(policy);
+}
+
+// Looks up the settings of the role, falling back to the role before
+// the dot. Must be called with the mutex held.
+bool findSettings(const std::string& role, Config::Thread& thread) {
+  auto it = settings.find(role);
+  if (it == settings.end()) {
+    it = settings.find(role.substr(0, role.find('.')));
+  }
+  if (it == settings.end()) {
+    return false;
+  }
+  thread = it->second;
+  return true;
+}
+
+// Applies the settings to the calling thread.
+// Returns an error message if one of them couldn't be applied.
+std::string applySettings(const Config::Thread& thread) {
+  std::stringstream ss;
+
+  if (!thread.cpus.empty()) {
+#ifdef __APPLE__
+    return "CPU affinity is not supported on this platform";
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const auto cpu : thread.cpus) {
+      if (cpu >= CPU_SETSIZE) {
+        ss << "CPU " << cpu << " is out of range";
+        return ss.str();
+      }
+      CPU_SET(cpu, &set);
+    }
+    auto rv = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rv != 0) {
+      ss << "unable to set CPU affinity: " << strerror(rv);
+      return ss.str();
+    }
+#endif
+  }
+
+  // The policy is always set, also if it is "other", such that it
+  // replaces a policy the thread may have been started with
+  {
+    const auto policy = policyFromName(thread.policy);
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = thread.priority;
+    auto rv = pthread_setschedparam(pthread_self(), policy, &param);
+    if (rv != 0) {
+      ss << "unable to set policy " << thread.policy
+         << " with priority " << thread.priority
+         << ": " << strerror(rv);
+      if (rv == EPERM) {
+        ss << " (requires CAP_SYS_NICE or a high enough RLIMIT_RTPRIO)";
+      }
+      return ss.str();
+    }
+  }
+
+  if (thread.nice != 0) {
+#ifdef __APPLE__
+    return "per thread nice levels are not supported on this platform";
+#else
+    auto rv = setpriority(PRIO_PROCESS, currentThreadID(), thread.nice);
+    if (rv < 0) {
+      ss << "unable to set nice level " << thread.nice
+         << ": " << strerror(errno);
+      if (errno == EACCES || errno == EPERM) {
+        ss << " (requires CAP_SYS_NICE or a high enough RLIMIT_NICE)";
+      }
+      return ss.str();
+    }
+#endif
+  }
+
+  return "";
+}
+
+// Returns the settings of the calling thread
+Scheduling::Thread currentSettings(const std::string& role) {
+  Scheduling::Thread out;
+  out.role = role;
+  out.tid = currentThreadID();
+
+#ifndef __APPLE__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) {
+        out.cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+
+  int policy = SCHED_OTHER;
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  pthread_getschedparam(pthread_self(), &policy, &param);
+  out.policy = policyName(policy);
+  out.priority = param.sched_priority;
+
+#ifdef __APPLE__
+  out.nice = getpriority(PRIO_PROCESS, 0);
+#else
+  out.nice = getpriority(PRIO_PROCESS, out.tid);
+#endif
+  return out;
+}
+
+} // namespace
+
+void Scheduling::initialize(
+    const std::map<std::string, Config::Thread>& threads) {
+  for (const auto& it : threads) {
+    std::string error;
+    std::thread probe([&] { error = applySettings(it.second); });
+    probe.join();
+    if (!error.empty()) {
+      std::stringstream ss;
+      ss << "threads." << it.first << ": " << error;
+      throw std::runtime_error(ss.str());
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  settings = threads;
+  initialized = true;
+}
+
+bool Scheduling::configured(const std::string& role) {
+  std::unique_lock<std::mutex> lock(mutex);
+  Config::Thread thread;
+  return initialized && findSettings(role, thread);
+}
+
+void Scheduling::apply(const std::string& role) {
+  Config::Thread thread;
+  bool found = false;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!initialized) {
+      return;
+    }
+    found = findSettings(role, thread);
+  }
+
+  // The settings were checked on startup; if they fail now, the thread
+  // can still do its job without them
+  if (found) {
+    auto error = applySettings(thread);
+    if (!error.empty()) {
+      std::cerr << "threads." << role << ": " << error << std::endl;
+    }
+  }
+
+  auto current = currentSettings(role);
+  std::unique_lock<std::mutex> lock(mutex);
+  started.push_back(std::move(current));
+}
+
+std::vector<Scheduling::Thread> Scheduling::getThreads() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return started;
+}
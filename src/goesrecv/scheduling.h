@@ -0,0 +1,65 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+// Scheduling applies the [threads] section of the configuration: the
+// CPUs a thread may run on, its scheduling policy and real-time
+// priority, and its nice level. By default every thread is left to
+// the scheduler, and on a busy host the demodulator can be preempted
+// long enough for the source to drop samples. Pinning the demodulator
+// to cores of its own, with a real-time priority, keeps it running.
+//
+// Threads look up their settings by role ("source", "demodulator",
+// "decoder", ...) when they start. They apply them to themselves,
+// because on Linux the nice level is a property of the thread, and can
+// only be set through its thread ID.
+//
+// Settings are checked on startup by applying them to a thread that
+// does nothing else. A setting that can't be applied (e.g. a real-time
+// priority without the privilege to use it) fails there, instead of
+// being reported by every thread that tries it.
+//
+// Every thread records the settings it ends up with, as reported by
+// the kernel, such that they can be included in the stats.
+//
+class Scheduling {
+public:
+  struct Thread {
+    std::string role;
+    pid_t tid;
+
+    // CPUs the thread may run on
+    std::vector<int> cpus;
+
+    // "other", "fifo", "rr", "idle", "batch" (the latter two are
+    // not configurable), or the number of an unnamed policy
+    std::string policy;
+    int priority;
+    int nice;
+  };
+
+  // Checks that the settings of every role can be applied, and keeps
+  // them for apply. Throws std::runtime_error if they can't be.
+  static void initialize(const std::map<std::string, Config::Thread>& threads);
+
+  // Applies the settings of the role to the calling thread, if any.
+  // A role with a qualifier (e.g. "demodulator.costas") uses the
+  // settings of the role before the dot if it has none of its own.
+  // Does nothing until initialize has been called.
+  static void apply(const std::string& role);
+
+  // Returns if the role has settings of its own (or through the role
+  // before the dot), i.e. if apply would change the calling thread.
+  // Threads with a default of their own (e.g. a low priority) only
+  // use it if the role is not configured.
+  static bool configured(const std::string& role);
+
+  // Returns the settings of the threads that called apply.
+  static std::vector<Thread> getThreads();
+};
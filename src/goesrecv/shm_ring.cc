@@ -0,0 +1,274 @@
+#include "shm_ring.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+#include <util/error.h>
+
+static_assert(sizeof(ShmRing::Header) == 192, "Unexpected header size");
+
+constexpr mode_t ShmRing::defaultMode;
+
+namespace {
+
+uint64_t monotonicTime() {
+  struct timespec ts;
+  auto rv = clock_gettime(CLOCK_MONOTONIC, &ts);
+  ASSERT(rv == 0);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+[[noreturn]] void throwError(const std::string& call, const std::string& name) {
+  std::stringstream ss;
+  ss << call << ": " << strerror(errno) << " (" << name << ")";
+  throw std::runtime_error(ss.str());
+}
+
+// Maps the header followed by the data twice. Returns the base of the
+// mapping (its length is dataOffset + 2 * capacity).
+void* map(int fd, size_t dataOffset, size_t capacity, const std::string& name) {
+  const size_t length = dataOffset + 2 * capacity;
+
+  // Reserve address space for both copies
+  auto base = mmap(nullptr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    throwError("mmap", name);
+  }
+
+  auto* p = static_cast<uint8_t*>(base);
+  auto rv = mmap(
+    p,
+    dataOffset + capacity,
+    PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_FIXED,
+    fd,
+    0);
+  if (rv == MAP_FAILED) {
+    munmap(base, length);
+    throwError("mmap", name);
+  }
+
+  rv = mmap(
+    p + dataOffset + capacity,
+    capacity,
+    PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_FIXED,
+    fd,
+    dataOffset);
+  if (rv == MAP_FAILED) {
+    munmap(base, length);
+    throwError("mmap", name);
+  }
+
+  return base;
+}
+
+} // namespace
+
+std::unique_ptr<ShmRing> ShmRing::create(
+    const std::string& name,
+    size_t size,
+    uint32_t elementSize,
+    mode_t mode) {
+  ASSERT(elementSize > 0);
+  const size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t capacity = pageSize;
+  while (capacity < size) {
+    capacity <<= 1;
+  }
+
+  // Readers of a previous instance keep their (stale) mapping
+  shm_unlink(name.c_str());
+  auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, mode);
+  if (fd < 0) {
+    throwError("shm_open", name);
+  }
+
+  // The mode passed to shm_open is masked by the umask
+  if (fchmod(fd, mode) < 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    throwError("fchmod", name);
+  }
+
+  const size_t dataOffset = pageSize;
+  if (ftruncate(fd, dataOffset + capacity) < 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    throwError("ftruncate", name);
+  }
+
+  void* base;
+  try {
+    base = map(fd, dataOffset, capacity, name);
+  } catch (...) {
+    close(fd);
+    shm_unlink(name.c_str());
+    throw;
+  }
+  close(fd);
+
+  auto* header = new (base) Header;
+  header->elementSize = elementSize;
+  header->dataOffset = dataOffset;
+  header->capacity = capacity;
+  header->head.store(0);
+  header->heartbeat.store(0);
+  header->version = version;
+
+  // Readers check the magic last
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = magic;
+
+  auto* data = static_cast<uint8_t*>(base) + dataOffset;
+  return std::unique_ptr<ShmRing>(
+    new ShmRing(
+      name,
+      base,
+      dataOffset + 2 * capacity,
+      header,
+      data,
+      capacity,
+      elementSize));
+}
+
+ShmRing::ShmRing(
+    std::string name,
+    void* base,
+    size_t length,
+    Header* header,
+    uint8_t* data,
+    size_t capacity,
+    uint32_t elementSize)
+    : name_(std::move(name)),
+      base_(base),
+      length_(length),
+      header_(header),
+      data_(data),
+      capacity_(capacity),
+      elementSize_(elementSize),
+      head_(0) {
+}
+
+ShmRing::~ShmRing() {
+  munmap(base_, length_);
+  shm_unlink(name_.c_str());
+}
+
+bool ShmRing::hasReaders() const {
+  const auto heartbeat = header_->heartbeat.load(std::memory_order_relaxed);
+  return heartbeat != 0 && monotonicTime() - heartbeat < 1000000000ull;
+}
+
+void ShmRing::commit(size_t nbytes) {
+  ASSERT(nbytes <= maxWrite());
+  ASSERT((nbytes % elementSize_) == 0);
+  head_ += nbytes;
+  header_->head.store(head_, std::memory_order_release);
+}
+
+void ShmRing::write(const void* buf, size_t nbytes) {
+  const auto* p = static_cast<const uint8_t*>(buf);
+  const size_t chunk = maxWrite() - (maxWrite() % elementSize_);
+  while (nbytes > 0) {
+    const auto n = std::min(nbytes, chunk);
+    memcpy(reserve(), p, n);
+    commit(n);
+    p += n;
+    nbytes -= n;
+  }
+}
+
+std::unique_ptr<ShmRing::Reader> ShmRing::Reader::open(const std::string& name) {
+  auto fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    throwError("shm_open", name);
+  }
+
+  // Read the header to find the size of the ring
+  char buf[sizeof(Header)];
+  uint32_t m = 0;
+  uint32_t v = 0;
+  uint32_t dataOffset = 0;
+  uint64_t capacity = 0;
+  if (pread(fd, buf, sizeof(buf), 0) == sizeof(buf)) {
+    memcpy(&m, buf + offsetof(Header, magic), sizeof(m));
+    memcpy(&v, buf + offsetof(Header, version), sizeof(v));
+    memcpy(&dataOffset, buf + offsetof(Header, dataOffset), sizeof(dataOffset));
+    memcpy(&capacity, buf + offsetof(Header, capacity), sizeof(capacity));
+  }
+  if (m != magic || v != version) {
+    close(fd);
+    std::stringstream ss;
+    ss << "Not a ring buffer (or an incompatible version): " << name;
+    throw std::runtime_error(ss.str());
+  }
+
+  void* base;
+  try {
+    base = map(fd, dataOffset, capacity, name);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+
+  auto* h = static_cast<Header*>(base);
+  auto* data = static_cast<uint8_t*>(base) + dataOffset;
+  const auto length = dataOffset + 2 * capacity;
+  return std::unique_ptr<Reader>(new Reader(base, length, h, data));
+}
+
+ShmRing::Reader::Reader(void* base, size_t length, Header* header, uint8_t* data)
+    : base_(base),
+      length_(length),
+      header_(header),
+      data_(data),
+      lost_(0) {
+  // Start at the current head
+  tail_ = header_->head.load(std::memory_order_acquire);
+}
+
+ShmRing::Reader::~Reader() {
+  munmap(base_, length_);
+}
+
+size_t ShmRing::Reader::poll(const uint8_t** data) {
+  header_->heartbeat.store(monotonicTime(), std::memory_order_relaxed);
+
+  // The writer may be writing up to half the ring past the head, so
+  // only the half before the head is safe to read
+  const auto capacity = header_->capacity;
+  const auto head = header_->head.load(std::memory_order_acquire);
+  if (head - tail_ > capacity / 2) {
+    lost_ += head - tail_;
+    tail_ = head;
+  }
+
+  *data = data_ + (tail_ & (capacity - 1));
+  return head - tail_;
+}
+
+bool ShmRing::Reader::consume(size_t nbytes) {
+  const auto start = tail_;
+  tail_ += nbytes;
+
+  // Orders the reads of the data before the load of the head
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const auto head = header_->head.load(std::memory_order_relaxed);
+  if (head - start > header_->capacity / 2) {
+    lost_ += nbytes;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+// ShmRing is a ring buffer in POSIX shared memory with a single writer
+// (goesrecv) and any number of readers (local consumers of a tap).
+//
+// The writer never waits for readers. It writes a block to the ring
+// and then advances the head, without a system call. Readers map the
+// same memory, and read blocks in place, also without system calls. A
+// reader that falls behind by more than the size of the ring loses
+// data, which it detects from the head (see Reader).
+//
+// Layout of the shared memory object:
+//
+//   offset 0:      header (see Header), padded to dataOffset
+//   dataOffset:    data, capacity bytes (a power of 2)
+//
+// The data is mapped twice, back to back, such that any range of up
+// to capacity bytes starting within the ring is contiguous in memory.
+// The head is the total number of bytes ever written. The byte at
+// position p is found at data[p & (capacity - 1)].
+//
+// Elements (elementSize bytes, e.g. 2 for complex int8 samples) are
+// never split across writes. Readers announce themselves by updating
+// the heartbeat whenever they poll; the writer skips publishing when
+// no reader has polled for a second.
+//
+// Readers can write to the header (for the heartbeat), so the writer
+// never reads the layout of the ring back from it; a reader can only
+// corrupt the data it reads itself.
+//
+class ShmRing {
+public:
+  static constexpr uint32_t magic = 0x474f4553; // "GOES"
+  static constexpr uint32_t version = 1;
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t elementSize;
+    uint32_t dataOffset;
+    uint64_t capacity;
+    char pad0[40];
+
+    // Total number of bytes written (release order)
+    std::atomic<uint64_t> head;
+    char pad1[56];
+
+    // CLOCK_MONOTONIC time of the last poll of any reader (ns)
+    std::atomic<uint64_t> heartbeat;
+    char pad2[56];
+  };
+
+  // Permissions of the shared memory object (owner only)
+  static constexpr mode_t defaultMode = 0600;
+
+  // Creates (or replaces) the shared memory object with the specified
+  // name (e.g. "/goesrecv-clock-recovery"). The size is rounded up to
+  // a power of 2 (and at least a page). Readers need read and write
+  // permission (the mode is not subject to the umask).
+  static std::unique_ptr<ShmRing> create(
+      const std::string& name,
+      size_t size,
+      uint32_t elementSize,
+      mode_t mode = defaultMode);
+
+  ~ShmRing();
+
+  // Returns true if a reader has polled in the last second.
+  bool hasReaders() const;
+
+  // Largest number of bytes that can be written at once
+  size_t maxWrite() const {
+    return capacity_ / 2;
+  }
+
+  // Returns a pointer to write up to maxWrite() bytes to. They become
+  // visible to readers when committed.
+  uint8_t* reserve() {
+    return data_ + (head_ & (capacity_ - 1));
+  }
+
+  void commit(size_t nbytes);
+
+  // Copies bytes to the ring, in chunks of at most maxWrite() bytes.
+  void write(const void* buf, size_t nbytes);
+
+  // Reader of a ring created by another process.
+  class Reader {
+  public:
+    static std::unique_ptr<Reader> open(const std::string& name);
+
+    ~Reader();
+
+    uint32_t getElementSize() const {
+      return header_->elementSize;
+    }
+
+    // Returns the number of bytes that are ready to be read at data,
+    // or 0 if there are none. A reader that fell behind skips ahead,
+    // and the bytes it missed are counted as lost.
+    size_t poll(const uint8_t** data);
+
+    // Marks bytes returned by poll as read. Returns false if the writer
+    // may have overwritten them in the meantime, in which case whatever
+    // was read from them must be discarded.
+    bool consume(size_t nbytes);
+
+    // Total number of bytes this reader missed
+    uint64_t getLost() const {
+      return lost_;
+    }
+
+  protected:
+    Reader(void* base, size_t length, Header* header, uint8_t* data);
+
+    void* base_;
+    size_t length_;
+    Header* header_;
+    uint8_t* data_;
+    uint64_t tail_;
+    uint64_t lost_;
+  };
+
+protected:
+  ShmRing(
+      std::string name,
+      void* base,
+      size_t length,
+      Header* header,
+      uint8_t* data,
+      size_t capacity,
+      uint32_t elementSize);
+
+  const std::string name_;
+  void* base_;
+  size_t length_;
+  Header* header_;
+  uint8_t* data_;
+  const size_t capacity_;
+  const uint32_t elementSize_;
+
+  // Only the writer writes the head, so it keeps its own copy
+  uint64_t head_;
+};
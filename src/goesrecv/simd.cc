@@ -0,0 +1,73 @@
+#include "simd.h"
+
+#include <initializer_list>
+#include <stdexcept>
+
+const char* simdName(SIMD simd) {
+  switch (simd) {
+  case SIMD::NONE:
+    return "none";
+  case SIMD::NEON:
+    return "neon";
+  case SIMD::SSE2:
+    return "sse2";
+  case SIMD::SSE41:
+    return "sse4.1";
+  case SIMD::AVX2:
+    return "avx2";
+  }
+  return "unknown";
+}
+
+SIMD simdFromName(const std::string& name) {
+  for (auto simd : { SIMD::NONE, SIMD::NEON, SIMD::SSE2, SIMD::SSE41, SIMD::AVX2 }) {
+    if (name == simdName(simd)) {
+      return simd;
+    }
+  }
+  throw std::invalid_argument("Unknown instruction set: " + name);
+}
+
+bool simdSupported(SIMD simd) {
+  switch (simd) {
+  case SIMD::NONE:
+    return true;
+  case SIMD::NEON:
+#ifdef __ARM_NEON
+    return true;
+#else
+    return false;
+#endif
+  case SIMD::SSE2:
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#else
+    return false;
+#endif
+  case SIMD::SSE41:
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.1");
+#else
+    return false;
+#endif
+  case SIMD::AVX2:
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+SIMD simdBest() {
+  for (auto simd : { SIMD::AVX2, SIMD::SSE41, SIMD::SSE2, SIMD::NEON }) {
+    if (simdSupported(simd)) {
+      return simd;
+    }
+  }
+  return SIMD::NONE;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+
+// Instruction set extensions that DSP kernels can be specialized for.
+//
+// On ARM, NEON support is a compile time decision (see the top level
+// CMakeLists.txt). On x86, every variant is compiled into the binary
+// using function level target attributes, and the CPU is queried at
+// runtime to find out which variants can be used.
+//
+// SSE2 is part of every x86-64 CPU. Only the sample conversions (see
+// convert.h) have an SSE2 variant; every other kernel runs its scalar
+// implementation when asked for SSE2.
+//
+enum class SIMD {
+  NONE,
+  NEON,
+  SSE2,
+  SSE41,
+  AVX2,
+};
+
+// Returns human readable name of instruction set.
+const char* simdName(SIMD simd);
+
+// Returns instruction set with specified name (see simdName).
+// Throws std::invalid_argument if the name is unknown.
+SIMD simdFromName(const std::string& name);
+
+// Returns whether or not this CPU supports the instruction set.
+bool simdSupported(SIMD simd);
+
+// Returns the best instruction set supported by this CPU.
+SIMD simdBest();
+
+// Helpers that are shared between kernels for different instruction
+// sets must be inlined. Otherwise they are compiled for the baseline
+// instruction set and called from within the kernel's inner loop.
+#define SIMD_INLINE inline __attribute__((always_inline))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
@@ -18,6 +18,10 @@ SoftBitPublisher::~SoftBitPublisher() {
 }
 
 void SoftBitPublisher::publish(const std::vector<int8_t>& bits) {
+  if (hasRingReaders()) {
+    ring_->write(bits.data(), bits.size() * sizeof(bits[0]));
+  }
+
   if (!hasSubscribers()) {
     return;
   }
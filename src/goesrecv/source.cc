@@ -2,6 +2,8 @@
 
 #include <algorithm>
 
+#include <util/error.h>
+
 #ifdef BUILD_AIRSPY
 #include "airspy_source.h"
 #endif
@@ -10,7 +12,44 @@
 #include "rtlsdr_source.h"
 #endif
 
+#include "file_source.h"
 #include "nanomsg_source.h"
+#include "rtltcp_source.h"
+#include "spectrum.h"
+
+namespace {
+
+Source::Overflow overflow(const Config& config) {
+  const auto& policy = config.demodulator.sourceOverflow;
+  if (policy == "drop_newest") {
+    return Source::Overflow::DROP_NEWEST;
+  }
+  if (policy == "drop_oldest") {
+    return Source::Overflow::DROP_OLDEST;
+  }
+  return Source::Overflow::BLOCK;
+}
+
+// Returns the block size that meets the target latency, rounded down
+// to a multiple of the given number of samples, or 0 if there is no
+// target (the source then uses its default).
+uint32_t latencyBlockSize(
+    const Config& config,
+    uint32_t sampleRate,
+    uint32_t multiple) {
+  const auto latency = config.demodulator.latency;
+  if (latency <= 0) {
+    return 0;
+  }
+
+  // A sample waits for the rest of its block to arrive, and then for
+  // the block to pass through the stages. If the demodulator keeps
+  // up, the latter takes less than the duration of a block.
+  const uint32_t n = (sampleRate * latency) / 2000.0;
+  return std::max(n - (n % multiple), multiple);
+}
+
+} // namespace
 
 std::unique_ptr<Source> Source::build(
     const std::string& type,
@@ -44,7 +83,14 @@ std::unique_ptr<Source> Source::build(
     airspy->setFrequency(config.airspy.frequency);
     airspy->setGain(config.airspy.gain);
     airspy->setBiasTee(config.airspy.bias_tee);
+    airspy->setRealSamples(config.airspy.sampleType == "int16_real");
+    Spectrum::attach(
+      config.airspy.samplePublisher,
+      config.spectrum,
+      "source",
+      airspy->getSampleRate());
     airspy->setSamplePublisher(std::move(config.airspy.samplePublisher));
+    airspy->setOverflow(overflow(config));
     return std::unique_ptr<Source>(airspy.release());
 #else
     throw std::runtime_error(
@@ -68,7 +114,20 @@ std::unique_ptr<Source> Source::build(
     rtlsdr->setFrequency(config.rtlsdr.frequency);
     rtlsdr->setTunerGain(config.rtlsdr.gain);
     rtlsdr->setBiasTee(config.rtlsdr.bias_tee);
+    if (config.rtlsdr.blockSize == 0) {
+      config.rtlsdr.blockSize =
+        latencyBlockSize(config, rtlsdr->getSampleRate(), 256);
+    }
+    if (config.rtlsdr.blockSize != 0) {
+      rtlsdr->setBlockSize(config.rtlsdr.blockSize);
+    }
+    Spectrum::attach(
+      config.rtlsdr.samplePublisher,
+      config.spectrum,
+      "source",
+      rtlsdr->getSampleRate());
     rtlsdr->setSamplePublisher(std::move(config.rtlsdr.samplePublisher));
+    rtlsdr->setOverflow(overflow(config));
     return std::unique_ptr<Source>(rtlsdr.release());
 #else
     throw std::runtime_error(
@@ -79,15 +138,120 @@ std::unique_ptr<Source> Source::build(
       );
 #endif
   }
+  if (type == "rtltcp") {
+    auto rtltcp = RTLTCP::open(config);
+
+    // Use sample rate if set, otherwise default to 2.4MSPS.
+    if (config.rtltcp.sampleRate != 0) {
+      rtltcp->setSampleRate(config.rtltcp.sampleRate);
+    } else {
+      rtltcp->setSampleRate(2400000);
+    }
+    rtltcp->setFrequency(config.rtltcp.frequency);
+    rtltcp->setTunerGain(config.rtltcp.gain);
+    rtltcp->setBiasTee(config.rtltcp.bias_tee);
+    if (config.rtltcp.blockSize == 0) {
+      config.rtltcp.blockSize =
+        latencyBlockSize(config, rtltcp->getSampleRate(), 4);
+    }
+    if (config.rtltcp.blockSize != 0) {
+      rtltcp->setBlockSize(config.rtltcp.blockSize);
+    }
+    Spectrum::attach(
+      config.rtltcp.samplePublisher,
+      config.spectrum,
+      "source",
+      rtltcp->getSampleRate());
+    rtltcp->setSamplePublisher(std::move(config.rtltcp.samplePublisher));
+    rtltcp->setOverflow(overflow(config));
+    return std::unique_ptr<Source>(rtltcp.release());
+  }
   if (type == "nanomsg") {
     auto nanomsg = Nanomsg::open(config);
     nanomsg->setSampleRate(config.nanomsg.sampleRate);
+    Spectrum::attach(
+      config.nanomsg.samplePublisher,
+      config.spectrum,
+      "source",
+      nanomsg->getSampleRate());
     nanomsg->setSamplePublisher(std::move(config.nanomsg.samplePublisher));
+    nanomsg->setOverflow(overflow(config));
     return std::unique_ptr<Source>(nanomsg.release());
   }
+  if (type == "file") {
+    auto file = FileSource::open(config.file);
+    if (config.file.blockSize == 0) {
+      const auto blockSize =
+        latencyBlockSize(config, file->getSampleRate(), 4);
+      if (blockSize != 0) {
+        file->setBlockSize(blockSize);
+      }
+    }
+    Spectrum::attach(
+      config.file.samplePublisher,
+      config.spectrum,
+      "source",
+      file->getSampleRate());
+    file->setSamplePublisher(std::move(config.file.samplePublisher));
+    return std::unique_ptr<Source>(file.release());
+  }
 
   throw std::runtime_error("Invalid source: " + type);
 }
 
-Source::~Source() {
+void Source::setSIMD(SIMD simd) {
+  ASSERT(simdSupported(simd));
+  simd_ = simd;
+}
+
+std::unique_ptr<Samples> Source::popForWrite(
+    Queue<Samples>& queue,
+    size_t nsamples) {
+  if (overflow_ == Overflow::BLOCK) {
+    return queue.popForWrite();
+  }
+
+  auto out = queue.tryPopForWrite();
+  if (out) {
+    return out;
+  }
+
+  // Take back the oldest block the demodulator hasn't read yet.
+  // If it has borrowed every buffer, drop the new block instead.
+  if (overflow_ == Overflow::DROP_OLDEST) {
+    out = queue.reclaimForWrite();
+    if (out) {
+      drop(out->size());
+      return out;
+    }
+  }
+
+  drop(nsamples);
+  return std::unique_ptr<Samples>();
+}
+
+void Source::drop(size_t nsamples) {
+  droppedSamples_.store(
+    droppedSamples_.load(std::memory_order_relaxed) + nsamples,
+    std::memory_order_relaxed);
+  droppedBlocks_.store(
+    droppedBlocks_.load(std::memory_order_relaxed) + 1,
+    std::memory_order_relaxed);
+}
+
+void Source::stall(std::chrono::steady_clock::duration duration) {
+  const auto us =
+    std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  stalls_.store(
+    stalls_.load(std::memory_order_relaxed) + 1,
+    std::memory_order_relaxed);
+  stallTime_.store(
+    stallTime_.load(std::memory_order_relaxed) + us,
+    std::memory_order_relaxed);
+}
+
+void Source::disconnect() {
+  disconnects_.store(
+    disconnects_.load(std::memory_order_relaxed) + 1,
+    std::memory_order_relaxed);
 }
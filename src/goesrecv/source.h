@@ -1,19 +1,47 @@
 #pragma once
 
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
 #include <memory>
 
 #include "config.h"
 #include "sample_publisher.h"
+#include "simd.h"
 #include "types.h"
 
 // Pure virtual base class for every source of samples.
 class Source {
 public:
+  // What a source does with a block of samples when the queue has no
+  // empty buffer for it, because the demodulator is falling behind.
+  // A device source that blocks stalls the USB transfers of its
+  // driver, which then loses samples without telling anyone. Either
+  // drop policy keeps the transfers going and counts what it drops.
+  enum class Overflow {
+    // Wait for the demodulator (default)
+    BLOCK,
+    // Drop the new block
+    DROP_NEWEST,
+    // Drop the oldest block in the queue, in favor of the new one
+    DROP_OLDEST,
+  };
+
   static std::unique_ptr<Source> build(
       const std::string& type,
       Config& config);
 
-  virtual ~Source();
+  Source()
+      : droppedSamples_(0),
+        droppedBlocks_(0),
+        stalls_(0),
+        stallTime_(0),
+        disconnects_(0) {
+  }
+
+  virtual ~Source() {
+  }
 
   // Sample rate is set in the configuration
   virtual uint32_t getSampleRate() const = 0;
@@ -23,4 +51,66 @@ public:
 
   // Stop producing samples
   virtual void stop() = 0;
+
+  // Select sample conversion implementation (defaults to best supported).
+  // Sources that don't convert samples themselves ignore this.
+  void setSIMD(SIMD simd);
+
+  SIMD getSIMD() const {
+    return simd_;
+  }
+
+  // Select overflow policy (defaults to blocking).
+  // Sources that must not lose samples (files) ignore this.
+  void setOverflow(Overflow overflow) {
+    overflow_ = overflow;
+  }
+
+  // Total number of samples and blocks dropped on overflow
+  virtual uint64_t getDroppedSamples() const {
+    return droppedSamples_.load(std::memory_order_relaxed);
+  }
+
+  virtual uint64_t getDroppedBlocks() const {
+    return droppedBlocks_.load(std::memory_order_relaxed);
+  }
+
+  // Number of times a network source waited long for samples, and the
+  // total time it waited then (in microseconds). Other sources don't
+  // stall (or can't tell).
+  virtual uint64_t getStalls() const {
+    return stalls_.load(std::memory_order_relaxed);
+  }
+
+  virtual uint64_t getStallTime() const {
+    return stallTime_.load(std::memory_order_relaxed);
+  }
+
+  // Number of times a network source lost its connection to the
+  // server. Other sources don't disconnect.
+  virtual uint64_t getDisconnects() const {
+    return disconnects_.load(std::memory_order_relaxed);
+  }
+
+protected:
+  // Returns a buffer to write a block of nsamples to, according to
+  // the overflow policy. Returns nullptr if the block must be dropped,
+  // in which case it has been counted as such.
+  std::unique_ptr<Samples> popForWrite(Queue<Samples>& queue, size_t nsamples);
+
+  void drop(size_t nsamples);
+
+  void stall(std::chrono::steady_clock::duration duration);
+
+  void disconnect();
+
+  SIMD simd_ = simdBest();
+  Overflow overflow_ = Overflow::BLOCK;
+
+  // Written by the thread producing samples only
+  std::atomic<uint64_t> droppedSamples_;
+  std::atomic<uint64_t> droppedBlocks_;
+  std::atomic<uint64_t> stalls_;
+  std::atomic<uint64_t> stallTime_;
+  std::atomic<uint64_t> disconnects_;
 };
@@ -0,0 +1,203 @@
+#include "spectrum.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <util/error.h>
+
+#include "scheduling.h"
+
+namespace {
+
+// Upper limit of samples handed over at once, in FFTs
+constexpr size_t maxSegments = 16;
+
+Spectrum::Window windowFromName(const std::string& name) {
+  if (name == "rectangular") {
+    return Spectrum::Window::RECTANGULAR;
+  }
+  if (name == "blackman") {
+    return Spectrum::Window::BLACKMAN;
+  }
+  return Spectrum::Window::HANN;
+}
+
+} // namespace
+
+void Spectrum::attach(
+    std::unique_ptr<SamplePublisher>& publisher,
+    Config::Spectrum& config,
+    const std::string& tap,
+    uint32_t sampleRate) {
+  if (!config.publisher || config.tap != tap) {
+    return;
+  }
+
+  // A sample publisher without endpoint only feeds the spectrum
+  if (!publisher) {
+    publisher = std::make_unique<SamplePublisher>(-1);
+  }
+
+  auto spectrum = std::make_shared<Spectrum>(
+    std::move(config.publisher),
+    sampleRate,
+    config.size,
+    windowFromName(config.window),
+    std::chrono::milliseconds(config.interval));
+  publisher->setTap([spectrum] (const Samples& samples) {
+      spectrum->push(samples);
+    });
+}
+
+Spectrum::Spectrum(
+    std::unique_ptr<SpectrumPublisher> publisher,
+    uint32_t sampleRate,
+    size_t size,
+    Window window,
+    std::chrono::milliseconds interval)
+    : publisher_(std::move(publisher)),
+      sampleRate_(sampleRate),
+      size_(size),
+      interval_(interval),
+      fft_(size),
+      window_(size),
+      tmp_(size),
+      power_(size, 0.0),
+      count_(0),
+      bins_(size),
+      stop_(false) {
+  // Window, normalized such that a full scale sinusoid at the center
+  // of a bin has a power of 1 (0 dB)
+  double sum = 0.0;
+  for (size_t i = 0; i < size; i++) {
+    const double x = (2 * M_PI * i) / size;
+    double w = 1.0;
+    switch (window) {
+    case Window::HANN:
+      w = 0.5 - 0.5 * cos(x);
+      break;
+    case Window::BLACKMAN:
+      w = 0.42 - 0.5 * cos(x) + 0.08 * cos(2 * x);
+      break;
+    default:
+      break;
+    }
+    window_[i] = w;
+    sum += w;
+  }
+  for (auto& w : window_) {
+    w /= sum;
+  }
+
+  thread_ = std::thread(&Spectrum::loop, this);
+#ifdef __APPLE__
+  pthread_setname_np("spectrum");
+#else
+  pthread_setname_np(thread_.native_handle(), "spectrum");
+#endif
+}
+
+Spectrum::~Spectrum() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+void Spectrum::push(const Samples& samples) {
+  std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+
+  // Blocks are not contiguous, so only whole FFTs are copied
+  const size_t room = maxSegments * size_ - input_.size();
+  const size_t n = std::min(room, samples.size()) & ~(size_ - 1);
+  if (n == 0) {
+    return;
+  }
+  input_.insert(input_.end(), samples.begin(), samples.begin() + n);
+  lock.unlock();
+  cv_.notify_one();
+}
+
+void Spectrum::loop() {
+#ifdef __linux__
+  // Only run when nothing else wants the CPU, unless [threads.spectrum]
+  // says otherwise. Leaving SCHED_IDLE again can require privileges,
+  // so it's not set at all if the role is configured.
+  if (!Scheduling::configured("spectrum")) {
+    struct sched_param param;
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+  }
+#endif
+
+  Scheduling::apply("spectrum");
+
+  Samples samples;
+  auto deadline = std::chrono::steady_clock::now() + interval_;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait_until(lock, deadline, [this] {
+          return stop_ || !input_.empty();
+        });
+      if (stop_) {
+        break;
+      }
+      std::swap(samples, input_);
+    }
+
+    process(samples);
+    samples.clear();
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      publish();
+      deadline += interval_;
+
+      // Don't try to catch up after falling behind
+      if (deadline < now) {
+        deadline = now + interval_;
+      }
+    }
+  }
+}
+
+void Spectrum::process(const Samples& samples) {
+  for (size_t i = 0; i + size_ <= samples.size(); i += size_) {
+    for (size_t j = 0; j < size_; j++) {
+      tmp_[j] = samples[i + j] * window_[j];
+    }
+    fft_.run(tmp_.data());
+    for (size_t j = 0; j < size_; j++) {
+      power_[j] += std::norm(tmp_[j]);
+    }
+    count_++;
+  }
+}
+
+void Spectrum::publish() {
+  if (count_ == 0) {
+    return;
+  }
+
+  // Bins are shifted such that the first is the lowest frequency.
+  // The floor is at -300 dB to stay within range.
+  const size_t half = size_ / 2;
+  for (size_t i = 0; i < size_; i++) {
+    const double power = power_[(i + half) % size_] / count_;
+    const double db = 10.0 * log10(std::max(power, 1e-30));
+    bins_[i] = (int16_t) lrint(100.0 * db);
+  }
+  publisher_->publish(sampleRate_, count_, bins_);
+
+  std::fill(power_.begin(), power_.end(), 0.0);
+  count_ = 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "fft.h"
+#include "sample_publisher.h"
+#include "spectrum_publisher.h"
+#include "types.h"
+
+// Spectrum computes the averaged power spectrum of a stream of samples
+// and publishes it once per interval, such that the signal can be
+// monitored remotely (e.g. for dish alignment) without streaming the
+// samples themselves.
+//
+// It runs on a thread of its own, at the lowest scheduling priority.
+// The thread producing samples hands them over without ever waiting:
+// if the spectrum thread is still busy with the previous blocks, or
+// can't get the CPU, blocks are skipped. The average is computed over
+// whatever was handed over during the interval (Welch's method without
+// overlap), which is plenty to estimate the spectrum.
+//
+// Every bin is the power relative to a full scale complex sinusoid
+// (amplitude 1), in dB. A frame has a 24 byte header (see
+// SpectrumPublisher) followed by the bins in 0.01 dB units, from
+// minus half the sample rate to just below half the sample rate.
+//
+class Spectrum {
+public:
+  enum class Window {
+    RECTANGULAR,
+    HANN,
+    BLACKMAN,
+  };
+
+  // Makes the sample publisher (created if there is none) pass its
+  // samples to a new spectrum, if the spectrum publisher is configured
+  // and taps the specified point ("source" or "agc"). The spectrum
+  // lives as long as the sample publisher.
+  static void attach(
+      std::unique_ptr<SamplePublisher>& publisher,
+      Config::Spectrum& config,
+      const std::string& tap,
+      uint32_t sampleRate);
+
+  explicit Spectrum(
+      std::unique_ptr<SpectrumPublisher> publisher,
+      uint32_t sampleRate,
+      size_t size,
+      Window window,
+      std::chrono::milliseconds interval);
+  ~Spectrum();
+
+  // Copies samples for the spectrum thread, if it is ready for them.
+  // Never waits. Only whole FFTs worth of samples are copied.
+  void push(const Samples& samples);
+
+protected:
+  void loop();
+  void process(const Samples& samples);
+  void publish();
+
+  std::unique_ptr<SpectrumPublisher> publisher_;
+  const uint32_t sampleRate_;
+  const size_t size_;
+  const std::chrono::milliseconds interval_;
+
+  FFT fft_;
+  std::vector<float> window_;
+  std::vector<std::complex<float> > tmp_;
+
+  // Sum of the power of every bin, and the number of FFTs summed
+  std::vector<double> power_;
+  uint32_t count_;
+  std::vector<int16_t> bins_;
+
+  // Samples handed over by push
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  Samples input_;
+  bool stop_;
+
+  std::thread thread_;
+};
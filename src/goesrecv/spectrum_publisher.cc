@@ -0,0 +1,67 @@
+#include "spectrum_publisher.h"
+
+#include <time.h>
+
+#include <cstring>
+
+#include <nanomsg/nn.h>
+#include <nanomsg/pubsub.h>
+
+#include <util/error.h>
+
+namespace {
+
+// Writes a value in little endian byte order.
+template <typename T>
+uint8_t* put(uint8_t* p, T value) {
+  for (size_t i = 0; i < sizeof(T); i++) {
+    p[i] = (value >> (8 * i)) & 0xff;
+  }
+  return p + sizeof(T);
+}
+
+} // namespace
+
+std::unique_ptr<SpectrumPublisher> SpectrumPublisher::create(const std::string& endpoint) {
+  auto fd = Publisher::bind(endpoint);
+  return std::make_unique<SpectrumPublisher>(fd);
+}
+
+SpectrumPublisher::SpectrumPublisher(int fd)
+  : Publisher(fd) {
+}
+
+SpectrumPublisher::~SpectrumPublisher() {
+}
+
+void SpectrumPublisher::publish(
+    uint32_t sampleRate,
+    uint32_t count,
+    const std::vector<int16_t>& bins) {
+  if (!hasSubscribers()) {
+    return;
+  }
+
+  struct timespec ts;
+  auto rv = clock_gettime(CLOCK_REALTIME, &ts);
+  ASSERT(rv == 0);
+  const uint64_t nanos = (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+  // Frame header (24 bytes), followed by the bins
+  tmp_.resize(24 + 2 * bins.size());
+  auto* p = tmp_.data();
+  p = put<uint64_t>(p, nanos);
+  p = put<uint32_t>(p, sampleRate);
+  p = put<uint32_t>(p, bins.size());
+  p = put<uint32_t>(p, count);
+  p = put<uint32_t>(p, 0);
+  for (const auto& bin : bins) {
+    p = put<uint16_t>(p, (uint16_t) bin);
+  }
+
+  rv = nn_send(fd_, tmp_.data(), tmp_.size(), 0);
+  if (rv < 0) {
+    fprintf(stderr, "nn_send: %s\n", nn_strerror(nn_errno()));
+    ASSERT(false);
+  }
+}
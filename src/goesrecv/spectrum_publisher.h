@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+#include "publisher.h"
+
+class SpectrumPublisher : public Publisher {
+public:
+  static std::unique_ptr<SpectrumPublisher> create(const std::string& endpoint);
+
+  explicit SpectrumPublisher(int fd);
+  virtual ~SpectrumPublisher();
+
+  // Publishes a frame with the power of every bin in 0.01 dB units,
+  // from the lowest to the highest frequency (see Spectrum).
+  void publish(
+      uint32_t sampleRate,
+      uint32_t count,
+      const std::vector<int16_t>& bins);
+
+protected:
+  std::vector<uint8_t> tmp_;
+};
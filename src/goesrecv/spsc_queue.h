@@ -0,0 +1,241 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "queue.h"
+
+// SPSCQueue is a lock-free implementation of Queue for exactly one
+// producer thread and one consumer thread.
+//
+// All buffers are allocated up front. Full buffers travel from the
+// producer to the consumer through one ring, and empty buffers travel
+// back through another. Each ring has a single writer and a single
+// reader, so neither needs a lock. A thread that finds its ring empty
+// spins for a little while before parking on a condition variable.
+//
+template <class T>
+class SPSCQueue : public Queue<T> {
+  static constexpr size_t cacheLineSize = 64;
+
+  // Number of times to poll an empty ring before parking.
+  // Polling is useless if there is only a single core.
+  static int spinCount() {
+    return std::thread::hardware_concurrency() > 1 ? 1000 : 0;
+  }
+
+  static void relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__arm__) || defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+
+  // Bounded ring of pointers with one writer and one reader.
+  // The read and write indices are kept on separate cache lines.
+  class Ring {
+  public:
+    explicit Ring(size_t capacity) : head_(0), tail_(0), waiting_(false) {
+      size_t n = 1;
+      while (n < capacity) {
+        n <<= 1;
+      }
+      slots_.reset(new std::atomic<T*>[n]);
+      size_ = n;
+      mask_ = n - 1;
+    }
+
+    // Called by the writer only. The ring is sized to hold every
+    // buffer of the queue, so there is always room.
+    void push(T* v) {
+      const auto tail = tail_.load(std::memory_order_relaxed);
+      ASSERT(tail - head_.load(std::memory_order_acquire) < size_);
+      slots_[tail & mask_].store(v, std::memory_order_relaxed);
+      tail_.store(tail + 1, std::memory_order_release);
+
+      // Pairs with the fence in pop(), such that either the reader
+      // observes the new element, or we observe the reader parking.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (waiting_.load(std::memory_order_relaxed)) {
+        wake();
+      }
+    }
+
+    // Called by the reader only. Returns nullptr if the ring is empty
+    // and the closed flag is set (if the reader should stop waiting).
+    T* pop(const std::atomic<bool>& closed, int spin) {
+      for (int i = 0; i < spin; i++) {
+        auto v = tryPop();
+        if (v != nullptr || closed.load()) {
+          return v;
+        }
+        relax();
+      }
+
+      std::unique_lock<std::mutex> lock(m_);
+      waiting_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      T* v;
+      while ((v = tryPop()) == nullptr && !closed.load()) {
+        cv_.wait(lock);
+      }
+      waiting_.store(false, std::memory_order_relaxed);
+      return v;
+    }
+
+    // The writer may also take back the oldest element (see
+    // reclaimForWrite), so the read index is advanced by whoever
+    // wins the compare-and-swap. The loser discards the element it
+    // read (its slot may have been written again since) and retries.
+    T* tryPop() {
+      auto head = head_.load(std::memory_order_relaxed);
+      for (;;) {
+        if (head == tail_.load(std::memory_order_acquire)) {
+          return nullptr;
+        }
+        auto v = slots_[head & mask_].load(std::memory_order_relaxed);
+        if (head_.compare_exchange_weak(
+              head,
+              head + 1,
+              std::memory_order_acq_rel,
+              std::memory_order_relaxed)) {
+          return v;
+        }
+      }
+    }
+
+    // Number of elements in the ring (approximate from any thread
+    // other than the writer and the reader)
+    size_t count() const {
+      return tail_.load(std::memory_order_relaxed) -
+        head_.load(std::memory_order_relaxed);
+    }
+
+    void wake() {
+      std::unique_lock<std::mutex> lock(m_);
+      cv_.notify_one();
+    }
+
+  protected:
+    std::unique_ptr<std::atomic<T*>[]> slots_;
+    size_t size_;
+    size_t mask_;
+
+    char pad0_[cacheLineSize];
+    std::atomic<size_t> head_;
+    char pad1_[cacheLineSize - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_;
+    char pad2_[cacheLineSize - sizeof(std::atomic<size_t>)];
+
+    // Slow path for a parked reader
+    std::atomic<bool> waiting_;
+    std::mutex m_;
+    std::condition_variable cv_;
+  };
+
+public:
+  explicit SPSCQueue(size_t capacity) :
+      capacity_(capacity),
+      spin_(spinCount()),
+      closed_(false),
+      read_(capacity),
+      write_(capacity) {
+    for (size_t i = 0; i < capacity_; i++) {
+      write_.push(new T());
+    }
+  }
+
+  ~SPSCQueue() {
+    // Buffers that are borrowed are owned by the borrower
+    T* v;
+    while ((v = read_.tryPop()) != nullptr) {
+      delete v;
+    }
+    while ((v = write_.tryPop()) != nullptr) {
+      delete v;
+    }
+  }
+
+  size_t size() override {
+    return capacity_;
+  }
+
+  size_t depth() override {
+    return read_.count();
+  }
+
+  bool closed() override {
+    return closed_.load();
+  }
+
+  void close() override {
+    closed_.store(true);
+    read_.wake();
+    write_.wake();
+  }
+
+  std::unique_ptr<T> popForWrite() override {
+    ASSERT(!closed_.load());
+    auto v = write_.tryPop();
+    if (v == nullptr) {
+      const auto start = this->now();
+      v = write_.pop(closed_, spin_);
+      this->add(this->writeWait_, start);
+    }
+    ASSERT(v != nullptr);
+    return std::unique_ptr<T>(v);
+  }
+
+  std::unique_ptr<T> tryPopForWrite() override {
+    ASSERT(!closed_.load());
+    return std::unique_ptr<T>(write_.tryPop());
+  }
+
+  std::unique_ptr<T> reclaimForWrite() override {
+    ASSERT(!closed_.load());
+    return std::unique_ptr<T>(read_.tryPop());
+  }
+
+  void pushWrite(std::unique_ptr<T> v) override {
+    ASSERT(!closed_.load());
+    read_.push(v.release());
+  }
+
+  std::unique_ptr<T> popForRead() override {
+    auto v = read_.tryPop();
+    if (v == nullptr) {
+      const auto start = this->now();
+      v = read_.pop(closed_, spin_);
+      this->add(this->readWait_, start);
+    }
+
+    // Allow read side to drain; the producer may have pushed
+    // its final buffer right before closing the queue.
+    if (v == nullptr) {
+      v = read_.tryPop();
+    }
+
+    return std::unique_ptr<T>(v);
+  }
+
+  void pushRead(std::unique_ptr<T> v) override {
+    if (!closed_.load()) {
+      write_.push(v.release());
+    }
+  }
+
+protected:
+  const size_t capacity_;
+  const int spin_;
+  std::atomic<bool> closed_;
+
+  // Full buffers, from producer to consumer
+  Ring read_;
+
+  // Empty buffers, from consumer to producer
+  Ring write_;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "quality.h"
+
+// StatsRing passes fixed size records from a single writer to a single
+// reader (the monitor), without locks, allocation, or formatting. The
+// writer never waits: if the reader falls behind (or there is none),
+// new records are dropped.
+template <typename T, size_t N>
+class StatsRing {
+  static_assert((N & (N - 1)) == 0, "Size must be a power of 2");
+
+public:
+  StatsRing() : head_(0), tail_(0) {
+  }
+
+  void push(const T& record) {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == N) {
+      return;
+    }
+    records_[head & (N - 1)] = record;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  bool pop(T& record) {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    record = records_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+protected:
+  std::array<T, N> records_;
+  std::atomic<uint64_t> head_;
+  std::atomic<uint64_t> tail_;
+};
+
+// Stats of the demodulator, for the in-process monitor. JSON for
+// external subscribers is written from the same values (see
+// Demodulator::publishStats).
+struct DemodulatorStats {
+  // Written after every iteration of the thread publishing stats
+  struct Sample {
+    float gain;
+    float frequency;
+    float omega;
+  };
+
+  // Stats of a single stage over the last report period (see
+  // Demodulator::writeStageStats for their meaning)
+  struct Stage {
+    std::string name;
+    int thread;
+    double throughput;
+    double load;
+    double rate;
+    double inputWait;
+    double outputWait;
+
+    // Mean number of input samples per block
+    double blockSize;
+
+    // Percentiles of CPU time per block (seconds)
+    double blockTimeP50;
+    double blockTimeP90;
+    double blockTimeP99;
+    double blockTimeMax;
+
+    double depthMean;
+    uint64_t depthMax;
+    size_t depthSize;
+  };
+
+  // Written every second or so
+  struct Report {
+    std::vector<Stage> stages;
+
+    // Dropped by the source since the previous report
+    uint64_t droppedSamples;
+    uint64_t droppedBlocks;
+
+    // Stalls of a network source since the previous report, and the
+    // time it waited for samples then (seconds)
+    uint64_t stalls;
+    double stallTime;
+
+    // Connections a network source lost since the previous report
+    uint64_t disconnects;
+
+    // Duration of the blocks of the source, and the estimated time
+    // from a sample arriving at the source to its soft bit leaving
+    // the demodulator (seconds, see Demodulator::report)
+    double blockDuration;
+    double latency;
+
+    // Quality of the symbols since the previous report
+    Quality::Report quality;
+  };
+
+  StatsRing<Sample, 4096> samples;
+
+  void pushReport(Report report) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Only keep the latest reports if nobody reads them
+    if (reports_.size() == 16) {
+      reports_.erase(reports_.begin());
+    }
+    reports_.push_back(std::move(report));
+  }
+
+  std::vector<Report> popReports() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Report> out;
+    std::swap(out, reports_);
+    return out;
+  }
+
+protected:
+  // Reports are infrequent and variable size; a lock is cheap enough
+  std::mutex mutex_;
+  std::vector<Report> reports_;
+};
+
+// Stats of the decoder, for the in-process monitor.
+struct DecoderStats {
+  // Written for every packet
+  struct Packet {
+    int64_t skippedSymbols;
+    int viterbiErrors;
+    int reedSolomonErrors;
+    bool ok;
+  };
+
+  StatsRing<Packet, 1024> packets;
+};
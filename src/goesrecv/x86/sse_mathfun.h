@@ -0,0 +1,125 @@
+/* SSE implementation of sincos
+
+   Inspired by Intel Approximate Math library, and based on the
+   corresponding algorithms of the cephes math library
+
+   Modified for goesrecv: only sincos_ps is included, and it is
+   compiled with a function level target attribute so that it can be
+   used from kernels that are selected at runtime.
+*/
+
+/* Copyright (C) 2007  Julien Pommier
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+  (this is the zlib license)
+*/
+
+#pragma once
+
+#include <immintrin.h>
+
+#include "../simd.h"
+
+#define c_minus_cephes_DP1 -0.78515625
+#define c_minus_cephes_DP2 -2.4187564849853515625e-4
+#define c_minus_cephes_DP3 -3.77489497744594108e-8
+#define c_sincof_p0 -1.9515295891E-4
+#define c_sincof_p1  8.3321608736E-3
+#define c_sincof_p2 -1.6666654611E-1
+#define c_coscof_p0  2.443315711809948E-005
+#define c_coscof_p1 -1.388731625493765E-003
+#define c_coscof_p2  4.166664568298827E-002
+#define c_cephes_FOPI 1.27323954473516 // 4 / M_PI
+
+/* evaluation of 4 sines & cosines at once.
+
+   The code is the exact rewriting of the cephes sinf function.
+   Precision is excellent as long as x < 8192.
+  */
+TARGET_SSE41
+static inline void sincos_ps(__m128 x, __m128 *ysin, __m128 *ycos) {
+  const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+  __m128 xmm1, xmm2, xmm3, y;
+  __m128i emm2;
+
+  __m128 sign_bit_sin = _mm_and_ps(x, sign_mask);
+  x = _mm_andnot_ps(sign_mask, x);
+
+  /* scale by 4/Pi */
+  y = _mm_mul_ps(x, _mm_set1_ps(c_cephes_FOPI));
+
+  /* store the integer part of y in emm2 */
+  emm2 = _mm_cvttps_epi32(y);
+  /* j=(j+1) & (~1) (see the cephes sources) */
+  emm2 = _mm_add_epi32(emm2, _mm_set1_epi32(1));
+  emm2 = _mm_and_si128(emm2, _mm_set1_epi32(~1));
+  y = _mm_cvtepi32_ps(emm2);
+
+  /* get the polynom selection mask
+     there is one polynom for 0 <= x <= Pi/4
+     and another one for Pi/4<x<=Pi/2
+
+     Both branches will be computed.
+  */
+  __m128 poly_mask = _mm_castsi128_ps(
+    _mm_cmpeq_epi32(
+      _mm_and_si128(emm2, _mm_set1_epi32(2)),
+      _mm_setzero_si128()));
+
+  /* The magic pass: "Extended precision modular arithmetic"
+     x = ((x - y * DP1) - y * DP2) - y * DP3; */
+  xmm1 = _mm_mul_ps(y, _mm_set1_ps(c_minus_cephes_DP1));
+  xmm2 = _mm_mul_ps(y, _mm_set1_ps(c_minus_cephes_DP2));
+  xmm3 = _mm_mul_ps(y, _mm_set1_ps(c_minus_cephes_DP3));
+  x = _mm_add_ps(x, xmm1);
+  x = _mm_add_ps(x, xmm2);
+  x = _mm_add_ps(x, xmm3);
+
+  __m128i emm0 = _mm_slli_epi32(_mm_and_si128(emm2, _mm_set1_epi32(4)), 29);
+  sign_bit_sin = _mm_xor_ps(sign_bit_sin, _mm_castsi128_ps(emm0));
+  __m128i emm4 = _mm_sub_epi32(emm2, _mm_set1_epi32(2));
+  emm4 = _mm_andnot_si128(emm4, _mm_set1_epi32(4));
+  __m128 sign_bit_cos = _mm_castsi128_ps(_mm_slli_epi32(emm4, 29));
+
+  /* Evaluate the first polynom  (0 <= x <= Pi/4) in y1,
+     and the second polynom      (Pi/4 <= x <= 0) in y2 */
+  __m128 z = _mm_mul_ps(x, x);
+  __m128 y1, y2;
+
+  y1 = _mm_mul_ps(z, _mm_set1_ps(c_coscof_p0));
+  y2 = _mm_mul_ps(z, _mm_set1_ps(c_sincof_p0));
+  y1 = _mm_add_ps(y1, _mm_set1_ps(c_coscof_p1));
+  y2 = _mm_add_ps(y2, _mm_set1_ps(c_sincof_p1));
+  y1 = _mm_mul_ps(y1, z);
+  y2 = _mm_mul_ps(y2, z);
+  y1 = _mm_add_ps(y1, _mm_set1_ps(c_coscof_p2));
+  y2 = _mm_add_ps(y2, _mm_set1_ps(c_sincof_p2));
+  y1 = _mm_mul_ps(y1, z);
+  y2 = _mm_mul_ps(y2, z);
+  y1 = _mm_mul_ps(y1, z);
+  y2 = _mm_mul_ps(y2, x);
+  y1 = _mm_sub_ps(y1, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+  y2 = _mm_add_ps(y2, x);
+  y1 = _mm_add_ps(y1, _mm_set1_ps(1.0f));
+
+  /* select the correct result from the two polynoms */
+  __m128 ys = _mm_blendv_ps(y1, y2, poly_mask);
+  __m128 yc = _mm_blendv_ps(y2, y1, poly_mask);
+  *ysin = _mm_xor_ps(ys, sign_bit_sin);
+  *ycos = _mm_xor_ps(yc, sign_bit_cos);
+}